@@ -0,0 +1,95 @@
+#include "arena.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "custom_assert.h"
+
+static ArenaBlock* ArenaBlockCreate(size_t capacity) {
+	ArenaBlock* block = malloc(sizeof(ArenaBlock) + capacity);
+	assert(block != NULL, "No memory!");
+	*block = (ArenaBlock) { .next = NULL, .capacity = capacity, .size = 0 };
+	return block;
+}
+
+Arena* ArenaCreate(size_t blockCapacity) {
+	assert(blockCapacity > 0, "Arena blocks can not be empty!");
+
+	Arena* arena = malloc(sizeof(Arena));
+	assert(arena != NULL, "No memory!");
+
+	ArenaBlock* block = ArenaBlockCreate(blockCapacity);
+	*arena = (Arena) { .first = block, .current = block, .blockCapacity = blockCapacity };
+	return arena;
+}
+
+void ArenaFree(Arena* arena) {
+	ArenaBlock* block = arena->first;
+	while (block != NULL) {
+		ArenaBlock* next = block->next;
+		free(block);
+		block = next;
+	}
+	free(arena);
+}
+
+void* ArenaAllocate(Arena* arena, size_t size, size_t alignment) {
+	assert(alignment <= alignof(max_align_t) && (alignment & (alignment - 1)) == 0, "Unsupported alignment!");
+
+	ArenaBlock* block = arena->current;
+	size_t offset = (block->size + alignment - 1) & ~(alignment - 1);
+	while (offset + size > block->capacity) {
+		// Blocks after the current one are left over from before a reset, they are empty
+		if(block->next != NULL && block->next->capacity >= size) {
+			block = block->next;
+			block->size = 0;
+			offset = 0;
+			continue;
+		}
+
+		// Grow geometrically, so there are only a logarithmic amount of blocks
+		arena->blockCapacity *= 2;
+		while (arena->blockCapacity < size) {
+			arena->blockCapacity *= 2;
+		}
+
+		ArenaBlock* grown = ArenaBlockCreate(arena->blockCapacity);
+		grown->next = block->next;
+		block->next = grown;
+		block = grown;
+		offset = 0;
+	}
+	arena->current = block;
+
+	void* memory = block->data + offset;
+	block->size = offset + size;
+	return memory;
+}
+
+void* ArenaAllocateZero(Arena* arena, size_t size, size_t alignment) {
+	void* memory = ArenaAllocate(arena, size, alignment);
+	memset(memory, 0, size);
+	return memory;
+}
+
+void ArenaReset(Arena* arena) {
+	arena->current = arena->first;
+	arena->first->size = 0;
+}
+
+size_t ArenaCapacity(Arena* arena) {
+	size_t capacity = 0;
+	for (ArenaBlock* block = arena->first; block != NULL; block = block->next) {
+		capacity += block->capacity;
+	}
+	return capacity;
+}
+
+size_t ArenaSize(Arena* arena) {
+	size_t size = 0;
+	for (ArenaBlock* block = arena->first; block != arena->current; block = block->next) {
+		size += block->size;
+	}
+	return size + arena->current->size;
+}
@@ -0,0 +1,43 @@
+#ifndef SIMULATOR_ARENA_H
+#define SIMULATOR_ARENA_H
+
+#include <stdalign.h>
+#include <stddef.h>
+
+//-----------------------------------------------------------------------------
+// Arena
+//-----------------------------------------------------------------------------
+
+// Bump allocator over a chain of contiguous blocks, each one at least twice as big as the one before
+// Allocations are never freed one by one, only all together by ArenaReset or ArenaFree
+typedef struct ArenaBlock {
+	struct ArenaBlock* next;
+	size_t capacity;
+	size_t size;
+	alignas(max_align_t) unsigned char data[];
+} ArenaBlock;
+
+typedef struct Arena {
+	ArenaBlock* first;
+	ArenaBlock* current;
+	size_t blockCapacity;
+} Arena;
+
+Arena* ArenaCreate(size_t blockCapacity);
+
+void ArenaFree(Arena* arena);
+
+// alignment is a power of two no bigger than alignof(max_align_t), usually alignof of the allocated type
+void* ArenaAllocate(Arena* arena, size_t size, size_t alignment);
+
+void* ArenaAllocateZero(Arena* arena, size_t size, size_t alignment);
+
+// Makes all the memory available again without returning the blocks to the system, in constant time
+void ArenaReset(Arena* arena);
+
+// Total capacity of the blocks and the amount of it in use
+size_t ArenaCapacity(Arena* arena);
+
+size_t ArenaSize(Arena* arena);
+
+#endif //SIMULATOR_ARENA_H
@@ -0,0 +1,216 @@
+#include <raylib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "simulator.h"
+#include "constraint_type.h"
+#include "constraint_kernels.h"
+#include "custom_assert.h"
+
+// Without generated kernels every template is built from its symbolic function, or read from the cache
+const ConstraintKernel constraintKernels[CONSTRAINT_TYPE_COUNT] = { 0 };
+
+#define SCENE_PARTICLES 1000
+#define RUNS 20
+#define PARALLEL_SCENE_CONSTRAINTS 50000
+#define PARALLEL_RUNS 5
+
+static const unsigned int threadCounts[] = { 1, 2, 4, 8 };
+
+static const char* cacheFiles[] = { "circle.graph", "distance.graph" };
+
+static double Now() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1e3 + time.tv_nsec / 1e6;
+}
+
+static void ClearCache(const char* directory) {
+	char path[4096];
+	for (unsigned int i = 0; i < sizeof(cacheFiles) / sizeof(cacheFiles[0]); ++i) {
+		snprintf(path, sizeof(path), "%s/%s", directory, cacheFiles[i]);
+		remove(path);
+	}
+}
+
+// Constraints with their particle lists and the particles they were made of
+static void SceneFree(ParticleArray* particles, ConstraintArray* constraints) {
+	for (unsigned int i = 0; i < constraints->size; ++i) {
+		free(constraints->start[i]->particles->start);
+		free(constraints->start[i]->particles);
+	}
+	ConstraintArrayFree(constraints);
+	ParticleArrayFree(particles);
+}
+
+// Only the templates of every type, what the cache saves
+static double BuildTemplates(const char* directory) {
+	const double start = Now();
+
+	SymbolMatrixArray* symbolMatrixArray = SymbolMatrixArrayCreate();
+	ConstraintTemplate* templates[CONSTRAINT_TYPE_COUNT];
+	for (unsigned int i = 0; i < CONSTRAINT_TYPE_COUNT; ++i) {
+		templates[i] = ConstraintTypeTemplateLoad(symbolMatrixArray, i, directory);
+	}
+
+	const double end = Now();
+
+	for (unsigned int i = 0; i < CONSTRAINT_TYPE_COUNT; ++i) {
+		ConstraintTemplateFree(templates[i]);
+	}
+	SymbolMatrixArrayFree(symbolMatrixArray);
+
+	return end - start;
+}
+
+// Chain of particles held together by distance constraints, the first one on a circle
+static double BuildScene(const char* directory) {
+	const double start = Now();
+
+	SymbolMatrixArray* symbolMatrixArray = SymbolMatrixArrayCreate();
+	ParticleArray* particles = ParticleArrayCreate();
+	ConstraintArray* constraints = ConstraintArrayCreate();
+	constraints->cacheDirectory = directory;
+
+	Particle* previous = ParticleCreate(particles, (Vector2) { .x = 250.0f, .y = 200.0f }, false);
+	CircleConstraintCreate(constraints, symbolMatrixArray, ParticleArrayOf(1, previous),
+	                       (Vector2) { .x = 200.0f, .y = 200.0f }, (Vector2) { .x = 50.0f, .y = 50.0f });
+
+	for (unsigned int i = 1; i < SCENE_PARTICLES; ++i) {
+		Particle* particle = ParticleCreate(particles, (Vector2) { .x = 250.0f + i * 10.0f, .y = 200.0f }, false);
+		DistanceConstraintCreate(constraints, symbolMatrixArray, ParticleArrayOf(2, previous, particle), 10.0f);
+		previous = particle;
+	}
+
+	const double end = Now();
+
+	SceneFree(particles, constraints);
+	SymbolMatrixArrayFree(symbolMatrixArray);
+
+	return end - start;
+}
+
+// Descriptions of a chain of PARALLEL_SCENE_CONSTRAINTS particles, the first one on a circle
+static ConstraintDescription* ChainDescriptions(ParticleArray* particles) {
+	ConstraintDescription* descriptions = calloc(PARALLEL_SCENE_CONSTRAINTS, sizeof(ConstraintDescription));
+	assert(descriptions != NULL, "No memory!");
+
+	Particle* previous = ParticleCreate(particles, (Vector2) { .x = 250.0f, .y = 200.0f }, false);
+	descriptions[0] = (ConstraintDescription) {
+		.type = CIRCLE,
+		.particles = ParticleArrayOf(1, previous),
+		.metadata.circle = { .center = { .x = 200.0f, .y = 200.0f }, .radius = { .x = 50.0f, .y = 50.0f } },
+	};
+	for (unsigned int i = 1; i < PARALLEL_SCENE_CONSTRAINTS; ++i) {
+		Particle* particle = ParticleCreate(particles, (Vector2) { .x = 250.0f + i * 10.0f, .y = 200.0f }, false);
+		descriptions[i] = (ConstraintDescription) {
+			.type = DISTANCE,
+			.particles = ParticleArrayOf(2, previous, particle),
+			.metadata.distance = { .distance = 10.0f },
+		};
+		previous = particle;
+	}
+
+	return descriptions;
+}
+
+// Templates and constraints of the chain created one by one, or by ConstraintsCreateParallel when there is a pool
+// Particle lists are made beforehand, so both only time what they do differently
+static double BuildChain(ThreadPool* pool) {
+	SymbolMatrixArray* symbolMatrixArray = SymbolMatrixArrayCreate();
+	ParticleArray* particles = ParticleArrayCreate();
+	ConstraintArray* constraints = ConstraintArrayCreate();
+	ConstraintDescription* descriptions = ChainDescriptions(particles);
+
+	const double start = Now();
+	if(pool != NULL) {
+		ConstraintsCreateParallel(constraints, pool, descriptions, PARALLEL_SCENE_CONSTRAINTS);
+	} else {
+		CircleConstraintCreate(constraints, symbolMatrixArray, descriptions[0].particles,
+		                       descriptions[0].metadata.circle.center, descriptions[0].metadata.circle.radius);
+		for (unsigned int i = 1; i < PARALLEL_SCENE_CONSTRAINTS; ++i) {
+			DistanceConstraintCreate(constraints, symbolMatrixArray, descriptions[i].particles,
+			                         descriptions[i].metadata.distance.distance);
+		}
+	}
+	const double end = Now();
+
+	// The particle lists of the descriptions went to the constraints
+	free(descriptions);
+	SceneFree(particles, constraints);
+	SymbolMatrixArrayFree(symbolMatrixArray);
+
+	return end - start;
+}
+
+static void Report(const char* name, const double* times, unsigned int runs) {
+	double minimum = times[0];
+	double total = 0;
+	for (unsigned int i = 0; i < runs; ++i) {
+		minimum = times[i] < minimum ? times[i] : minimum;
+		total += times[i];
+	}
+
+	printf("%-16s min %8.3f ms  mean %8.3f ms\n", name, minimum, total / runs);
+}
+
+// Builds a scene of SCENE_PARTICLES particles with an empty and with a filled graph cache, then a chain of
+// PARALLEL_SCENE_CONSTRAINTS constraints one by one and with ConstraintsCreateParallel on pools of threadCounts threads
+// The cache goes to the directory given as argument, or to a temporary one
+int main(int argc, char** argv) {
+	SetTraceLogLevel(LOG_WARNING);
+
+	char temporary[] = "/tmp/constraint_cache_XXXXXX";
+	const char* directory = argc > 1 ? argv[1] : mkdtemp(temporary);
+	assert(directory != NULL, "Can not create cache directory!");
+
+	double templatesCold[RUNS];
+	double templatesWarm[RUNS];
+	double sceneCold[RUNS];
+	double sceneWarm[RUNS];
+
+	for (unsigned int i = 0; i < RUNS; ++i) {
+		ClearCache(directory);
+		templatesCold[i] = BuildTemplates(directory);
+		templatesWarm[i] = BuildTemplates(directory);
+
+		ClearCache(directory);
+		sceneCold[i] = BuildScene(directory);
+		sceneWarm[i] = BuildScene(directory);
+	}
+
+	printf("Templates of %u constraint types, scene of %u particles and %u constraints\n", CONSTRAINT_TYPE_COUNT,
+	       SCENE_PARTICLES, SCENE_PARTICLES);
+	Report("templates cold", templatesCold, RUNS);
+	Report("templates warm", templatesWarm, RUNS);
+	Report("scene cold", sceneCold, RUNS);
+	Report("scene warm", sceneWarm, RUNS);
+
+	// Without a cache, the templates are built too, at the same time when there are threads for them
+	double chain[PARALLEL_RUNS];
+	for (unsigned int i = 0; i < PARALLEL_RUNS; ++i) {
+		chain[i] = BuildChain(NULL);
+	}
+	printf("Chain of %u constraints, %ld processors\n", PARALLEL_SCENE_CONSTRAINTS, sysconf(_SC_NPROCESSORS_ONLN));
+	Report("one by one", chain, PARALLEL_RUNS);
+	for (unsigned int t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t) {
+		ThreadPool* pool = ThreadPoolCreate(threadCounts[t]);
+		for (unsigned int i = 0; i < PARALLEL_RUNS; ++i) {
+			chain[i] = BuildChain(pool);
+		}
+		ThreadPoolFree(pool);
+
+		char name[32];
+		snprintf(name, sizeof(name), "parallel %u", threadCounts[t]);
+		Report(name, chain, PARALLEL_RUNS);
+	}
+
+	ClearCache(directory);
+	if(argc <= 1) {
+		rmdir(directory);
+	}
+
+	return 0;
+}
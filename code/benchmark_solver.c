@@ -0,0 +1,150 @@
+#include <math.h>
+#include <raylib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "simulator.h"
+#include "constraint_type.h"
+#include "custom_assert.h"
+
+#define STEPS 10
+#define SOLVES 5
+#define REGULARIZATION 1e-5f
+
+// The dense solvers are cubic, steps are sparse and go up to a long rope
+static const unsigned int solveSizes[] = { 16, 32, 64, 128, 256 };
+static const unsigned int stepSizes[] = { 16, 256, 1024, 4096, 10000 };
+
+static double Now() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1e3 + time.tv_nsec / 1e6;
+}
+
+// Largest entry of g λ + f, how far λ is from solving the system
+static float Residual(MatrixNArray* array, MatrixNSparse* g, MatrixN* lambda, MatrixN* f) {
+	MatrixN* r = MatrixNAdd(array, MatrixNSparseMultiply(array, g, lambda), f);
+	float residual = 0;
+	for (unsigned int i = 0; i < r->rows; ++i) {
+		residual = fmaxf(residual, fabsf(r->values[i]));
+	}
+	return residual;
+}
+
+// g = J J' for the Jacobian of a chain of particles, each constraint depends on the particle before it
+static MatrixNSparse* ChainSystem(MatrixNArray* array, unsigned int constraints) {
+	MatrixNTriplets* J = MatrixNTripletsCreate(array, constraints, 2 * constraints, 4 * constraints);
+	MatrixN* w = MatrixNCreate(array, 2 * constraints, 1);
+	srand(7);
+	for (unsigned int i = 0; i < constraints; ++i) {
+		for (unsigned int k = 0; k < 2; ++k) {
+			const float value = (float) rand() / (float) RAND_MAX * 2.0f - 1.0f;
+			MatrixNTripletsAdd(J, i, i + constraints * k, value);
+			if(i > 0) {
+				MatrixNTripletsAdd(J, i, i - 1 + constraints * k, -value);
+			}
+			*MatrixNGet(w, i + constraints * k, 0) = 1.0f;
+		}
+	}
+	return MatrixNSparseMultiplyWeightedTranspose(array, MatrixNSparseCreate(array, J), w);
+}
+
+// Best time of solving g λ = -f with the normal equations pseudoinverse, a dense and a sparse Cholesky factorization
+static void BenchmarkSolve(unsigned int constraints) {
+	MatrixNArray* array = MatrixNArrayCreate();
+	MatrixNSparse* g = ChainSystem(array, constraints);
+	MatrixN* denseG = MatrixNSparseToDense(array, g);
+	MatrixN* f = MatrixNCreate(array, constraints, 1);
+	for (unsigned int i = 0; i < constraints; ++i) {
+		f->values[i] = (float) rand() / (float) RAND_MAX * 2.0f - 1.0f;
+	}
+	MatrixN* negatedF = MatrixNNegate(array, f);
+
+	double pseudoinverseTime = 0;
+	double choleskyTime = 0;
+	double sparseTime = 0;
+	float pseudoinverseResidual = 0;
+	float choleskyResidual = 0;
+	float sparseResidual = 0;
+	for (unsigned int run = 0; run < SOLVES; ++run) {
+		double start = Now();
+		MatrixN* lambda = MatrixNMultiply(array, MatrixNPseudoinverse(array, denseG), negatedF);
+		double time = Now() - start;
+		pseudoinverseTime = run == 0 || time < pseudoinverseTime ? time : pseudoinverseTime;
+		pseudoinverseResidual = Residual(array, g, lambda, f);
+
+		start = Now();
+		lambda = MatrixNCholeskySolve(array, MatrixNCholesky(array, denseG, REGULARIZATION), negatedF);
+		time = Now() - start;
+		choleskyTime = run == 0 || time < choleskyTime ? time : choleskyTime;
+		choleskyResidual = Residual(array, g, lambda, f);
+
+		start = Now();
+		lambda = MatrixNSparseCholeskySolve(array, MatrixNSparseCholesky(array, g, REGULARIZATION), negatedF);
+		time = Now() - start;
+		sparseTime = run == 0 || time < sparseTime ? time : sparseTime;
+		sparseResidual = Residual(array, g, lambda, f);
+	}
+
+	printf("solve %5u constraints  pseudoinverse %10.3f ms (residual %.2e)  cholesky %8.3f ms (residual %.2e)  "
+	       "sparse cholesky %8.3f ms (residual %.2e)\n", constraints, pseudoinverseTime, pseudoinverseResidual,
+	       choleskyTime, choleskyResidual, sparseTime, sparseResidual);
+
+	MatrixNArrayFree(array);
+}
+
+// Chain of particles held together by distance constraints, the first one on a circle, one constraint per particle
+static void BenchmarkStep(unsigned int constraints) {
+	SymbolMatrixArray* symbolMatrixArray = SymbolMatrixArrayCreate();
+	ParticleArray* particles = ParticleArrayCreate();
+	ConstraintArray* constraintArray = ConstraintArrayCreate();
+
+	Particle* previous = ParticleCreate(particles, (Vector2) { .x = 250.0f, .y = 200.0f }, false);
+	CircleConstraintCreate(constraintArray, symbolMatrixArray, ParticleArrayOf(1, previous),
+	                       (Vector2) { .x = 200.0f, .y = 200.0f }, (Vector2) { .x = 50.0f, .y = 50.0f });
+	for (unsigned int i = 1; i < constraints; ++i) {
+		Particle* particle = ParticleCreate(particles, (Vector2) { .x = 250.0f + i * 10.0f, .y = 200.0f }, false);
+		DistanceConstraintCreate(constraintArray, symbolMatrixArray, ParticleArrayOf(2, previous, particle), 10.0f);
+		previous = particle;
+	}
+
+	Simulator simulator = SimulatorCreate(particles, constraintArray, false);
+
+	double minimum = 0;
+	double total = 0;
+	for (unsigned int i = 0; i < STEPS; ++i) {
+		const double start = Now();
+		SimulatorUpdate(&simulator, 0.0001f);
+		const double time = Now() - start;
+		minimum = i == 0 || time < minimum ? time : minimum;
+		total += time;
+	}
+
+	printf("step  %5u constraints  min %8.3f ms  mean %8.3f ms  matrices %8zu bytes\n", constraints, minimum,
+	       total / STEPS, ArenaCapacity(simulator.matrixNArray->arena));
+
+	SimulatorFree(&simulator);
+	for (unsigned int i = 0; i < constraintArray->size; ++i) {
+		// Only the list, the particles belong to the scene
+		free(constraintArray->start[i]->particles->start);
+		free(constraintArray->start[i]->particles);
+	}
+	ConstraintArrayFree(constraintArray);
+	ParticleArrayFree(particles);
+	SymbolMatrixArrayFree(symbolMatrixArray);
+}
+
+// Time of a simulation step against the amount of constraints, and of solving for λ alone with each solver
+int main() {
+	SetTraceLogLevel(LOG_WARNING);
+
+	for (unsigned int i = 0; i < sizeof(solveSizes) / sizeof(solveSizes[0]); ++i) {
+		BenchmarkSolve(solveSizes[i]);
+	}
+	for (unsigned int i = 0; i < sizeof(stepSizes) / sizeof(stepSizes[0]); ++i) {
+		BenchmarkStep(stepSizes[i]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,223 @@
+#include <raylib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "simulator.h"
+#include "constraint_type.h"
+#include "constraint_kernels.h"
+#include "custom_assert.h"
+
+// Templates are always built from their symbolic function here, generated kernels are not needed
+const ConstraintKernel constraintKernels[CONSTRAINT_TYPE_COUNT] = { 0 };
+
+#define RUNS 5
+// Evaluations are repeated for at least this long, so fast expressions are not timed by a single call
+#define MINIMUM_EVALUATION_TIME 50.0
+#define CONSTRAINT_BATCH 1024
+
+static const unsigned int sizes[] = { 64, 256, 1024, 4096 };
+
+typedef enum BenchmarkFormat {
+	FORMAT_CSV,
+	FORMAT_JSON,
+} BenchmarkFormat;
+
+// One row of the report, what was built, its size and how fast it was built and evaluated
+typedef struct BenchmarkResult {
+	const char* name;
+	unsigned int size;
+	unsigned int nodes;
+	size_t bytes;
+	double buildTime;
+	double evaluationsPerSecond;
+} BenchmarkResult;
+
+static double Now() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1e3 + time.tv_nsec / 1e6;
+}
+
+// Horner form of a polynomial of the given degree in x with distinct coefficients, about 3 nodes per degree
+static SymbolNode* Polynomial(SymbolNodeArray* array, SymbolNode* x, unsigned int degree) {
+	SymbolNode* result = SymbolNodeConstant(array, 1.0f);
+	for (unsigned int i = 0; i < degree; ++i) {
+		SymbolNode* coefficient = SymbolNodeConstant(array, 1.0f + (float) i / (float) degree);
+		result = SymbolNodeBinary(array, ADD, SymbolNodeBinary(array, MULTIPLY, result, x), coefficient);
+	}
+	return result;
+}
+
+// Interpreted evaluations of expression per second, x is substituted and everything folds into a constant
+static double EvaluationsPerSecond(SymbolNodeArray* array, SymbolNode* expression, SymbolNode* x) {
+	unsigned int evaluations = 0;
+	const double start = Now();
+	double elapsed;
+	do {
+		SymbolNode* value = SymbolNodeEvaluate(expression, array, x, 0.5f);
+		assert(value->operation == CONSTANT, "Expression did not fold into a constant!");
+		evaluations++;
+		elapsed = Now() - start;
+	} while(elapsed < MINIMUM_EVALUATION_TIME);
+
+	return evaluations / elapsed * 1e3;
+}
+
+// Builds the polynomial of degree size, the nodes and memory are those of the expression
+static BenchmarkResult BenchmarkEvaluate(unsigned int size) {
+	BenchmarkResult result = { .name = "evaluate", .size = size, .buildTime = 0 };
+
+	for (unsigned int run = 0; run < RUNS; ++run) {
+		SymbolNodeArray* array = SymbolNodeArrayCreate();
+		SymbolNode* x = SymbolNodeVariable(array);
+
+		const size_t before = ArenaSize(array->arena);
+		const double start = Now();
+		SymbolNode* expression = Polynomial(array, x, size);
+		const double time = Now() - start;
+
+		if(run == 0 || time < result.buildTime) {
+			result.buildTime = time;
+		}
+		if(run == 0) {
+			result.nodes = SymbolNodeCount(expression);
+			result.bytes = ArenaSize(array->arena) - before;
+			result.evaluationsPerSecond = EvaluationsPerSecond(array, expression, x);
+		}
+
+		SymbolNodeArrayFree(array);
+	}
+
+	return result;
+}
+
+// Differentiates the polynomial of degree size, the nodes and memory are those added for the derivative
+static BenchmarkResult BenchmarkDifferentiate(unsigned int size) {
+	BenchmarkResult result = { .name = "differentiate", .size = size, .buildTime = 0 };
+
+	for (unsigned int run = 0; run < RUNS; ++run) {
+		SymbolNodeArray* array = SymbolNodeArrayCreate();
+		SymbolNode* x = SymbolNodeVariable(array);
+		SymbolNode* expression = Polynomial(array, x, size);
+
+		const size_t before = ArenaSize(array->arena);
+		const double start = Now();
+		SymbolNode* derivative = SymbolNodeDifferentiate(expression, array, x);
+		const double time = Now() - start;
+
+		if(run == 0 || time < result.buildTime) {
+			result.buildTime = time;
+		}
+		if(run == 0) {
+			result.nodes = SymbolNodeCount(derivative);
+			result.bytes = ArenaSize(array->arena) - before;
+			result.evaluationsPerSecond = EvaluationsPerSecond(array, derivative, x);
+		}
+
+		SymbolNodeArrayFree(array);
+	}
+
+	return result;
+}
+
+// Builds, differentiates and compiles the template of a type, evaluated for CONSTRAINT_BATCH constraints at once
+// The nodes are those of f and df/dx, the memory all the nodes and matrices built on the way
+static BenchmarkResult BenchmarkConstraint(const char* name, ConstraintType type) {
+	BenchmarkResult result = { .name = name, .size = 1, .buildTime = 0 };
+
+	for (unsigned int run = 0; run < RUNS; ++run) {
+		SymbolMatrixArray* symbolMatrixArray = SymbolMatrixArrayCreate();
+
+		const double start = Now();
+		ConstraintTemplate* constraintTemplate = ConstraintTypeTemplateCreate(symbolMatrixArray, type);
+		const double time = Now() - start;
+
+		if(run == 0 || time < result.buildTime) {
+			result.buildTime = time;
+		}
+		if(run == 0) {
+			result.nodes = SymbolNodeCount(constraintTemplate->constraintFunction)
+			               + SymbolMatrixCount(constraintTemplate->constraintFunction_dx);
+			result.bytes = ArenaSize(symbolMatrixArray->arena) + ArenaSize(symbolMatrixArray->nodeArray->arena);
+
+			const unsigned int inputCount = constraintTemplate->inputCount * CONSTRAINT_BATCH;
+			const unsigned int outputCount = constraintTemplate->outputCount * CONSTRAINT_BATCH;
+			float* inputs = calloc(inputCount, sizeof(float));
+			float* inputTangents = calloc(inputCount, sizeof(float));
+			float* outputs = calloc(outputCount, sizeof(float));
+			float* outputTangents = calloc(outputCount, sizeof(float));
+			assert(inputs != NULL && inputTangents != NULL && outputs != NULL && outputTangents != NULL, "No memory!");
+			for (unsigned int i = 0; i < inputCount; ++i) {
+				inputs[i] = 1.0f + (float) (i % 7);
+				inputTangents[i] = 0.5f;
+			}
+
+			unsigned int evaluations = 0;
+			const double evaluationStart = Now();
+			double elapsed;
+			do {
+				SymbolTapeEvaluateDualBatch(constraintTemplate->tape, CONSTRAINT_BATCH, inputs, inputTangents, outputs,
+				                            outputTangents);
+				evaluations += CONSTRAINT_BATCH;
+				elapsed = Now() - evaluationStart;
+			} while(elapsed < MINIMUM_EVALUATION_TIME);
+			result.evaluationsPerSecond = evaluations / elapsed * 1e3;
+
+			free(inputs);
+			free(inputTangents);
+			free(outputs);
+			free(outputTangents);
+		}
+
+		ConstraintTemplateFree(constraintTemplate);
+		SymbolMatrixArrayFree(symbolMatrixArray);
+	}
+
+	return result;
+}
+
+static void Report(BenchmarkFormat format, const BenchmarkResult* results, unsigned int count) {
+	if(format == FORMAT_CSV) {
+		printf("benchmark,size,nodes,bytes,build_ms,evaluations_per_second\n");
+		for (unsigned int i = 0; i < count; ++i) {
+			printf("%s,%u,%u,%zu,%.6f,%.1f\n", results[i].name, results[i].size, results[i].nodes, results[i].bytes,
+			       results[i].buildTime, results[i].evaluationsPerSecond);
+		}
+	} else {
+		printf("[\n");
+		for (unsigned int i = 0; i < count; ++i) {
+			printf("  {\"benchmark\": \"%s\", \"size\": %u, \"nodes\": %u, \"bytes\": %zu, \"build_ms\": %.6f, "
+			       "\"evaluations_per_second\": %.1f}%s\n", results[i].name, results[i].size, results[i].nodes,
+			       results[i].bytes, results[i].buildTime, results[i].evaluationsPerSecond, i + 1 < count ? "," : "");
+		}
+		printf("]\n");
+	}
+}
+
+// Measures the symbolic engine on polynomials of growing degree and on the built-in constraint templates
+// Results are written to stdout as CSV, or as JSON with --json, build times are the best of RUNS runs
+int main(int argc, char** argv) {
+	assert(argc == 1 || (argc == 2 && (strcmp(argv[1], "--csv") == 0 || strcmp(argv[1], "--json") == 0)),
+	       "Usage: benchmark_symdiff [--csv | --json]");
+	const BenchmarkFormat format = argc == 2 && strcmp(argv[1], "--json") == 0 ? FORMAT_JSON : FORMAT_CSV;
+
+	SetTraceLogLevel(LOG_WARNING);
+
+	const unsigned int sizeCount = sizeof(sizes) / sizeof(sizes[0]);
+	BenchmarkResult results[2 * sizeof(sizes) / sizeof(sizes[0]) + CONSTRAINT_TYPE_COUNT];
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < sizeCount; ++i) {
+		results[count++] = BenchmarkEvaluate(sizes[i]);
+	}
+	for (unsigned int i = 0; i < sizeCount; ++i) {
+		results[count++] = BenchmarkDifferentiate(sizes[i]);
+	}
+	results[count++] = BenchmarkConstraint("circle", CIRCLE);
+	results[count++] = BenchmarkConstraint("distance", DISTANCE);
+
+	Report(format, results, count);
+
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include <raylib.h>
+#include <stdio.h>
+
+#include "simulator.h"
+#include "constraint_type.h"
+#include "constraint_kernels.h"
+#include "custom_assert.h"
+
+// The generator builds every template from its symbolic function, so it links without any kernel
+const ConstraintKernel constraintKernels[CONSTRAINT_TYPE_COUNT] = { 0 };
+
+static const char* kernelNames[CONSTRAINT_TYPE_COUNT] = {
+	[CIRCLE] = "CircleConstraintKernel",
+	[DISTANCE] = "DistanceConstraintKernel",
+};
+
+static const char* typeNames[CONSTRAINT_TYPE_COUNT] = {
+	[CIRCLE] = "CIRCLE",
+	[DISTANCE] = "DISTANCE",
+};
+
+// Writes the kernels of the built-in constraint types and the constraintKernels table to the file given as argument
+int main(int argc, char** argv) {
+	assert(argc == 2, "Usage: constraint_codegen <output file>");
+
+	SetTraceLogLevel(LOG_WARNING);
+
+	FILE* file = fopen(argv[1], "w");
+	assert(file != NULL, "Can not open output file!");
+
+	SymbolMatrixArray* symbolMatrixArray = SymbolMatrixArrayCreate();
+	ConstraintTemplate* templates[CONSTRAINT_TYPE_COUNT];
+
+	fprintf(file, "// Generated by constraint_codegen, do not edit\n\n");
+
+	for (unsigned int i = 0; i < CONSTRAINT_TYPE_COUNT; ++i) {
+		templates[i] = ConstraintTypeTemplateCreate(symbolMatrixArray, i);
+		SymbolTapeGenerateC(templates[i]->tape, kernelNames[i], file);
+		fprintf(file, "\n");
+
+		// Sparsity of df/dx, so the kernel skips the same zeros as the symbolic template
+		// An empty array is not valid C, a Jacobian without nonzeros is left NULL instead
+		if(templates[i]->jacobianEntryCount > 0) {
+			fprintf(file, "static const unsigned int %sJacobian[] = {", kernelNames[i]);
+			for (unsigned int j = 0; j < templates[i]->jacobianEntryCount; ++j) {
+				fprintf(file, "%s %u", j == 0 ? "" : ",", templates[i]->jacobianEntries[j]);
+			}
+			fprintf(file, " };\n\n");
+		}
+	}
+
+	fprintf(file, "const ConstraintKernel constraintKernels[CONSTRAINT_TYPE_COUNT] = {\n");
+	for (unsigned int i = 0; i < CONSTRAINT_TYPE_COUNT; ++i) {
+		fprintf(file, "\t[%s] = { .evaluate = %s, .particleCount = %u, .parameterCount = %u,\n", typeNames[i],
+		        kernelNames[i], templates[i]->particleCount, templates[i]->parameterCount);
+		if(templates[i]->jacobianEntryCount > 0) {
+			fprintf(file, "\t             .jacobianEntries = %sJacobian, ", kernelNames[i]);
+		} else {
+			fprintf(file, "\t             .jacobianEntries = NULL, ");
+		}
+		fprintf(file, ".jacobianEntryCount = %u },\n", templates[i]->jacobianEntryCount);
+		ConstraintTemplateFree(templates[i]);
+	}
+	fprintf(file, "};\n");
+
+	SymbolMatrixArrayFree(symbolMatrixArray);
+
+	const bool failed = ferror(file) != 0;
+	fclose(file);
+
+	return failed ? 1 : 0;
+}
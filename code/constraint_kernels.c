@@ -0,0 +1,4 @@
+#include "constraint_kernels.h"
+
+// Kernel functions and the constraintKernels table, generated in the build directory
+#include "constraint_kernels_generated.h"
@@ -0,0 +1,14 @@
+#ifndef SIMULATOR_CONSTRAINT_KERNELS_H
+#define SIMULATOR_CONSTRAINT_KERNELS_H
+
+#include "simulator.h"
+
+//-----------------------------------------------------------------------------
+// Constraint kernels
+//-----------------------------------------------------------------------------
+
+// Emitted by constraint_codegen at build time for the built-in constraint types
+// Types without a kernel have a NULL entry and are evaluated by interpreting their tape
+extern const ConstraintKernel constraintKernels[CONSTRAINT_TYPE_COUNT];
+
+#endif //SIMULATOR_CONSTRAINT_KERNELS_H
@@ -1,7 +1,17 @@
 #include "constraint_type.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "constraint_kernels.h"
 #include "custom_assert.h"
 #include "math.h"
 
+// Hash of the code that builds the constraint graphs, set by the build, a cached graph is only used with the same hash
+#ifndef CONSTRAINT_BUILD_HASH
+#error "CONSTRAINT_BUILD_HASH is not defined"
+#endif
+
 SymbolMatrix* TaylorPositionApproximation(SymbolMatrixArray* array, SymbolNode* t, SymbolNode* xx, SymbolNode* xy,
                                           SymbolNode* vx, SymbolNode* vy, SymbolNode* ax, SymbolNode* ay) {
 	SymbolMatrix* t1 = SymbolMatrixCreate(array, 1, 2);                                                                 // x
@@ -17,7 +27,7 @@ SymbolMatrix* TaylorPositionApproximation(SymbolMatrixArray* array, SymbolNode*
 	SymbolMatrixSet(t3, 0, 1, ay);
 
 	SymbolMatrix* t4 = SymbolMatrixMultiplyValue(array, t2, t);                                                         // v * t
-	SymbolNode* t5 = SymbolNodeBinary(array->nodeArray, MULTIPLY, t, t);                                                // t^2
+	SymbolNode* t5 = SymbolNodeUnary(array->nodeArray, SQUARE, t);                                                      // t^2
 	SymbolMatrix* t6 = SymbolMatrixMultiplyValue(array, t3, t5);                                                        // a * t^2
 	SymbolMatrix* t7 = SymbolMatrixMultiplyValue(array, t6, SymbolNodeConstant(array->nodeArray, 0.5f));                // 1/2 * a * t^2
 	SymbolMatrix* t8 = SymbolMatrixAdd(array, t1, t4);                                                                  // x + v * t
@@ -26,8 +36,31 @@ SymbolMatrix* TaylorPositionApproximation(SymbolMatrixArray* array, SymbolNode*
 	return t9;
 }
 
+// Constraints are only ever evaluated at t = 0, binding it once removes the v * t and a * t^2 terms from the graph
+// The time derivatives are recovered from the position tangents, dx/dt = v at t = 0
+SymbolNode* ConstraintFunctionSpecialize(SymbolMatrixArray* array, const char* name, SymbolNode* f, SymbolNode* t) {
+	SymbolNode* specialized = SymbolNodeSimplify(SymbolNodeEvaluate(f, array->nodeArray, t, 0.0f), array->nodeArray);
+
+	TraceLog(LOG_DEBUG, "%s constraint specialized for t = 0 from %u to %u nodes", name, SymbolNodeCount(f),
+	         SymbolNodeCount(specialized));
+
+	return specialized;
+}
+
+// Simplifies the constraint function and its derivative in place, logging the amount of nodes before and after
+void ConstraintFunctionSimplify(SymbolMatrixArray* array, const char* name, SymbolNode** f, SymbolMatrix** df_dx) {
+	const unsigned int before = SymbolNodeCount(*f) + SymbolMatrixCount(*df_dx);
+
+	*f = SymbolNodeSimplify(*f, array->nodeArray);
+	*df_dx = SymbolMatrixSimplify(*df_dx, array);
+
+	const unsigned int after = SymbolNodeCount(*f) + SymbolMatrixCount(*df_dx);
+
+	TraceLog(LOG_DEBUG, "%s constraint simplified from %u to %u nodes", name, before, after);
+}
+
 SymbolNode* CircleConstraintFunction(SymbolMatrixArray* array, SymbolNode* t, SymbolMatrix* x, SymbolMatrix* v, SymbolMatrix* a,
-                                     Vector2 center, Vector2 radius) {
+                                     SymbolMatrix* center, SymbolMatrix* radius) {
 	SymbolMatrix* positionParticle1 = TaylorPositionApproximation(array, t,
 	                                                              SymbolMatrixGet(x, 0, 0), SymbolMatrixGet(x, 0, 1),
 	                                                              SymbolMatrixGet(v, 0, 0), SymbolMatrixGet(v, 0, 1),
@@ -35,26 +68,17 @@ SymbolNode* CircleConstraintFunction(SymbolMatrixArray* array, SymbolNode* t, Sy
 
 	//const float distance = sum((x(t) - center) ** 2 / 2 - (radius ** 2) / 2);
 
-	SymbolMatrix* t1 = SymbolMatrixCreate(array, 1, 2);                                                                 // -1 * center
-	SymbolMatrixSet(t1, 0, 0, SymbolNodeConstant(array->nodeArray, -center.x));
-	SymbolMatrixSet(t1, 0, 1, SymbolNodeConstant(array->nodeArray, -center.y));
-
-	SymbolMatrix* t2 = SymbolMatrixAdd(array, positionParticle1, t1);                                                   // x(t) - center
-	SymbolMatrix* t3 = SymbolMatrixMultiplyElementWise(array, t2, t2);                                                  // (x(t) - center) ** 2
-	SymbolMatrix* t4 = SymbolMatrixMultiplyValue(array, t3, SymbolNodeConstant(array->nodeArray, 0.5f));                // (x(t) - center) ** 2 / 2
-	SymbolMatrix* t5 = SymbolMatrixCreate(array, 1, 2);                                                                 // (radius ** 2) / 2)
-	SymbolMatrixSet(t5, 0, 0, SymbolNodeConstant(array->nodeArray, (radius.x * radius.x) / 2.0f));
-	SymbolMatrixSet(t5, 0, 1, SymbolNodeConstant(array->nodeArray, (radius.y * radius.y) / 2.0f));
-	SymbolMatrix* t6 = SymbolMatrixSubtract(array, t4, t5);                                                             // (x(t) - center) ** 2 / 2 - (radius ** 2) / 2
-	SymbolNode* t7 = SymbolNodeBinary(array->nodeArray, ADD, SymbolMatrixGet(t6, 0, 0), SymbolMatrixGet(t6, 0, 1));     // sum((x(t) - center) ** 2 / 2 - (radius ** 2) / 2)
+	SymbolMatrix* t1 = SymbolMatrixSubtract(array, positionParticle1, center);                                          // x(t) - center
+	SymbolNode* t2 = SymbolMatrixDot(array, t1, t1);                                                                    // sum((x(t) - center) ** 2)
+	SymbolNode* t3 = SymbolMatrixDot(array, radius, radius);                                                            // sum(radius ** 2)
+	SymbolNode* t4 = SymbolNodeBinary(array->nodeArray, MULTIPLY, SymbolNodeConstant(array->nodeArray, -0.5f), t3);     // -sum(radius ** 2) / 2
+	SymbolNode* t5 = SymbolNodeFma(array->nodeArray, SymbolNodeConstant(array->nodeArray, 0.5f), t2, t4);               // sum((x(t) - center) ** 2 / 2 - (radius ** 2) / 2)
 
-	return t7;
+	return t5;
 }
 
-Constraint* CircleConstraintCreate(ConstraintArray* constraintsArray, SymbolMatrixArray* symbolMatrixArray,
-								   ParticleArray* particlesArray, Vector2 center, Vector2 radius) {
-	assert(particlesArray->size == 1, "Circle constraint has incorrect number of particles!");
-
+// Parameters are center and radius
+ConstraintTemplate* CircleConstraintTemplateCreate(SymbolMatrixArray* symbolMatrixArray) {
 	SymbolNode* t = SymbolNodeVariable(symbolMatrixArray->nodeArray);
 	SymbolMatrix* x = SymbolMatrixCreate(symbolMatrixArray, 1, 2);
 	SymbolMatrixSet(x, 0, 0, SymbolNodeVariable(symbolMatrixArray->nodeArray));
@@ -66,22 +90,60 @@ Constraint* CircleConstraintCreate(ConstraintArray* constraintsArray, SymbolMatr
 	SymbolMatrixSet(a, 0, 0, SymbolNodeVariable(symbolMatrixArray->nodeArray));
 	SymbolMatrixSet(a, 0, 1, SymbolNodeVariable(symbolMatrixArray->nodeArray));
 
-	SymbolNode* f = CircleConstraintFunction(symbolMatrixArray, t, x, v, a, center, radius);
-	SymbolNode* df_dt = SymbolNodeDifferentiate(f, symbolMatrixArray->nodeArray, t);
-	SymbolMatrix* df_dx = SymbolNodeDifferentiateSymbolMatrix(f, symbolMatrixArray, x);
-	SymbolMatrix* df_dxdt = SymbolMatrixDifferentiateSymbolNode(df_dx, symbolMatrixArray, t);
+	SymbolMatrix* center = SymbolMatrixCreate(symbolMatrixArray, 1, 2);
+	SymbolMatrixSet(center, 0, 0, SymbolNodeVariable(symbolMatrixArray->nodeArray));
+	SymbolMatrixSet(center, 0, 1, SymbolNodeVariable(symbolMatrixArray->nodeArray));
+	SymbolMatrix* radius = SymbolMatrixCreate(symbolMatrixArray, 1, 2);
+	SymbolMatrixSet(radius, 0, 0, SymbolNodeVariable(symbolMatrixArray->nodeArray));
+	SymbolMatrixSet(radius, 0, 1, SymbolNodeVariable(symbolMatrixArray->nodeArray));
+	SymbolMatrix* parameters = SymbolMatrixCreate(symbolMatrixArray, 1, 4);
+	SymbolMatrixSet(parameters, 0, 0, SymbolMatrixGet(center, 0, 0));
+	SymbolMatrixSet(parameters, 0, 1, SymbolMatrixGet(center, 0, 1));
+	SymbolMatrixSet(parameters, 0, 2, SymbolMatrixGet(radius, 0, 0));
+	SymbolMatrixSet(parameters, 0, 3, SymbolMatrixGet(radius, 0, 1));
+
+	SymbolNode* f = ConstraintFunctionSpecialize(symbolMatrixArray, "Circle",
+	                                             CircleConstraintFunction(symbolMatrixArray, t, x, v, a, center, radius), t);
+	SymbolMatrix* df_dx = SymbolNodeGradientSymbolMatrix(f, symbolMatrixArray, x);
+	ConstraintFunctionSimplify(symbolMatrixArray, "Circle", &f, &df_dx);
+
+	return ConstraintTemplateCreate(CIRCLE, parameters, x, f, df_dx);
+}
+
+// Values of the parameter variables of the template of type, in the order of its parameters matrix
+static void ConstraintParameters(ConstraintType type, const ConstraintMetadata* metadata, float* parameters) {
+	switch (type) {
+		case CIRCLE:
+			parameters[0] = metadata->circle.center.x;
+			parameters[1] = metadata->circle.center.y;
+			parameters[2] = metadata->circle.radius.x;
+			parameters[3] = metadata->circle.radius.y;
+			break;
+		case DISTANCE:
+			parameters[0] = metadata->distance.distance;
+			break;
+		default:
+			assert(false, "Unknown constraint type!");
+	}
+}
+
+Constraint* CircleConstraintCreate(ConstraintArray* constraintsArray, SymbolMatrixArray* symbolMatrixArray,
+								   ParticleArray* particlesArray, Vector2 center, Vector2 radius) {
+	assert(particlesArray->size == 1, "Circle constraint has incorrect number of particles!");
 
-	Constraint* constraint = ConstraintCreate(constraintsArray, particlesArray, CIRCLE, t, x, v, a, f, df_dt, df_dx,
-											  df_dxdt);
+	const ConstraintMetadata metadata = { .circle = { .center = center, .radius = radius } };
+	float parameters[CONSTRAINT_MAX_PARAMETERS];
+	ConstraintParameters(CIRCLE, &metadata, parameters);
 
-	constraint->metadata.circle.center = center;
-	constraint->metadata.circle.radius = radius;
+	ConstraintTemplate* constraintTemplate = ConstraintTypeTemplate(constraintsArray, symbolMatrixArray, CIRCLE);
+	Constraint* constraint = ConstraintCreate(constraintsArray, particlesArray, constraintTemplate, parameters);
+	constraint->metadata = metadata;
 
 	return constraint;
 }
 
 SymbolNode* DistanceConstraintFunction(SymbolMatrixArray* array, SymbolNode* t, SymbolMatrix* x, SymbolMatrix* v,
-                                       SymbolMatrix* a, float distance) {
+                                       SymbolMatrix* a, SymbolNode* distance) {
 	SymbolMatrix* positionParticle1 = TaylorPositionApproximation(array, t,
 	                                                              SymbolMatrixGet(x, 0, 0), SymbolMatrixGet(x, 0, 1),
 	                                                              SymbolMatrixGet(v, 0, 0), SymbolMatrixGet(v, 0, 1),
@@ -102,21 +164,16 @@ SymbolNode* DistanceConstraintFunction(SymbolMatrixArray* array, SymbolNode* t,
 	SymbolMatrixSet(t2, 0, 1, SymbolMatrixGet(positionParticle2, 0, 1));
 
 	SymbolMatrix* t3 = SymbolMatrixSubtract(array, t1, t2);                                                             // x_1(t) - x_2(t)
-	SymbolMatrix* t4 = SymbolMatrixMultiplyElementWise(array, t3, t3);                                                  // (x_1(t) - x_2(t)) ** 2
-	SymbolMatrix* t5 = SymbolMatrixMultiplyValue(array, t4, SymbolNodeConstant(array->nodeArray, 0.5f));                // (x_1(t) - x_2(t)) ** 2 / 2
-	SymbolMatrix* t6 = SymbolMatrixCreate(array, 1, 2);                                                                 // (distance ** 2) / 2)
-	SymbolMatrixSet(t6, 0, 0, SymbolNodeConstant(array->nodeArray, (distance * distance) / 2.0f));
-	SymbolMatrixSet(t6, 0, 1, SymbolNodeConstant(array->nodeArray, (distance * distance) / 2.0f));
-	SymbolMatrix* t7 = SymbolMatrixSubtract(array, t5, t6);                                                             // (x_1(t) - x_2(t)) ** 2 / 2 - (distance ** 2) / 2)
-	SymbolNode* t8 = SymbolNodeBinary(array->nodeArray, ADD, SymbolMatrixGet(t7, 0, 0), SymbolMatrixGet(t7, 0, 1));     // sum((x_1(t) - x_2(t)) ** 2 / 2 - (distance ** 2) / 2))
+	SymbolNode* t4 = SymbolMatrixDot(array, t3, t3);                                                                    // sum((x_1(t) - x_2(t)) ** 2)
+	SymbolNode* t5 = SymbolNodeUnary(array->nodeArray, SQUARE, distance);                                               // distance ** 2
+	SymbolNode* t6 = SymbolNodeUnary(array->nodeArray, NEGATE, t5);                                                     // -2 * (distance ** 2) / 2, once for each coordinate
+	SymbolNode* t7 = SymbolNodeFma(array->nodeArray, SymbolNodeConstant(array->nodeArray, 0.5f), t4, t6);               // sum((x_1(t) - x_2(t)) ** 2 / 2 - (distance ** 2) / 2))
 
-	return t8;
+	return t7;
 }
 
-Constraint* DistanceConstraintCreate(ConstraintArray* constraintsArray, SymbolMatrixArray* symbolMatrixArray,
-                                     ParticleArray* particlesArray, float distance) {
-	assert(particlesArray->size == 2, "Circle constraint has incorrect number of particles!");
-
+// Parameter is the distance
+ConstraintTemplate* DistanceConstraintTemplateCreate(SymbolMatrixArray* symbolMatrixArray) {
 	SymbolNode* t = SymbolNodeVariable(symbolMatrixArray->nodeArray);
 	SymbolMatrix* x = SymbolMatrixCreate(symbolMatrixArray, 2, 2);
 	SymbolMatrixSet(x, 0, 0, SymbolNodeVariable(symbolMatrixArray->nodeArray));
@@ -134,17 +191,252 @@ Constraint* DistanceConstraintCreate(ConstraintArray* constraintsArray, SymbolMa
 	SymbolMatrixSet(a, 1, 0, SymbolNodeVariable(symbolMatrixArray->nodeArray));
 	SymbolMatrixSet(a, 1, 1, SymbolNodeVariable(symbolMatrixArray->nodeArray));
 
-	SymbolNode* f = DistanceConstraintFunction(symbolMatrixArray, t, x, v, a, distance);
-	SymbolNode* df_dt = SymbolNodeDifferentiate(f, symbolMatrixArray->nodeArray, t);
-	SymbolMatrix* df_dx = SymbolNodeDifferentiateSymbolMatrix(f, symbolMatrixArray, x);
-	SymbolMatrix* df_dxdt = SymbolMatrixDifferentiateSymbolNode(df_dx, symbolMatrixArray, t);
+	SymbolMatrix* parameters = SymbolMatrixCreate(symbolMatrixArray, 1, 1);
+	SymbolMatrixSet(parameters, 0, 0, SymbolNodeVariable(symbolMatrixArray->nodeArray));
+	SymbolNode* distance = SymbolMatrixGet(parameters, 0, 0);
+
+	SymbolNode* f = ConstraintFunctionSpecialize(symbolMatrixArray, "Distance",
+	                                             DistanceConstraintFunction(symbolMatrixArray, t, x, v, a, distance), t);
+	SymbolMatrix* df_dx = SymbolNodeGradientSymbolMatrix(f, symbolMatrixArray, x);
+	ConstraintFunctionSimplify(symbolMatrixArray, "Distance", &f, &df_dx);
 
-	Constraint* constraint = ConstraintCreate(constraintsArray, particlesArray, DISTANCE, t, x, v, a, f, df_dt, df_dx,
-											  df_dxdt);
-	constraint->metadata.distance.distance = distance;
+	return ConstraintTemplateCreate(DISTANCE, parameters, x, f, df_dx);
+}
+
+Constraint* DistanceConstraintCreate(ConstraintArray* constraintsArray, SymbolMatrixArray* symbolMatrixArray,
+                                     ParticleArray* particlesArray, float distance) {
+	assert(particlesArray->size == 2, "Circle constraint has incorrect number of particles!");
+
+	const ConstraintMetadata metadata = { .distance = { .distance = distance } };
+	float parameters[CONSTRAINT_MAX_PARAMETERS];
+	ConstraintParameters(DISTANCE, &metadata, parameters);
+
+	ConstraintTemplate* constraintTemplate = ConstraintTypeTemplate(constraintsArray, symbolMatrixArray, DISTANCE);
+	Constraint* constraint = ConstraintCreate(constraintsArray, particlesArray, constraintTemplate, parameters);
+	constraint->metadata = metadata;
 	return constraint;
 }
 
+ConstraintTemplate* ConstraintTypeTemplateCreate(SymbolMatrixArray* symbolMatrixArray, ConstraintType type) {
+	switch (type) {
+		case CIRCLE:
+			return CircleConstraintTemplateCreate(symbolMatrixArray);
+		case DISTANCE:
+			return DistanceConstraintTemplateCreate(symbolMatrixArray);
+		default:
+			assert(false, "Unknown constraint type!");
+			return NULL;
+	}
+}
+
+static const char* constraintCacheNames[CONSTRAINT_TYPE_COUNT] = {
+	[CIRCLE] = "circle",
+	[DISTANCE] = "distance",
+};
+
+ConstraintTemplate* ConstraintTypeTemplateLoad(SymbolMatrixArray* symbolMatrixArray, ConstraintType type,
+                                               const char* directory) {
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s.graph", directory, constraintCacheNames[type]);
+
+	// Every type has its own file, the type is in the key too so a renamed file is never used as another type
+	const uint64_t key = CONSTRAINT_BUILD_HASH ^ type;
+
+	SymbolGraphFile* file = SymbolGraphFileOpen(path, key);
+	if(file != NULL) {
+		ConstraintTemplate* constraintTemplate = ConstraintTemplateCreateGraph(type, file->graph);
+		SymbolGraphFileClose(file);
+
+		TraceLog(LOG_DEBUG, "%s constraint loaded from %s", constraintCacheNames[type], path);
+
+		return constraintTemplate;
+	}
+
+	ConstraintTemplate* constraintTemplate = ConstraintTypeTemplateCreate(symbolMatrixArray, type);
+
+	if((mkdir(directory, 0755) != 0 && errno != EEXIST) || !SymbolGraphWrite(constraintTemplate->graph, key, path)) {
+		TraceLog(LOG_WARNING, "Can not write %s constraint to %s", constraintCacheNames[type], path);
+	}
+
+	return constraintTemplate;
+}
+
+ConstraintTemplate* ConstraintTypeTemplate(ConstraintArray* constraintsArray, SymbolMatrixArray* symbolMatrixArray,
+                                           ConstraintType type) {
+	if(constraintsArray->templates[type] == NULL) {
+		const ConstraintKernel* kernel = &constraintKernels[type];
+
+		if(kernel->evaluate != NULL) {
+			constraintsArray->templates[type] = ConstraintTemplateCreateKernel(type, kernel);
+		} else if(constraintsArray->cacheDirectory != NULL) {
+			constraintsArray->templates[type] = ConstraintTypeTemplateLoad(symbolMatrixArray, type,
+			                                                               constraintsArray->cacheDirectory);
+		} else {
+			constraintsArray->templates[type] = ConstraintTypeTemplateCreate(symbolMatrixArray, type);
+		}
+	}
+
+	return constraintsArray->templates[type];
+}
+
+void ConstraintArrayCollectSymbols(ConstraintArray* constraintsArray, SymbolMatrixArray* symbolMatrixArray) {
+	SymbolMatrix* matrixRoots[3 * CONSTRAINT_TYPE_COUNT];
+	SymbolNode* nodeRoots[CONSTRAINT_TYPE_COUNT];
+	unsigned int matrixRootCount = 0;
+	unsigned int nodeRootCount = 0;
+
+	// Templates from a generated kernel or a cached graph have no symbolic form
+	for (unsigned int type = 0; type < CONSTRAINT_TYPE_COUNT; ++type) {
+		ConstraintTemplate* constraintTemplate = constraintsArray->templates[type];
+		if(constraintTemplate != NULL && constraintTemplate->x != NULL) {
+			matrixRoots[matrixRootCount++] = constraintTemplate->x;
+			matrixRoots[matrixRootCount++] = constraintTemplate->parameters;
+			matrixRoots[matrixRootCount++] = constraintTemplate->constraintFunction_dx;
+			nodeRoots[nodeRootCount++] = constraintTemplate->constraintFunction;
+		}
+	}
+
+	const SymbolMemoryStatistics before = SymbolMatrixArrayStatistics(symbolMatrixArray);
+	SymbolMatrixArrayCollect(symbolMatrixArray, matrixRoots, matrixRootCount, nodeRoots, nodeRootCount);
+	const SymbolMemoryStatistics after = SymbolMatrixArrayStatistics(symbolMatrixArray);
+
+	matrixRootCount = 0;
+	nodeRootCount = 0;
+	for (unsigned int type = 0; type < CONSTRAINT_TYPE_COUNT; ++type) {
+		ConstraintTemplate* constraintTemplate = constraintsArray->templates[type];
+		if(constraintTemplate != NULL && constraintTemplate->x != NULL) {
+			constraintTemplate->x = matrixRoots[matrixRootCount++];
+			constraintTemplate->parameters = matrixRoots[matrixRootCount++];
+			constraintTemplate->constraintFunction_dx = matrixRoots[matrixRootCount++];
+			constraintTemplate->constraintFunction = nodeRoots[nodeRootCount++];
+		}
+	}
+
+	TraceLog(LOG_INFO, "Symbols collected, %zu nodes and %zu matrices in %zu bytes, were %zu nodes and %zu matrices in "
+	         "%zu bytes", after.nodeCount, after.matrixCount, after.reservedBytes, before.nodeCount, before.matrixCount,
+	         before.reservedBytes);
+}
+
+// Templates of the types missing one, each built on its own thread
+typedef struct TemplatesCreateJob {
+	ConstraintArray* constraintsArray;
+	ConstraintType types[CONSTRAINT_TYPE_COUNT];
+} TemplatesCreateJob;
+
+// Every template is built in a symbolic context of its own, so they are built at the same time without sharing
+// anything. Only the pointer-free graph and what is compiled from it are kept, the context is released afterwards
+static void TemplatesCreateRun(void* context, unsigned int index) {
+	const TemplatesCreateJob* job = context;
+	const ConstraintType type = job->types[index];
+	const char* directory = job->constraintsArray->cacheDirectory;
+
+	SymbolMatrixArray* symbolMatrixArray = SymbolMatrixArrayCreate();
+	ConstraintTemplate* constraintTemplate = directory != NULL
+	                                         ? ConstraintTypeTemplateLoad(symbolMatrixArray, type, directory)
+	                                         : ConstraintTypeTemplateCreate(symbolMatrixArray, type);
+	constraintTemplate->x = NULL;
+	constraintTemplate->parameters = NULL;
+	constraintTemplate->constraintFunction = NULL;
+	constraintTemplate->constraintFunction_dx = NULL;
+	SymbolMatrixArrayFree(symbolMatrixArray);
+
+	job->constraintsArray->templates[type] = constraintTemplate;
+}
+
+// Constraints of the descriptions, in ranges of the same size
+typedef struct ConstraintsCreateJob {
+	ConstraintArray* constraintsArray;
+	const ConstraintDescription* descriptions;
+	const unsigned int* lanes;
+	unsigned int first;
+	unsigned int count;
+	unsigned int taskCount;
+} ConstraintsCreateJob;
+
+// Every constraint already has its slot in the array and its lane, so tasks never write to the same place
+static void ConstraintsCreateRun(void* context, unsigned int index) {
+	const ConstraintsCreateJob* job = context;
+	const unsigned int begin = (unsigned int) ((unsigned long) job->count * index / job->taskCount);
+	const unsigned int end = (unsigned int) ((unsigned long) job->count * (index + 1) / job->taskCount);
+
+	for (unsigned int i = begin; i < end; ++i) {
+		const ConstraintDescription* description = &job->descriptions[i];
+		ConstraintTemplate* constraintTemplate = job->constraintsArray->templates[description->type];
+
+		assert(description->particles->size == constraintTemplate->particleCount,
+		       "Constraint has incorrect number of particles!");
+
+		Constraint* constraint = malloc(sizeof(Constraint));
+		assert(constraint != NULL, "No memory!");
+		*constraint = (Constraint) {
+			.type = description->type,
+			.index = job->first + i,
+			.particles = description->particles,
+			.constraintTemplate = constraintTemplate,
+			.lane = job->lanes[i],
+			.metadata = description->metadata,
+		};
+		ConstraintParameters(description->type, &description->metadata, constraint->parameters);
+
+		job->constraintsArray->start[job->first + i] = constraint;
+	}
+}
+
+void ConstraintsCreateParallel(ConstraintArray* constraintsArray, ThreadPool* pool,
+                               const ConstraintDescription* descriptions, unsigned int count) {
+	// Lanes are given in order of description, as creating the constraints one by one would
+	unsigned int* lanes = calloc(count, sizeof(unsigned int));
+	unsigned int laneCounts[CONSTRAINT_TYPE_COUNT] = { 0 };
+	assert(lanes != NULL, "No memory!");
+
+	for (unsigned int i = 0; i < count; ++i) {
+		lanes[i] = laneCounts[descriptions[i].type]++;
+	}
+
+	// Generated kernels take no building, the other missing templates are built by the pool
+	TemplatesCreateJob templatesJob = { .constraintsArray = constraintsArray };
+	unsigned int templateCount = 0;
+	for (unsigned int i = 0; i < CONSTRAINT_TYPE_COUNT; ++i) {
+		if(laneCounts[i] == 0 || constraintsArray->templates[i] != NULL) {
+			continue;
+		}
+
+		if(constraintKernels[i].evaluate != NULL) {
+			constraintsArray->templates[i] = ConstraintTemplateCreateKernel(i, &constraintKernels[i]);
+		} else {
+			templatesJob.types[templateCount++] = i;
+		}
+	}
+	ThreadPoolRun(pool, TemplatesCreateRun, &templatesJob, templateCount);
+
+	for (unsigned int i = 0; i < CONSTRAINT_TYPE_COUNT; ++i) {
+		if(laneCounts[i] != 0) {
+			laneCounts[i] = ConstraintTemplateAddLanes(constraintsArray->templates[i], laneCounts[i]);
+		}
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		lanes[i] += laneCounts[descriptions[i].type];
+	}
+
+	const unsigned int first = constraintsArray->size;
+	ConstraintArrayReserve(constraintsArray, first + count);
+	constraintsArray->size = first + count;
+
+	// A few ranges per thread, so a thread that is slowed down does not hold back the others
+	ConstraintsCreateJob constraintsJob = {
+		.constraintsArray = constraintsArray,
+		.descriptions = descriptions,
+		.lanes = lanes,
+		.first = first,
+		.count = count,
+		.taskCount = count < pool->threadCount * 4 ? count : pool->threadCount * 4,
+	};
+	ThreadPoolRun(pool, ConstraintsCreateRun, &constraintsJob, constraintsJob.taskCount);
+
+	free(lanes);
+}
+
 void ConstraintDraw(Constraint* constraint) {
 	switch (constraint->type) {
 		case CIRCLE:
@@ -2,17 +2,52 @@
 #define SIMULATOR_CONSTRAINT_TYPE_H
 
 #include "simulator.h"
+#include "thread_pool.h"
 
 //-----------------------------------------------------------------------------
 // Constraint functions
 //-----------------------------------------------------------------------------
 
+// Builds, differentiates and compiles the symbolic function of a built-in constraint type
+ConstraintTemplate* ConstraintTypeTemplateCreate(SymbolMatrixArray* symbolMatrixArray, ConstraintType type);
+
+// Same as ConstraintTypeTemplateCreate, but the graph is read from the cache in directory when it was written by the
+// same build, otherwise it is built and written there for the next run
+ConstraintTemplate* ConstraintTypeTemplateLoad(SymbolMatrixArray* symbolMatrixArray, ConstraintType type,
+                                               const char* directory);
+
+// Template shared by all constraints of a type, created on first use
+// Uses the generated kernel of the type when there is one, so nothing is differentiated at startup, or else the
+// graph cache of the array when it has one
+ConstraintTemplate* ConstraintTypeTemplate(ConstraintArray* constraintsArray, SymbolMatrixArray* symbolMatrixArray,
+                                           ConstraintType type);
+
+// Keeps the symbolic form of the templates of constraintsArray and releases every other node and matrix of
+// symbolMatrixArray, such as the intermediate expressions left over from building and differentiating them
+// Pointers to nodes and matrices of symbolMatrixArray held anywhere else are invalid afterwards
+void ConstraintArrayCollectSymbols(ConstraintArray* constraintsArray, SymbolMatrixArray* symbolMatrixArray);
+
 Constraint* CircleConstraintCreate(ConstraintArray* constraintsArray, SymbolMatrixArray* symbolMatrixArray,
                                    ParticleArray* particlesArray, Vector2 center, Vector2 radius);
 
 Constraint* DistanceConstraintCreate(ConstraintArray* constraintsArray, SymbolMatrixArray* symbolMatrixArray,
                                    ParticleArray* particlesArray, float distance);
 
+// Constraint to be created by ConstraintsCreateParallel
+typedef struct ConstraintDescription {
+	ConstraintType type;
+	ParticleArray* particles;
+	ConstraintMetadata metadata;
+} ConstraintDescription;
+
+// Creates a constraint for each description at the end of constraintsArray, in the same order and with the same lanes
+// as creating them one by one
+// Missing templates without a generated kernel are built at the same time on the threads of pool, each in a symbolic
+// context of its own that is released afterwards, so they keep their graph but not their symbolic form. The
+// constraints are then split between the threads
+void ConstraintsCreateParallel(ConstraintArray* constraintsArray, ThreadPool* pool,
+                               const ConstraintDescription* descriptions, unsigned int count);
+
 void ConstraintDraw(Constraint* constraint);
 
 #endif //SIMULATOR_CONSTRAINT_TYPE_H
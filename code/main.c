@@ -23,6 +23,8 @@ int main(void) {
 	ConstraintArray* allConstraintsArray = ConstraintArrayCreate();
 
 	Simulator simulator = case1(symbolMatrixArray, allParticlesArray, allConstraintsArray);
+	// Only the templates are needed from now on, not what was built on the way to them
+	ConstraintArrayCollectSymbols(allConstraintsArray, symbolMatrixArray);
 
 	const int FONT_SIZE = 11;
 
@@ -81,6 +83,7 @@ int main(void) {
 
 	// De-Initialization
 	//--------------------------------------------------------------------------------------
+	SimulatorFree(&simulator);
 	SymbolMatrixArrayFree(symbolMatrixArray);
 	ParticleArrayFree(allParticlesArray);
 	ConstraintArrayFree(allConstraintsArray);
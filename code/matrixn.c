@@ -2,6 +2,7 @@
 
 #include <math.h>
 #include <raylib.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <config.h>
 #include <string.h>
@@ -10,28 +11,30 @@
 
 MatrixNArray* MatrixNArrayCreate() {
 	MatrixNArray* array = malloc(sizeof(MatrixNArray));
-	*array = (MatrixNArray) { .start = NULL, .capacity = 0, .size = 0 };
+	*array = (MatrixNArray) { .arena = ArenaCreate(4096), .start = NULL, .capacity = 0, .size = 0 };
 	return array;
 }
 
 void MatrixNArrayFree(MatrixNArray* array) {
-	for (size_t i = 0; i < array->size; ++i) {
-		MatrixNFree(array->start[i]);
-		free(array->start[i]);
-	}
+	ArenaFree(array->arena);
 	free(array->start);
 	free(array);
 }
 
+void MatrixNArrayReset(MatrixNArray* array) {
+	ArenaReset(array->arena);
+	array->size = 0;
+}
+
 MatrixN* MatrixNArrayAdd(MatrixNArray* array) {
 	if(array->size == array->capacity) {
-		array->capacity++;
+		array->capacity = array->capacity == 0 ? 16 : array->capacity * 2;
 		array->start = reallocarray(array->start, array->capacity, sizeof(MatrixN*));
 
 		assert(array->start != NULL, "No memory");
 	}
 
-	MatrixN* matrix = malloc(sizeof(MatrixN));
+	MatrixN* matrix = ArenaAllocate(array->arena, sizeof(MatrixN), alignof(MatrixN));
 	array->start[array->size] = matrix;
 	array->size++;
 	return matrix;
@@ -50,40 +53,48 @@ MatrixN* MatrixNCreate(MatrixNArray* array, unsigned int rows, unsigned int cols
 	*matrix = (MatrixN) {
 		.rows = rows,
 		.cols = cols,
-		.values = calloc(rows * cols, sizeof(float))
+		.values = ArenaAllocateZero(array->arena, rows * cols * sizeof(float), alignof(max_align_t))
 	};
 
 	return matrix;
 }
 
-void MatrixNFree(MatrixN* matrix) {
-	free(matrix->values);
-}
-
 float* MatrixNGet(MatrixN * matrix, unsigned int row, unsigned int col) {
 	assert(row < matrix->rows && col < matrix->cols, "Indexing nonexistent element!");
 	return &matrix->values[row + matrix->rows * col];
 }
 
+// Appends to a log message, what does not fit is cut instead of written past the end of buffer
+static void MatrixNPrintAppend(char* buffer, size_t* size, const char* format, ...) {
+	va_list arguments;
+	va_start(arguments, format);
+	const int length = vsnprintf(buffer + *size, MAX_TRACELOG_MSG_LENGTH - *size, format, arguments);
+	va_end(arguments);
+
+	if(length > 0) {
+		*size = *size + length < MAX_TRACELOG_MSG_LENGTH ? *size + length : MAX_TRACELOG_MSG_LENGTH - 1;
+	}
+}
+
 void MatrixNPrint(MatrixN* matrix) {
 	char buffer[MAX_TRACELOG_MSG_LENGTH] = { 0 };
-	char* end = buffer;
+	size_t size = 0;
 
-	sprintf(end, "["); end += strlen(end);
+	MatrixNPrintAppend(buffer, &size, "[");
 	for (unsigned int i = 0; i < matrix->rows; ++i) {
-		sprintf(end, "["); end += strlen(end);
+		MatrixNPrintAppend(buffer, &size, "[");
 		for (unsigned int j = 0; j < matrix->cols; ++j) {
-			sprintf(end, "%.6F ", *MatrixNGet(matrix, i, j)); end += strlen(end);
+			MatrixNPrintAppend(buffer, &size, "%.6F ", *MatrixNGet(matrix, i, j));
 		}
-		sprintf(end, "]"); end += strlen(end);
+		MatrixNPrintAppend(buffer, &size, "]");
 		if(i != matrix->rows-1) {
-			TraceLog(LOG_DEBUG, buffer);
-			end = buffer;
+			TraceLog(LOG_DEBUG, "%s", buffer);
+			size = 0;
 		}
 	}
-	sprintf(end, "]"); end += strlen(end);
+	MatrixNPrintAppend(buffer, &size, "]");
 
-	TraceLog(LOG_DEBUG, buffer);
+	TraceLog(LOG_DEBUG, "%s", buffer);
 }
 
 void MatrixNReshape(MatrixN * matrix, unsigned int rows, unsigned int cols) {
@@ -104,72 +115,220 @@ float MatrixNNorm(MatrixN * matrix) {
 	return sum;
 }
 
-MatrixN* MatrixNTranspose(MatrixNArray* array, MatrixN * matrix) {
-	MatrixN* transposed = MatrixNCreate(array, matrix->cols, matrix->rows);
+void MatrixNTransposeInto(MatrixN * result, MatrixN * matrix) {
+	assert(result->rows == matrix->cols && result->cols == matrix->rows, "Matrix dimensions don't match!");
+	assert(result->values != matrix->values, "Result can not be the matrix!");
 
 	for (unsigned int i = 0; i < matrix->rows; ++i) {
 		for (unsigned int j = 0; j < matrix->cols; ++j) {
-			*MatrixNGet(transposed, j, i) = *MatrixNGet(matrix, i, j);
+			*MatrixNGet(result, j, i) = *MatrixNGet(matrix, i, j);
 		}
 	}
+}
 
+MatrixN* MatrixNTranspose(MatrixNArray* array, MatrixN * matrix) {
+	MatrixN* transposed = MatrixNCreate(array, matrix->cols, matrix->rows);
+	MatrixNTransposeInto(transposed, matrix);
 	return transposed;
 }
 
+void MatrixNNegateInto(MatrixN * result, MatrixN * matrix) {
+	MatrixNMultiplyValueInto(result, matrix, -1.0f);
+}
+
 MatrixN* MatrixNNegate(MatrixNArray* array, MatrixN * matrix) {
 	MatrixN* result = MatrixNCreate(array, matrix->rows, matrix->cols);
-
-	for (unsigned int i = 0; i < matrix->rows; ++i) {
-		for (unsigned int j = 0; j < matrix->cols; ++j) {
-			*MatrixNGet(result, i, j) = *MatrixNGet(matrix, i, j) * -1;
-		}
-	}
-
+	MatrixNNegateInto(result, matrix);
 	return result;
 }
 
-MatrixN* MatrixNAdd(MatrixNArray* array, MatrixN * a,  MatrixN * b) {
+void MatrixNAddInto(MatrixN * result, MatrixN * a,  MatrixN * b) {
 	assert(a->rows == b->rows && a->cols == b->cols, "Matrix dimensions don't match!");
+	assert(result->rows == a->rows && result->cols == a->cols, "Matrix dimensions don't match!");
 
+	for (unsigned int i = 0; i < a->rows * a->cols; ++i) {
+		result->values[i] = a->values[i] + b->values[i];
+	}
+}
+
+MatrixN* MatrixNAdd(MatrixNArray* array, MatrixN * a,  MatrixN * b) {
 	MatrixN* result = MatrixNCreate(array, a->rows, a->cols);
+	MatrixNAddInto(result, a, b);
+	return result;
+}
+
+// result = op(a) op(b), or result += op(a) op(b) when accumulating, op transposes its matrix when asked to
+// Loops are ordered so the innermost one walks down columns, which are contiguous
+static void MatrixNMultiplyKernel(MatrixN * result, MatrixN * a, bool transposeA, MatrixN * b, bool transposeB,
+                                  bool accumulate) {
+	const unsigned int rows = transposeA ? a->cols : a->rows;
+	const unsigned int inner = transposeA ? a->rows : a->cols;
+	const unsigned int cols = transposeB ? b->rows : b->cols;
+	assert(inner == (transposeB ? b->cols : b->rows), "Matrix dimensions don't match!");
+	assert(result->rows == rows && result->cols == cols, "Matrix dimensions don't match!");
+	assert(result->values != a->values && result->values != b->values, "Result can not be an operand!");
+
+	if(!accumulate) {
+		memset(result->values, 0, rows * cols * sizeof(float));
+	}
 
-	for (unsigned int i = 0; i < a->rows; ++i) {
-		for (unsigned int j = 0; j < a->cols; ++j) {
-			*MatrixNGet(result, i, j) = *MatrixNGet(a, i, j) + *MatrixNGet(b, i, j);
+	for (unsigned int j = 0; j < cols; ++j) {
+		float* column = &result->values[j * rows];
+
+		if(transposeA) {
+			// Rows of a' are the columns of a, each entry is the dot product of two columns
+			for (unsigned int i = 0; i < rows; ++i) {
+				const float* aColumn = &a->values[i * a->rows];
+				float r = 0.0f;
+				for (unsigned int k = 0; k < inner; ++k) {
+					r += aColumn[k] * (transposeB ? b->values[j + k * b->rows] : b->values[k + j * b->rows]);
+				}
+				column[i] += r;
+			}
+		} else {
+			// Column j is a sum of the columns of a, weighted by column j of op(b)
+			for (unsigned int k = 0; k < inner; ++k) {
+				const float* aColumn = &a->values[k * a->rows];
+				const float weight = transposeB ? b->values[j + k * b->rows] : b->values[k + j * b->rows];
+				for (unsigned int i = 0; i < rows; ++i) {
+					column[i] += aColumn[i] * weight;
+				}
+			}
 		}
 	}
+}
 
-	return result;
+void MatrixNMultiplyInto(MatrixN * result, MatrixN * a,  MatrixN * b) {
+	MatrixNMultiplyKernel(result, a, false, b, false, false);
 }
 
-MatrixN* MatrixNMultiply(MatrixNArray* array, MatrixN * a,  MatrixN * b) {
-	assert(a->cols == b->rows, "Matrix dimensions don't match!");
+void MatrixNMultiplyAddInto(MatrixN * result, MatrixN * a,  MatrixN * b) {
+	MatrixNMultiplyKernel(result, a, false, b, false, true);
+}
 
+MatrixN* MatrixNMultiply(MatrixNArray* array, MatrixN * a,  MatrixN * b) {
 	MatrixN* result = MatrixNCreate(array, a->rows, b->cols);
+	MatrixNMultiplyInto(result, a, b);
+	return result;
+}
+
+void MatrixNMultiplyTransposedInto(MatrixN * result, MatrixN * a, bool transposeA, MatrixN * b, bool transposeB) {
+	MatrixNMultiplyKernel(result, a, transposeA, b, transposeB, false);
+}
 
-	for (unsigned int i = 0; i < result->rows; ++i) {
-		for (unsigned int j = 0; j < result->cols; ++j) {
-			float r = 0;
+void MatrixNMultiplyTransposedAddInto(MatrixN * result, MatrixN * a, bool transposeA, MatrixN * b, bool transposeB) {
+	MatrixNMultiplyKernel(result, a, transposeA, b, transposeB, true);
+}
+
+MatrixN* MatrixNMultiplyTransposed(MatrixNArray* array, MatrixN * a, bool transposeA, MatrixN * b, bool transposeB) {
+	MatrixN* result = MatrixNCreate(array, transposeA ? a->cols : a->rows, transposeB ? b->rows : b->cols);
+	MatrixNMultiplyTransposedInto(result, a, transposeA, b, transposeB);
+	return result;
+}
 
-			for (unsigned int k = 0; k < a->cols; ++k) {
-				r += *MatrixNGet(a, i, k) * *MatrixNGet(b, k, j);
+void MatrixNMultiplyWeightedTransposeInto(MatrixN * result, MatrixN * a, bool transposeA, MatrixN * w) {
+	const unsigned int n = transposeA ? a->cols : a->rows;
+	const unsigned int inner = transposeA ? a->rows : a->cols;
+	assert(w == NULL || (w->rows == inner && w->cols == 1), "Matrix dimensions don't match!");
+	assert(result->rows == n && result->cols == n, "Matrix dimensions don't match!");
+	assert(result->values != a->values, "Result can not be an operand!");
+
+	// Lower triangle, column j from its diagonal down
+	for (unsigned int j = 0; j < n; ++j) {
+		float* column = &result->values[j * n];
+
+		if(transposeA) {
+			// a' W a, entries are weighted dot products of two columns of a
+			const float* jColumn = &a->values[j * a->rows];
+			for (unsigned int i = j; i < n; ++i) {
+				const float* iColumn = &a->values[i * a->rows];
+				float r = 0.0f;
+				for (unsigned int k = 0; k < inner; ++k) {
+					r += iColumn[k] * (w == NULL ? 1.0f : w->values[k]) * jColumn[k];
+				}
+				column[i] = r;
 			}
+		} else {
+			// a W a', column j is the sum of the columns of a weighted by row j of a W
+			for (unsigned int i = j; i < n; ++i) {
+				column[i] = 0.0f;
+			}
+			for (unsigned int k = 0; k < inner; ++k) {
+				const float* aColumn = &a->values[k * a->rows];
+				const float weight = aColumn[j] * (w == NULL ? 1.0f : w->values[k]);
+				for (unsigned int i = j; i < n; ++i) {
+					column[i] += aColumn[i] * weight;
+				}
+			}
+		}
+	}
 
-			*MatrixNGet(result, i, j) = r;
+	// The upper triangle is the mirror of the lower one
+	for (unsigned int j = 1; j < n; ++j) {
+		for (unsigned int i = 0; i < j; ++i) {
+			result->values[i + j * n] = result->values[j + i * n];
 		}
 	}
+}
+
+MatrixN* MatrixNMultiplyWeightedTranspose(MatrixNArray* array, MatrixN * a, bool transposeA, MatrixN * w) {
+	const unsigned int n = transposeA ? a->cols : a->rows;
+	MatrixN* result = MatrixNCreate(array, n, n);
+	MatrixNMultiplyWeightedTransposeInto(result, a, transposeA, w);
 	return result;
 }
 
+void MatrixNMultiplyValueInto(MatrixN * result, MatrixN * matrix, float value) {
+	assert(result->rows == matrix->rows && result->cols == matrix->cols, "Matrix dimensions don't match!");
+
+	for (unsigned int i = 0; i < matrix->rows * matrix->cols; ++i) {
+		result->values[i] = matrix->values[i] * value;
+	}
+}
+
+void MatrixNMultiplyValueAddInto(MatrixN * result, MatrixN * matrix, float value) {
+	assert(result->rows == matrix->rows && result->cols == matrix->cols, "Matrix dimensions don't match!");
+
+	for (unsigned int i = 0; i < matrix->rows * matrix->cols; ++i) {
+		result->values[i] += matrix->values[i] * value;
+	}
+}
+
 MatrixN* MatrixNMultiplyValue(MatrixNArray* array, MatrixN * matrix, float value) {
 	MatrixN* result = MatrixNCreate(array, matrix->rows, matrix->cols);
+	MatrixNMultiplyValueInto(result, matrix, value);
+	return result;
+}
 
-	for (unsigned int i = 0; i < matrix->rows; ++i) {
-		for (unsigned int j = 0; j < matrix->cols; ++j) {
-			*MatrixNGet(result, i, j) = *MatrixNGet(matrix, i, j) * value;
+void MatrixNMultiplyElementWiseInto(MatrixN * result, MatrixN * a,  MatrixN * b) {
+	assert(a->rows == b->rows && a->cols == b->cols, "Matrix dimensions don't match!");
+	assert(result->rows == a->rows && result->cols == a->cols, "Matrix dimensions don't match!");
+
+	for (unsigned int i = 0; i < a->rows * a->cols; ++i) {
+		result->values[i] = a->values[i] * b->values[i];
+	}
+}
+
+MatrixN* MatrixNMultiplyElementWise(MatrixNArray* array, MatrixN * a,  MatrixN * b) {
+	MatrixN* result = MatrixNCreate(array, a->rows, a->cols);
+	MatrixNMultiplyElementWiseInto(result, a, b);
+	return result;
+}
+
+void MatrixNDiagonalMultiplyInto(MatrixN * result, MatrixN * diagonal, MatrixN * b) {
+	assert(diagonal->rows == b->rows && diagonal->cols == 1, "Matrix dimensions don't match!");
+	assert(result->rows == b->rows && result->cols == b->cols, "Matrix dimensions don't match!");
+
+	for (unsigned int j = 0; j < b->cols; ++j) {
+		for (unsigned int i = 0; i < b->rows; ++i) {
+			result->values[i + j * b->rows] = diagonal->values[i] * b->values[i + j * b->rows];
 		}
 	}
+}
 
+MatrixN* MatrixNDiagonalMultiply(MatrixNArray* array, MatrixN * diagonal, MatrixN * b) {
+	MatrixN* result = MatrixNCreate(array, b->rows, b->cols);
+	MatrixNDiagonalMultiplyInto(result, diagonal, b);
 	return result;
 }
 
@@ -242,9 +401,437 @@ MatrixN* MatrixNInverse (MatrixNArray* array, MatrixN * matrix) {
 }
 
 MatrixN* MatrixNPseudoinverse(MatrixNArray* array, MatrixN * matrix) {
-	MatrixN* transpose = MatrixNTranspose(array, matrix);
-	MatrixN* t1 = MatrixNMultiply(array, transpose, matrix);
-	MatrixN* t2 = MatrixNInverse(array, t1);
-	MatrixN* t3 = MatrixNMultiply(array, t2, transpose);
+	MatrixN* t1 = MatrixNMultiplyWeightedTranspose(array, matrix, true, NULL);    // A' A
+	MatrixN* t2 = MatrixNInverse(array, t1);                                      // (A' A)⁻¹
+	MatrixN* t3 = MatrixNMultiplyTransposed(array, t2, false, matrix, true);      // (A' A)⁻¹ A'
 	return t3;
 }
+
+MatrixN* MatrixNCholesky(MatrixNArray* array, MatrixN * matrix, float regularization) {
+	assert(matrix->rows == matrix->cols, "Matrix is not square!");
+
+	const unsigned int n = matrix->rows;
+	MatrixN* factor = MatrixNCreate(array, n, n);
+
+	float largest = 0.0f;
+	for (unsigned int i = 0; i < n; ++i) {
+		largest = fmaxf(largest, matrix->values[i + i * n]);
+	}
+	const float smallest = regularization * (largest > 0.0f ? largest : 1.0f);
+
+	// Left looking, column j is updated with the columns before it, both are contiguous as values are by columns
+	for (unsigned int j = 0; j < n; ++j) {
+		float* column = &factor->values[j * n];
+		for (unsigned int i = j; i < n; ++i) {
+			column[i] = matrix->values[i + j * n];
+		}
+
+		for (unsigned int k = 0; k < j; ++k) {
+			const float* previous = &factor->values[k * n];
+			const float l = previous[j];
+			for (unsigned int i = j; i < n; ++i) {
+				column[i] -= previous[i] * l;
+			}
+		}
+
+		// What is left of the diagonal is what row j does not share with the rows before it, only rounding error
+		// when it depends on them, its pivot is raised to the smallest one so the row gets a small solution
+		assert(!isnan(column[j]), "Matrix is not a number!");
+		const float pivot = sqrtf(fmaxf(column[j], smallest));
+		assert(pivot > 0.0f, "Matrix is singular!");
+
+		column[j] = pivot;
+		for (unsigned int i = j + 1; i < n; ++i) {
+			column[i] /= pivot;
+		}
+	}
+
+	return factor;
+}
+
+void MatrixNCholeskySolveInto(MatrixN * result, MatrixN * factor, MatrixN * b) {
+	assert(factor->rows == factor->cols && factor->rows == b->rows, "Matrix dimensions don't match!");
+	assert(result->rows == b->rows && result->cols == b->cols, "Matrix dimensions don't match!");
+
+	const unsigned int n = factor->rows;
+	if(result->values != b->values) {
+		memcpy(result->values, b->values, b->rows * b->cols * sizeof(float));
+	}
+
+	for (unsigned int c = 0; c < b->cols; ++c) {
+		float* x = &result->values[c * n];
+
+		// L y = b, each solved value is subtracted from the rest of the column
+		for (unsigned int j = 0; j < n; ++j) {
+			const float* column = &factor->values[j * n];
+			x[j] /= column[j];
+			for (unsigned int i = j + 1; i < n; ++i) {
+				x[i] -= column[i] * x[j];
+			}
+		}
+
+		// Lᵀ x = y, the rows of Lᵀ are the columns of L
+		for (unsigned int j = n; j-- > 0;) {
+			const float* column = &factor->values[j * n];
+			float sum = x[j];
+			for (unsigned int i = j + 1; i < n; ++i) {
+				sum -= column[i] * x[i];
+			}
+			x[j] = sum / column[j];
+		}
+	}
+
+}
+
+MatrixN* MatrixNCholeskySolve(MatrixNArray* array, MatrixN * factor, MatrixN * b) {
+	MatrixN* result = MatrixNCreate(array, b->rows, b->cols);
+	MatrixNCholeskySolveInto(result, factor, b);
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+// MatrixNSparse
+//-----------------------------------------------------------------------------
+
+MatrixNTriplets* MatrixNTripletsCreate(MatrixNArray* array, unsigned int rows, unsigned int cols, unsigned int capacity) {
+	MatrixNTriplets* triplets = ArenaAllocate(array->arena, sizeof(MatrixNTriplets), alignof(MatrixNTriplets));
+	*triplets = (MatrixNTriplets) {
+		.rows = rows,
+		.cols = cols,
+		.capacity = capacity,
+		.size = 0,
+		.rowIndices = ArenaAllocate(array->arena, capacity * sizeof(unsigned int), alignof(unsigned int)),
+		.colIndices = ArenaAllocate(array->arena, capacity * sizeof(unsigned int), alignof(unsigned int)),
+		.values = ArenaAllocate(array->arena, capacity * sizeof(float), alignof(float)),
+	};
+	return triplets;
+}
+
+void MatrixNTripletsAdd(MatrixNTriplets* triplets, unsigned int row, unsigned int col, float value) {
+	assert(row < triplets->rows && col < triplets->cols, "Indexing nonexistent element!");
+	assert(triplets->size < triplets->capacity, "Too many triplets!");
+
+	triplets->rowIndices[triplets->size] = row;
+	triplets->colIndices[triplets->size] = col;
+	triplets->values[triplets->size] = value;
+	triplets->size++;
+}
+
+// Room for count entries, the rows are filled in by the caller
+static MatrixNSparse* MatrixNSparseAllocate(MatrixNArray* array, unsigned int rows, unsigned int cols,
+                                            unsigned int count) {
+	MatrixNSparse* matrix = ArenaAllocate(array->arena, sizeof(MatrixNSparse), alignof(MatrixNSparse));
+	*matrix = (MatrixNSparse) {
+		.rows = rows,
+		.cols = cols,
+		.rowStarts = ArenaAllocateZero(array->arena, (rows + 1) * sizeof(unsigned int), alignof(unsigned int)),
+		.columns = ArenaAllocate(array->arena, count * sizeof(unsigned int), alignof(unsigned int)),
+		.values = ArenaAllocate(array->arena, count * sizeof(float), alignof(max_align_t)),
+	};
+	return matrix;
+}
+
+MatrixNSparse* MatrixNSparseCreate(MatrixNArray* array, MatrixNTriplets* triplets) {
+	MatrixNSparse* matrix = MatrixNSparseAllocate(array, triplets->rows, triplets->cols, triplets->size);
+	unsigned int* rowStarts = matrix->rowStarts;
+
+	// Counting sort by row, rowStarts[i + 1] is the next free place of row i while scattering
+	for (unsigned int e = 0; e < triplets->size; ++e) {
+		rowStarts[triplets->rowIndices[e] + 1]++;
+	}
+	for (unsigned int i = 0; i < matrix->rows; ++i) {
+		rowStarts[i + 1] += rowStarts[i];
+	}
+	unsigned int* next = ArenaAllocate(array->arena, (matrix->rows + 1) * sizeof(unsigned int), alignof(unsigned int));
+	memcpy(next, rowStarts, (matrix->rows + 1) * sizeof(unsigned int));
+	for (unsigned int e = 0; e < triplets->size; ++e) {
+		const unsigned int place = next[triplets->rowIndices[e]]++;
+		matrix->columns[place] = triplets->colIndices[e];
+		matrix->values[place] = triplets->values[e];
+	}
+
+	// Rows are short, insertion sort them by column then add up repeated columns while compacting
+	unsigned int size = 0;
+	for (unsigned int i = 0; i < matrix->rows; ++i) {
+		const unsigned int begin = rowStarts[i];
+		const unsigned int end = rowStarts[i + 1];
+		for (unsigned int e = begin + 1; e < end; ++e) {
+			const unsigned int column = matrix->columns[e];
+			const float value = matrix->values[e];
+			unsigned int place = e;
+			while (place > begin && matrix->columns[place - 1] > column) {
+				matrix->columns[place] = matrix->columns[place - 1];
+				matrix->values[place] = matrix->values[place - 1];
+				place--;
+			}
+			matrix->columns[place] = column;
+			matrix->values[place] = value;
+		}
+
+		rowStarts[i] = size;
+		for (unsigned int e = begin; e < end; ++e) {
+			if(size > rowStarts[i] && matrix->columns[size - 1] == matrix->columns[e]) {
+				matrix->values[size - 1] += matrix->values[e];
+			} else {
+				matrix->columns[size] = matrix->columns[e];
+				matrix->values[size] = matrix->values[e];
+				size++;
+			}
+		}
+	}
+	rowStarts[matrix->rows] = size;
+
+	return matrix;
+}
+
+unsigned int MatrixNSparseNonzeroCount(MatrixNSparse* matrix) {
+	return matrix->rowStarts[matrix->rows];
+}
+
+MatrixNSparse* MatrixNSparseTranspose(MatrixNArray* array, MatrixNSparse* matrix) {
+	const unsigned int count = MatrixNSparseNonzeroCount(matrix);
+	MatrixNSparse* transposed = MatrixNSparseAllocate(array, matrix->cols, matrix->rows, count);
+
+	for (unsigned int e = 0; e < count; ++e) {
+		transposed->rowStarts[matrix->columns[e] + 1]++;
+	}
+	for (unsigned int i = 0; i < transposed->rows; ++i) {
+		transposed->rowStarts[i + 1] += transposed->rowStarts[i];
+	}
+
+	// Rows are visited in order, so the columns of every transposed row come out sorted
+	unsigned int* next = ArenaAllocate(array->arena, (transposed->rows + 1) * sizeof(unsigned int),
+	                                   alignof(unsigned int));
+	memcpy(next, transposed->rowStarts, (transposed->rows + 1) * sizeof(unsigned int));
+	for (unsigned int i = 0; i < matrix->rows; ++i) {
+		for (unsigned int e = matrix->rowStarts[i]; e < matrix->rowStarts[i + 1]; ++e) {
+			const unsigned int place = next[matrix->columns[e]]++;
+			transposed->columns[place] = i;
+			transposed->values[place] = matrix->values[e];
+		}
+	}
+
+	return transposed;
+}
+
+MatrixN* MatrixNSparseToDense(MatrixNArray* array, MatrixNSparse* matrix) {
+	MatrixN* dense = MatrixNCreate(array, matrix->rows, matrix->cols);
+
+	for (unsigned int i = 0; i < matrix->rows; ++i) {
+		for (unsigned int e = matrix->rowStarts[i]; e < matrix->rowStarts[i + 1]; ++e) {
+			*MatrixNGet(dense, i, matrix->columns[e]) = matrix->values[e];
+		}
+	}
+
+	return dense;
+}
+
+void MatrixNSparsePrint(MatrixNSparse* matrix) {
+	char buffer[MAX_TRACELOG_MSG_LENGTH] = { 0 };
+
+	for (unsigned int i = 0; i < matrix->rows; ++i) {
+		size_t size = 0;
+		MatrixNPrintAppend(buffer, &size, "%u [", i);
+		for (unsigned int e = matrix->rowStarts[i]; e < matrix->rowStarts[i + 1]; ++e) {
+			MatrixNPrintAppend(buffer, &size, "%u:%.6F ", matrix->columns[e], matrix->values[e]);
+		}
+		MatrixNPrintAppend(buffer, &size, "]");
+
+		TraceLog(LOG_DEBUG, "%s", buffer);
+	}
+}
+
+// result = a b, or result += a b when accumulating
+static void MatrixNSparseMultiplyKernel(MatrixN * result, MatrixNSparse* a, MatrixN * b, bool accumulate) {
+	assert(a->cols == b->rows, "Matrix dimensions don't match!");
+	assert(result->rows == a->rows && result->cols == b->cols, "Matrix dimensions don't match!");
+	assert(result->values != b->values, "Result can not be an operand!");
+
+	for (unsigned int j = 0; j < b->cols; ++j) {
+		const float* column = &b->values[j * b->rows];
+		for (unsigned int i = 0; i < a->rows; ++i) {
+			float r = accumulate ? result->values[i + j * result->rows] : 0.0f;
+			for (unsigned int e = a->rowStarts[i]; e < a->rowStarts[i + 1]; ++e) {
+				r += a->values[e] * column[a->columns[e]];
+			}
+			result->values[i + j * result->rows] = r;
+		}
+	}
+}
+
+void MatrixNSparseMultiplyInto(MatrixN * result, MatrixNSparse* a, MatrixN * b) {
+	MatrixNSparseMultiplyKernel(result, a, b, false);
+}
+
+void MatrixNSparseMultiplyAddInto(MatrixN * result, MatrixNSparse* a, MatrixN * b) {
+	MatrixNSparseMultiplyKernel(result, a, b, true);
+}
+
+MatrixN* MatrixNSparseMultiply(MatrixNArray* array, MatrixNSparse* a, MatrixN * b) {
+	MatrixN* result = MatrixNCreate(array, a->rows, b->cols);
+	MatrixNSparseMultiplyInto(result, a, b);
+	return result;
+}
+
+void MatrixNSparseTransposeMultiplyInto(MatrixN * result, MatrixNSparse* a, MatrixN * b) {
+	assert(a->rows == b->rows, "Matrix dimensions don't match!");
+	assert(result->rows == a->cols && result->cols == b->cols, "Matrix dimensions don't match!");
+	assert(result->values != b->values, "Result can not be an operand!");
+
+	memset(result->values, 0, result->rows * result->cols * sizeof(float));
+
+	// Each row of a scatters its entries times b into the rows of the result given by their columns
+	for (unsigned int j = 0; j < b->cols; ++j) {
+		float* column = &result->values[j * result->rows];
+		for (unsigned int i = 0; i < a->rows; ++i) {
+			const float value = b->values[i + j * b->rows];
+			for (unsigned int e = a->rowStarts[i]; e < a->rowStarts[i + 1]; ++e) {
+				column[a->columns[e]] += a->values[e] * value;
+			}
+		}
+	}
+}
+
+MatrixN* MatrixNSparseTransposeMultiply(MatrixNArray* array, MatrixNSparse* a, MatrixN * b) {
+	MatrixN* result = MatrixNCreate(array, a->cols, b->cols);
+	MatrixNSparseTransposeMultiplyInto(result, a, b);
+	return result;
+}
+
+MatrixNSparse* MatrixNSparseMultiplyWeightedTranspose(MatrixNArray* array, MatrixNSparse* a, MatrixN * w) {
+	assert(w->rows == a->cols && w->cols == 1, "Matrix dimensions don't match!");
+
+	// Rows of the transpose are the columns of a, with the rows of a they have entries in
+	MatrixNSparse* transposed = MatrixNSparseTranspose(array, a);
+
+	unsigned int count = 0;
+	for (unsigned int c = 0; c < transposed->rows; ++c) {
+		const unsigned int entries = transposed->rowStarts[c + 1] - transposed->rowStarts[c];
+		count += w->values[c] != 0.0f ? entries * entries : 0;
+	}
+
+	// Each pair is multiplied once and mirrored, so the result is exactly symmetric
+	MatrixNTriplets* triplets = MatrixNTripletsCreate(array, a->rows, a->rows, count);
+	for (unsigned int c = 0; c < transposed->rows; ++c) {
+		if(w->values[c] == 0.0f) {
+			continue;
+		}
+		const unsigned int begin = transposed->rowStarts[c];
+		const unsigned int end = transposed->rowStarts[c + 1];
+		for (unsigned int e = begin; e < end; ++e) {
+			const unsigned int row = transposed->columns[e];
+			const float weighted = transposed->values[e] * w->values[c];
+			MatrixNTripletsAdd(triplets, row, row, weighted * transposed->values[e]);
+			for (unsigned int f = e + 1; f < end; ++f) {
+				const float product = weighted * transposed->values[f];
+				MatrixNTripletsAdd(triplets, row, transposed->columns[f], product);
+				MatrixNTripletsAdd(triplets, transposed->columns[f], row, product);
+			}
+		}
+	}
+
+	return MatrixNSparseCreate(array, triplets);
+}
+
+MatrixNSparse* MatrixNSparseCholesky(MatrixNArray* array, MatrixNSparse* matrix, float regularization) {
+	assert(matrix->rows == matrix->cols, "Matrix is not square!");
+
+	const unsigned int n = matrix->rows;
+
+	// Row i of the envelope starts at the first column of row i, or at i when it has nothing left of the diagonal
+	unsigned int* first = ArenaAllocate(array->arena, (n + 1) * sizeof(unsigned int), alignof(unsigned int));
+	unsigned int count = 0;
+	float largest = 0.0f;
+	for (unsigned int i = 0; i < n; ++i) {
+		const unsigned int begin = matrix->rowStarts[i];
+		first[i] = begin < matrix->rowStarts[i + 1] && matrix->columns[begin] < i ? matrix->columns[begin] : i;
+		count += i - first[i] + 1;
+
+		for (unsigned int e = begin; e < matrix->rowStarts[i + 1]; ++e) {
+			if(matrix->columns[e] == i) {
+				largest = fmaxf(largest, matrix->values[e]);
+			}
+		}
+	}
+	const float smallest = regularization * (largest > 0.0f ? largest : 1.0f);
+
+	MatrixNSparse* factor = MatrixNSparseAllocate(array, n, n, count);
+	for (unsigned int i = 0; i < n; ++i) {
+		factor->rowStarts[i + 1] = factor->rowStarts[i] + i - first[i] + 1;
+	}
+
+	// Up looking, row i is solved against the rows before it, the entries of a row are contiguous from its first column
+	for (unsigned int i = 0; i < n; ++i) {
+		float* row = &factor->values[factor->rowStarts[i]];
+		for (unsigned int k = first[i]; k <= i; ++k) {
+			factor->columns[factor->rowStarts[i] + k - first[i]] = k;
+			row[k - first[i]] = 0.0f;
+		}
+		for (unsigned int e = matrix->rowStarts[i]; e < matrix->rowStarts[i + 1] && matrix->columns[e] <= i; ++e) {
+			row[matrix->columns[e] - first[i]] = matrix->values[e];
+		}
+
+		for (unsigned int j = first[i]; j < i; ++j) {
+			const float* previous = &factor->values[factor->rowStarts[j]];
+			float sum = row[j - first[i]];
+			for (unsigned int k = first[i] > first[j] ? first[i] : first[j]; k < j; ++k) {
+				sum -= row[k - first[i]] * previous[k - first[j]];
+			}
+			row[j - first[i]] = sum / previous[j - first[j]];
+		}
+
+		float diagonal = row[i - first[i]];
+		for (unsigned int k = first[i]; k < i; ++k) {
+			diagonal -= row[k - first[i]] * row[k - first[i]];
+		}
+
+		// Same as MatrixNCholesky, a row depending on the ones before it has its pivot raised to the smallest one
+		assert(!isnan(diagonal), "Matrix is not a number!");
+		row[i - first[i]] = sqrtf(fmaxf(diagonal, smallest));
+		assert(row[i - first[i]] > 0.0f, "Matrix is singular!");
+	}
+
+	return factor;
+}
+
+void MatrixNSparseCholeskySolveInto(MatrixN * result, MatrixNSparse* factor, MatrixN * b) {
+	assert(factor->rows == factor->cols && factor->rows == b->rows, "Matrix dimensions don't match!");
+	assert(result->rows == b->rows && result->cols == b->cols, "Matrix dimensions don't match!");
+
+	const unsigned int n = factor->rows;
+	if(result->values != b->values) {
+		memcpy(result->values, b->values, b->rows * b->cols * sizeof(float));
+	}
+
+	for (unsigned int c = 0; c < b->cols; ++c) {
+		float* x = &result->values[c * n];
+
+		// L y = b, row by row
+		for (unsigned int i = 0; i < n; ++i) {
+			const unsigned int begin = factor->rowStarts[i];
+			const unsigned int end = factor->rowStarts[i + 1] - 1;
+			float sum = x[i];
+			for (unsigned int e = begin; e < end; ++e) {
+				sum -= factor->values[e] * x[factor->columns[e]];
+			}
+			x[i] = sum / factor->values[end];
+		}
+
+		// L' x = y, the rows of L are the columns of L', each solved value is subtracted from the ones before
+		for (unsigned int i = n; i-- > 0;) {
+			const unsigned int begin = factor->rowStarts[i];
+			const unsigned int end = factor->rowStarts[i + 1] - 1;
+			x[i] /= factor->values[end];
+			for (unsigned int e = begin; e < end; ++e) {
+				x[factor->columns[e]] -= factor->values[e] * x[i];
+			}
+		}
+	}
+
+}
+
+MatrixN* MatrixNSparseCholeskySolve(MatrixNArray* array, MatrixNSparse* factor, MatrixN * b) {
+	MatrixN* result = MatrixNCreate(array, b->rows, b->cols);
+	MatrixNSparseCholeskySolveInto(result, factor, b);
+	return result;
+}
@@ -1,8 +1,11 @@
 #ifndef SIMULATOR_MATRIXN_H
 #define SIMULATOR_MATRIXN_H
 
+#include <stdbool.h>
 #include <stdlib.h>
 
+#include "arena.h"
+
 //-----------------------------------------------------------------------------
 // MatrixN
 //-----------------------------------------------------------------------------
@@ -13,7 +16,9 @@ typedef struct MatrixN {
 	float * values;
 } MatrixN;
 
+// Matrices and their values live in the arena, a reset releases all of them at once
 typedef struct MatrixNArray {
+	Arena* arena;
 	MatrixN **start;
 	size_t capacity;
 	size_t size;
@@ -23,12 +28,13 @@ MatrixNArray* MatrixNArrayCreate();
 
 void MatrixNArrayFree(MatrixNArray* array);
 
+// Releases every matrix of the array while keeping its memory for the next ones
+void MatrixNArrayReset(MatrixNArray* array);
+
 void MatrixNArrayPrint(MatrixNArray* array);
 
 MatrixN* MatrixNCreate(MatrixNArray* array, unsigned int rows, unsigned int cols);
 
-void MatrixNFree(MatrixN* matrix);
-
 float* MatrixNGet(MatrixN * matrix, unsigned int row, unsigned int col);
 
 void MatrixNPrint(MatrixN* array);
@@ -37,18 +43,138 @@ void MatrixNReshape(MatrixN * matrix, unsigned int rows, unsigned int cols);
 
 float MatrixNNorm(MatrixN * matrix);
 
+// Operations return a new matrix of the array, their Into form writes to result instead, which has to have the size
+// of the result already, and the AddInto form adds to it. Element-wise operations accept result being one of their
+// operands, the others do not.
+
 MatrixN* MatrixNTranspose(MatrixNArray* array, MatrixN * matrix);
 
+void MatrixNTransposeInto(MatrixN * result, MatrixN * matrix);
+
 MatrixN* MatrixNNegate(MatrixNArray* array, MatrixN * matrix);
 
+void MatrixNNegateInto(MatrixN * result, MatrixN * matrix);
+
 MatrixN* MatrixNAdd(MatrixNArray* array, MatrixN * a,  MatrixN * b);
 
+void MatrixNAddInto(MatrixN * result, MatrixN * a,  MatrixN * b);
+
 MatrixN* MatrixNMultiply(MatrixNArray* array, MatrixN * a,  MatrixN * b);
 
+void MatrixNMultiplyInto(MatrixN * result, MatrixN * a,  MatrixN * b);
+
+void MatrixNMultiplyAddInto(MatrixN * result, MatrixN * a,  MatrixN * b);
+
+// op(a) op(b), where op transposes its matrix when its flag is set, without building the transpose
+MatrixN* MatrixNMultiplyTransposed(MatrixNArray* array, MatrixN * a, bool transposeA, MatrixN * b, bool transposeB);
+
+void MatrixNMultiplyTransposedInto(MatrixN * result, MatrixN * a, bool transposeA, MatrixN * b, bool transposeB);
+
+void MatrixNMultiplyTransposedAddInto(MatrixN * result, MatrixN * a, bool transposeA, MatrixN * b, bool transposeB);
+
+// Symmetric op(a) W op(a)' for the diagonal matrix W given as the column w, or the identity when w is NULL
+// Only the lower triangle is computed, half the products of a multiply, the upper one is copied from it
+MatrixN* MatrixNMultiplyWeightedTranspose(MatrixNArray* array, MatrixN * a, bool transposeA, MatrixN * w);
+
+void MatrixNMultiplyWeightedTransposeInto(MatrixN * result, MatrixN * a, bool transposeA, MatrixN * w);
+
 MatrixN* MatrixNMultiplyValue(MatrixNArray* array, MatrixN * matrix, float value);
 
+void MatrixNMultiplyValueInto(MatrixN * result, MatrixN * matrix, float value);
+
+void MatrixNMultiplyValueAddInto(MatrixN * result, MatrixN * matrix, float value);
+
+MatrixN* MatrixNMultiplyElementWise(MatrixNArray* array, MatrixN * a,  MatrixN * b);
+
+void MatrixNMultiplyElementWiseInto(MatrixN * result, MatrixN * a,  MatrixN * b);
+
+// D b for the diagonal matrix D given as the column diagonal, each row of b is scaled by its entry
+MatrixN* MatrixNDiagonalMultiply(MatrixNArray* array, MatrixN * diagonal, MatrixN * b);
+
+void MatrixNDiagonalMultiplyInto(MatrixN * result, MatrixN * diagonal, MatrixN * b);
+
 MatrixN* MatrixNInverse(MatrixNArray* array, MatrixN * matrix);
 
 MatrixN* MatrixNPseudoinverse(MatrixNArray* array, MatrixN * matrix);
 
+// Cholesky factor L of a symmetric positive semidefinite matrix, L Lᵀ = matrix, L lower triangular
+// Rows that depend on the ones before them, such as redundant constraints, would make it singular, their pivot is
+// raised to regularization times the largest diagonal entry instead, only the lower triangle of matrix is read
+MatrixN* MatrixNCholesky(MatrixNArray* array, MatrixN * matrix, float regularization);
+
+// Solution x of L Lᵀ x = b for the factor L of MatrixNCholesky, every column of b is solved for
+MatrixN* MatrixNCholeskySolve(MatrixNArray* array, MatrixN * factor, MatrixN * b);
+
+// Solves in place when result is b
+void MatrixNCholeskySolveInto(MatrixN * result, MatrixN * factor, MatrixN * b);
+
+//-----------------------------------------------------------------------------
+// MatrixNSparse
+//-----------------------------------------------------------------------------
+
+// Entries of a sparse matrix in any order, gathered before it is compressed, repeated entries are added together
+// Lives in the arena of a MatrixNArray, so its capacity is fixed when it is created
+typedef struct MatrixNTriplets {
+	unsigned int rows;
+	unsigned int cols;
+	unsigned int capacity;
+	unsigned int size;
+	unsigned int* rowIndices;
+	unsigned int* colIndices;
+	float* values;
+} MatrixNTriplets;
+
+// Compressed sparse rows, the entries of row i are [rowStarts[i], rowStarts[i + 1]) with increasing columns
+// The compressed sparse columns of a matrix are the rows of its transpose
+typedef struct MatrixNSparse {
+	unsigned int rows;
+	unsigned int cols;
+	unsigned int* rowStarts;
+	unsigned int* columns;
+	float * values;
+} MatrixNSparse;
+
+MatrixNTriplets* MatrixNTripletsCreate(MatrixNArray* array, unsigned int rows, unsigned int cols, unsigned int capacity);
+
+void MatrixNTripletsAdd(MatrixNTriplets* triplets, unsigned int row, unsigned int col, float value);
+
+MatrixNSparse* MatrixNSparseCreate(MatrixNArray* array, MatrixNTriplets* triplets);
+
+unsigned int MatrixNSparseNonzeroCount(MatrixNSparse* matrix);
+
+MatrixNSparse* MatrixNSparseTranspose(MatrixNArray* array, MatrixNSparse* matrix);
+
+MatrixN* MatrixNSparseToDense(MatrixNArray* array, MatrixNSparse* matrix);
+
+// Nonzeros of each row as column:value, rows longer than a log message are cut
+void MatrixNSparsePrint(MatrixNSparse* matrix);
+
+MatrixN* MatrixNSparseMultiply(MatrixNArray* array, MatrixNSparse* a, MatrixN * b);
+
+void MatrixNSparseMultiplyInto(MatrixN * result, MatrixNSparse* a, MatrixN * b);
+
+void MatrixNSparseMultiplyAddInto(MatrixN * result, MatrixNSparse* a, MatrixN * b);
+
+// a' b without building the transpose of a
+MatrixN* MatrixNSparseTransposeMultiply(MatrixNArray* array, MatrixNSparse* a, MatrixN * b);
+
+void MatrixNSparseTransposeMultiplyInto(MatrixN * result, MatrixNSparse* a, MatrixN * b);
+
+// a W a' for the diagonal matrix W given as the column w, both triangles of the symmetric result are stored but each
+// product is only computed once
+// Every column of a contributes the products of its pairs of entries, so rows sharing no column stay unrelated, and
+// neither do rows sharing only columns of zero weight
+MatrixNSparse* MatrixNSparseMultiplyWeightedTranspose(MatrixNArray* array, MatrixNSparse* a, MatrixN * w);
+
+// Same as MatrixNCholesky for a sparse symmetric matrix, the factor is stored over the envelope of the lower triangle
+// Row i of the factor holds every column from the first nonzero of row i of matrix up to i, fill in never leaves the
+// envelope, so a matrix whose nonzeros stay close to the diagonal, such as the constraints of a chain, factors in
+// linear time and memory
+MatrixNSparse* MatrixNSparseCholesky(MatrixNArray* array, MatrixNSparse* matrix, float regularization);
+
+MatrixN* MatrixNSparseCholeskySolve(MatrixNArray* array, MatrixNSparse* factor, MatrixN * b);
+
+// Solves in place when result is b
+void MatrixNSparseCholeskySolveInto(MatrixN * result, MatrixNSparse* factor, MatrixN * b);
+
 #endif //SIMULATOR_MATRIXN_H
@@ -67,12 +67,23 @@ Particle* ParticleCreate(ParticleArray* array, Vector2 x, bool isStatic) {
 	particle->x = x;
 	particle->v = Vector2Zero();
 	particle->a = Vector2Zero();
+	particle->fApplied = Vector2Zero();
 	particle->aApplied = Vector2Zero();
 	particle->aConstraint = Vector2Zero();
+	particle->inverseMass = isStatic ? 0.0f : 1.0f;
 	particle->isStatic = isStatic;
 	return particle;
 }
 
+void ParticleSetMass(Particle* particle, float mass) {
+	assert(mass > 0.0f, "Mass must be positive!");
+	particle->inverseMass = particle->isStatic ? 0.0f : 1.0f / mass;
+}
+
+void ParticleSetForce(Particle* particle, Vector2 force) {
+	particle->fApplied = force;
+}
+
 void ParticleUpdate(Particle* particle, float timestep) {
 	Vector2 t1 = particle->x;                                              // x
 	Vector2 t2 = Vector2Scale(particle->v, timestep);                      // v * t
@@ -93,6 +104,8 @@ ConstraintArray* ConstraintArrayCreate() {
 		.start = NULL,
 		.capacity = 0,
 		.size = 0,
+		.templates = { NULL },
+		.cacheDirectory = NULL,
 	};
 	return array;
 }
@@ -101,16 +114,29 @@ void ConstraintArrayFree(ConstraintArray* array) {
 	for (size_t i = 0; i < array->size; ++i) {
 		free(array->start[i]);
 	}
+	for (unsigned int i = 0; i < CONSTRAINT_TYPE_COUNT; ++i) {
+		if(array->templates[i] != NULL) {
+			ConstraintTemplateFree(array->templates[i]);
+		}
+	}
 	free(array->start);
 	free(array);
 }
 
+void ConstraintArrayReserve(ConstraintArray* array, unsigned int capacity) {
+	if(capacity <= array->capacity) {
+		return;
+	}
+
+	array->capacity = capacity;
+	array->start = reallocarray(array->start, array->capacity, sizeof(Constraint*));
+
+	assert(array->start != NULL, "No memory!");
+}
+
 Constraint* ConstraintArrayAdd(ConstraintArray* array) {
 	if(array->size == array->capacity) {
-		array->capacity++;
-		array->start = reallocarray(array->start, array->capacity, sizeof(Constraint*));
-
-		assert(array->start != NULL, "No memory!");
+		ConstraintArrayReserve(array, array->capacity == 0 ? 16 : array->capacity * 2);
 	}
 
 	Constraint* particle = malloc(sizeof(Constraint));
@@ -119,21 +145,194 @@ Constraint* ConstraintArrayAdd(ConstraintArray* array) {
 	return particle;
 }
 
-Constraint* ConstraintCreate(ConstraintArray* array, ParticleArray* particlesArray, ConstraintType type, SymbolNode* t,
-							 SymbolMatrix* x, SymbolMatrix* v, SymbolMatrix* a, SymbolNode* f, SymbolNode* df_dt,
-							 SymbolMatrix* df_dx, SymbolMatrix* df_dxdt) {
+// Particle and parameter counts follow from the inputs and outputs of the graph
+ConstraintTemplate* ConstraintTemplateCreateGraph(ConstraintType type, const SymbolGraph* graph) {
+	const unsigned int particleCount = (graph->outputCount - 1) / 2;
+	const unsigned int parameterCount = graph->inputCount - particleCount * 2;
+
+	assert(parameterCount <= CONSTRAINT_MAX_PARAMETERS, "Too many constraint parameters!");
+
+	ConstraintTemplate* constraintTemplate = malloc(sizeof(ConstraintTemplate));
+	*constraintTemplate = (ConstraintTemplate) {
+		.type = type,
+		.particleCount = particleCount,
+		.parameterCount = parameterCount,
+		.inputCount = graph->inputCount,
+		.outputCount = graph->outputCount,
+		.x = NULL,
+		.parameters = NULL,
+		.constraintFunction = NULL,
+		.constraintFunction_dx = NULL,
+		.jacobianEntries = calloc(particleCount * 2, sizeof(unsigned int)),
+		.jacobianEntryCount = 0,
+		.graph = NULL,
+		.tape = SymbolTapeCreateGraph(graph),
+		.kernel = NULL,
+		.jit = NULL,
+		.constraintCount = 0,
+		.batchCapacity = 0,
+		.batchInputs = NULL,
+		.batchInputTangents = NULL,
+		.batchOutputs = NULL,
+		.batchOutputTangents = NULL,
+	};
+
+	bool* nonzero = calloc(graph->outputCount, sizeof(bool));
+	assert(constraintTemplate->jacobianEntries != NULL && nonzero != NULL, "No memory!");
+	SymbolGraphSparsity(graph, nonzero);
+	for (unsigned int i = 0; i < particleCount * 2; ++i) {
+		if(nonzero[1 + i]) {
+			constraintTemplate->jacobianEntries[constraintTemplate->jacobianEntryCount++] = i;
+		}
+	}
+	free(nonzero);
+
+	// Constraints defined at runtime have no generated kernel, compile their tape instead where the JIT is supported
+	constraintTemplate->jit = SymbolJitCreate(constraintTemplate->tape);
+	if(constraintTemplate->jit != NULL) {
+		constraintTemplate->kernel = constraintTemplate->jit->function;
+	}
+
+	return constraintTemplate;
+}
+
+// Inputs are the parameters, then the position of each particle
+// Outputs are f, then df/dx for each particle and dimension
+ConstraintTemplate* ConstraintTemplateCreate(ConstraintType type, SymbolMatrix* parameters, SymbolMatrix* x,
+                                             SymbolNode* f, SymbolMatrix* df_dx) {
+	const unsigned int particleCount = x->rows;
+	const unsigned int parameterCount = parameters->rows * parameters->cols;
+	const unsigned int inputCount = parameterCount + particleCount * 2;
+	const unsigned int outputCount = 1 + particleCount * 2;
+
+	SymbolNode** inputs = calloc(inputCount, sizeof(SymbolNode*));
+	SymbolNode** outputs = calloc(outputCount, sizeof(SymbolNode*));
+
+	for (unsigned int i = 0; i < parameterCount; ++i) {
+		inputs[i] = parameters->values[i];
+	}
+	for (unsigned int i = 0; i < particleCount; ++i) {
+		inputs[parameterCount + i * 2 + 0] = SymbolMatrixGet(x, i, 0);
+		inputs[parameterCount + i * 2 + 1] = SymbolMatrixGet(x, i, 1);
+	}
+
+	outputs[0] = f;
+	for (unsigned int i = 0; i < particleCount; ++i) {
+		for (unsigned int k = 0; k < 2; ++k) {
+			outputs[1 + i * 2 + k] = SymbolMatrixGet(df_dx, i, k);
+		}
+	}
+
+	SymbolGraph* graph = SymbolGraphCreate(inputs, inputCount, outputs, outputCount);
+	ConstraintTemplate* constraintTemplate = ConstraintTemplateCreateGraph(type, graph);
+	constraintTemplate->x = x;
+	constraintTemplate->parameters = parameters;
+	constraintTemplate->constraintFunction = f;
+	constraintTemplate->constraintFunction_dx = df_dx;
+	constraintTemplate->graph = graph;
+
+	free(inputs);
+	free(outputs);
+
+	return constraintTemplate;
+}
+
+ConstraintTemplate* ConstraintTemplateCreateKernel(ConstraintType type, const ConstraintKernel* kernel) {
+	assert(kernel->parameterCount <= CONSTRAINT_MAX_PARAMETERS, "Too many constraint parameters!");
+
+	unsigned int* entries = calloc(kernel->particleCount * 2, sizeof(unsigned int));
+	assert(entries != NULL, "No memory!");
+	for (unsigned int i = 0; i < kernel->jacobianEntryCount; ++i) {
+		entries[i] = kernel->jacobianEntries[i];
+	}
+
+	ConstraintTemplate* constraintTemplate = malloc(sizeof(ConstraintTemplate));
+	*constraintTemplate = (ConstraintTemplate) {
+		.type = type,
+		.particleCount = kernel->particleCount,
+		.parameterCount = kernel->parameterCount,
+		.inputCount = kernel->parameterCount + kernel->particleCount * 2,
+		.outputCount = 1 + kernel->particleCount * 2,
+		.x = NULL,
+		.parameters = NULL,
+		.constraintFunction = NULL,
+		.constraintFunction_dx = NULL,
+		.jacobianEntries = entries,
+		.jacobianEntryCount = kernel->jacobianEntryCount,
+		.graph = NULL,
+		.tape = NULL,
+		.kernel = kernel->evaluate,
+		.jit = NULL,
+		.constraintCount = 0,
+		.batchCapacity = 0,
+		.batchInputs = NULL,
+		.batchInputTangents = NULL,
+		.batchOutputs = NULL,
+		.batchOutputTangents = NULL,
+	};
+
+	return constraintTemplate;
+}
+
+void ConstraintTemplateFree(ConstraintTemplate* constraintTemplate) {
+	if(constraintTemplate->graph != NULL) {
+		SymbolGraphFree(constraintTemplate->graph);
+	}
+	if(constraintTemplate->tape != NULL) {
+		SymbolTapeFree(constraintTemplate->tape);
+	}
+	if(constraintTemplate->jit != NULL) {
+		SymbolJitFree(constraintTemplate->jit);
+	}
+	free(constraintTemplate->jacobianEntries);
+	free(constraintTemplate->batchInputs);
+	free(constraintTemplate->batchInputTangents);
+	free(constraintTemplate->batchOutputs);
+	free(constraintTemplate->batchOutputTangents);
+	free(constraintTemplate);
+}
+
+// Batch buffers grow geometrically, so adding constraints one at a time stays linear
+static void ConstraintTemplateReserve(ConstraintTemplate* constraintTemplate, unsigned int capacity) {
+	if(capacity <= constraintTemplate->batchCapacity) {
+		return;
+	}
+
+	const unsigned int grown = constraintTemplate->batchCapacity == 0 ? 16 : constraintTemplate->batchCapacity * 2;
+	constraintTemplate->batchCapacity = capacity > grown ? capacity : grown;
+
+	const unsigned int inputCapacity = constraintTemplate->inputCount * constraintTemplate->batchCapacity;
+	const unsigned int outputCapacity = constraintTemplate->outputCount * constraintTemplate->batchCapacity;
+	constraintTemplate->batchInputs = reallocarray(constraintTemplate->batchInputs, inputCapacity, sizeof(float));
+	constraintTemplate->batchInputTangents = reallocarray(constraintTemplate->batchInputTangents, inputCapacity, sizeof(float));
+	constraintTemplate->batchOutputs = reallocarray(constraintTemplate->batchOutputs, outputCapacity, sizeof(float));
+	constraintTemplate->batchOutputTangents = reallocarray(constraintTemplate->batchOutputTangents, outputCapacity, sizeof(float));
+
+	assert(constraintTemplate->batchInputs != NULL && constraintTemplate->batchInputTangents != NULL
+	       && constraintTemplate->batchOutputs != NULL && constraintTemplate->batchOutputTangents != NULL, "No memory!");
+}
+
+unsigned int ConstraintTemplateAddLanes(ConstraintTemplate* constraintTemplate, unsigned int count) {
+	ConstraintTemplateReserve(constraintTemplate, constraintTemplate->constraintCount + count);
+
+	const unsigned int first = constraintTemplate->constraintCount;
+	constraintTemplate->constraintCount += count;
+	return first;
+}
+
+Constraint* ConstraintCreate(ConstraintArray* array, ParticleArray* particlesArray, ConstraintTemplate* constraintTemplate,
+                             const float* parameters) {
+	assert(particlesArray->size == constraintTemplate->particleCount, "Constraint has incorrect number of particles!");
+
 	Constraint* constraint = ConstraintArrayAdd(array);
-	constraint->type = type;
+	constraint->type = constraintTemplate->type;
 	constraint->index = array->size - 1;
 	constraint->particles = particlesArray;
-	constraint->t = t;
-	constraint->x = x;
-	constraint->v = v;
-	constraint->a = a;
-	constraint->constraintFunction = f;
-	constraint->constraintFunction_dt = df_dt;
-	constraint->constraintFunction_dx = df_dx;
-	constraint->constraintFunction_dxdt = df_dxdt;
+	constraint->constraintTemplate = constraintTemplate;
+	constraint->lane = ConstraintTemplateAddLanes(constraintTemplate, 1);
+	for (unsigned int i = 0; i < constraintTemplate->parameterCount; ++i) {
+		constraint->parameters[i] = parameters[i];
+	}
 	return constraint;
 }
 
@@ -141,118 +340,165 @@ Constraint* ConstraintCreate(ConstraintArray* array, ParticleArray* particlesArr
 // Constraint
 //----------------------------------------------------------------------------------
 
-// Provide position, velocity and acceleration for all particles in expression from values in Constraint
-// Then evaluate the expression
-float ConstraintEvaluateSymbolNode(Constraint* constraint, SymbolNodeArray *array, SymbolNode* expression) {
-	SymbolNode* result = expression;
-	result = SymbolNodeEvaluate(result, array, constraint->t, 0.0f);
+bool ConstraintJacobianNonzero(const Constraint* constraint, unsigned int particle, unsigned int dimension) {
+	const ConstraintTemplate* constraintTemplate = constraint->constraintTemplate;
+	assert(particle < constraintTemplate->particleCount && dimension < 2, "Indexing nonexistent element!");
 
-	for (unsigned int i = 0; i < constraint->particles->size; ++i) {
-		Particle* particle = constraint->particles->start[i];
+	for (unsigned int i = 0; i < constraintTemplate->jacobianEntryCount; ++i) {
+		if(constraintTemplate->jacobianEntries[i] == particle * 2 + dimension) {
+			return true;
+		}
+	}
+	return false;
+}
 
-		// Set particle position
-		result = SymbolNodeEvaluate(result, array, SymbolMatrixGet(constraint->x, i, 0), particle->x.x);
-		result = SymbolNodeEvaluate(result, array, SymbolMatrixGet(constraint->x, i, 1), particle->x.y);
+unsigned int ConstraintArrayJacobianNonzeroCount(const ConstraintArray* array) {
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < array->size; ++i) {
+		count += array->start[i]->constraintTemplate->jacobianEntryCount;
+	}
+	return count;
+}
 
-		// Set particle velocity
-		result = SymbolNodeEvaluate(result, array, SymbolMatrixGet(constraint->v, i, 0), particle->v.x);
-		result = SymbolNodeEvaluate(result, array, SymbolMatrixGet(constraint->v, i, 1), particle->v.y);
+// Provide parameters, position and velocity for all particles from values in each Constraint, gathered into its lane
+// Then evaluate each template over all its lanes at once, with its kernel or else by interpreting its tape
+// Results are left in batchOutputs and their time derivatives in batchOutputTangents of each template
+void ConstraintArrayEvaluate(ConstraintArray* array) {
+	for (unsigned int i = 0; i < array->size; ++i) {
+		Constraint* constraint = array->start[i];
+		ConstraintTemplate* constraintTemplate = constraint->constraintTemplate;
+		const unsigned int parameterCount = constraintTemplate->parameterCount;
+		const unsigned int count = constraintTemplate->constraintCount;
+		const unsigned int lane = constraint->lane;
+		float* inputs = constraintTemplate->batchInputs;
+		float* inputTangents = constraintTemplate->batchInputTangents;
+
+		// Parameters are constant in time
+		for (unsigned int j = 0; j < parameterCount; ++j) {
+			inputs[j * count + lane] = constraint->parameters[j];
+			inputTangents[j * count + lane] = 0.0f;
+		}
+
+		for (unsigned int j = 0; j < constraint->particles->size; ++j) {
+			Particle* particle = constraint->particles->start[j];
+			const unsigned int input = parameterCount + j * 2;
 
-		// Set particle acceleration
-		result = SymbolNodeEvaluate(result, array, SymbolMatrixGet(constraint->a, i, 0), particle->a.x);
-		result = SymbolNodeEvaluate(result, array, SymbolMatrixGet(constraint->a, i, 1), particle->a.y);
+			// Set particle position
+			inputs[(input + 0) * count + lane] = particle->x.x;
+			inputs[(input + 1) * count + lane] = particle->x.y;
+
+			// Set particle velocity, the derivative of the position at t = 0
+			inputTangents[(input + 0) * count + lane] = particle->v.x;
+			inputTangents[(input + 1) * count + lane] = particle->v.y;
+		}
 	}
 
-	assert(result->operation == CONSTANT, "Variables are left without value!");
-	return result->data.value;
-}
+	for (unsigned int i = 0; i < CONSTRAINT_TYPE_COUNT; ++i) {
+		ConstraintTemplate* constraintTemplate = array->templates[i];
 
-// Provide position, velocity and acceleration for all particles in expression from values in Constraint
-// Then evaluate the expression
-MatrixN* ConstraintEvaluateSymbolMatrix(Constraint* constraint, SymbolNodeArray *array, MatrixNArray* matrixNArray,
-										SymbolMatrix* expression) {
-	MatrixN* matrix = MatrixNCreate(matrixNArray, expression->rows, expression->cols);
-	for (unsigned int i = 0; i < expression->cols * expression->rows; ++i) {
-		matrix->values[i] = ConstraintEvaluateSymbolNode(constraint, array, expression->values[i]);
+		if(constraintTemplate == NULL) {
+			continue;
+		}
+
+		if(constraintTemplate->kernel != NULL) {
+			constraintTemplate->kernel(constraintTemplate->constraintCount,
+			                           constraintTemplate->batchInputs, constraintTemplate->batchInputTangents,
+			                           constraintTemplate->batchOutputs, constraintTemplate->batchOutputTangents);
+		} else {
+			SymbolTapeEvaluateDualBatch(constraintTemplate->tape, constraintTemplate->constraintCount,
+			                            constraintTemplate->batchInputs, constraintTemplate->batchInputTangents,
+			                            constraintTemplate->batchOutputs, constraintTemplate->batchOutputTangents);
+		}
 	}
-	return matrix;
 }
 
 //----------------------------------------------------------------------------------
 // Simulator
 //----------------------------------------------------------------------------------
 
-SimulatorMatrices GetMatrices(SymbolMatrixArray *array, MatrixNArray* matrixNArray, float ks, float kd,
-							  ParticleArray* particles, ConstraintArray* constraints) {
+SimulatorMatrices GetMatrices(MatrixNArray* matrixNArray, float ks, float kd, ParticleArray* particles,
+                              ConstraintArray* constraints) {
 	const unsigned int d = 2;
-	const unsigned int n = particles->capacity;
-	const unsigned int m = constraints->capacity;
+	const unsigned int n = particles->size;
+	const unsigned int m = constraints->size;
 
 	MatrixN* dq = MatrixNCreate(matrixNArray, n*d, 1);
+	// Q are the applied forces
 	MatrixN* Q = MatrixNCreate(matrixNArray, n*d, 1);
 	MatrixN* C = MatrixNCreate(matrixNArray, m, 1);
 	MatrixN* dC = MatrixNCreate(matrixNArray, m, 1);
-	MatrixN* W = MatrixNCreate(matrixNArray, n * d, n * d);
-	MatrixN* J = MatrixNCreate(matrixNArray, m, n * d);
-	MatrixN* dJ = MatrixNCreate(matrixNArray, m, n * d);
 
-	for (unsigned int i = 0; i < n*d; ++i) {
-		*MatrixNGet(W, i, i) = 1;
-	}
+	// W is the diagonal of inverse masses, one entry per particle and dimension, only its diagonal is stored
+	MatrixN* W = MatrixNCreate(matrixNArray, n * d, 1);
+
+	// Every constraint only touches its own particles, J and dJ are gathered as their structural nonzeros
+	const unsigned int nonzeroCount = ConstraintArrayJacobianNonzeroCount(constraints);
+	MatrixNTriplets* JTriplets = MatrixNTripletsCreate(matrixNArray, m, n * d, nonzeroCount);
+	MatrixNTriplets* dJTriplets = MatrixNTripletsCreate(matrixNArray, m, n * d, nonzeroCount);
 
 	for (unsigned int i = 0; i < particles->size; ++i) {
+		*MatrixNGet(W, i+n*0, 0) = particles->start[i]->inverseMass;
+		*MatrixNGet(W, i+n*1, 0) = particles->start[i]->inverseMass;
 		// TODO check if this should be differenciated x(t) terms
 		*MatrixNGet(dq, i+n*0, 0) = particles->start[i]->v.x;
 		*MatrixNGet(dq, i+n*1, 0) = particles->start[i]->v.y;
-		*MatrixNGet(Q, i+n*0, 0) = particles->start[i]->a.x;
-		*MatrixNGet(Q, i+n*1, 0) = particles->start[i]->a.y;
+		*MatrixNGet(Q, i+n*0, 0) = particles->start[i]->fApplied.x;
+		*MatrixNGet(Q, i+n*1, 0) = particles->start[i]->fApplied.y;
 	}
 
-	for (unsigned int i = 0; i < constraints->size; ++i) {
-		Constraint* constraint = constraints->start[i];
+	// W Q is the applied acceleration, none for static particles whatever force they are given
+	MatrixN* WQ = MatrixNCreate(matrixNArray, n*d, 1);
+	MatrixNDiagonalMultiplyInto(WQ, W, Q);
 
-		float c = ConstraintEvaluateSymbolNode(constraint, array->nodeArray, constraint->constraintFunction);
-		float dc_dt = ConstraintEvaluateSymbolNode(constraint, array->nodeArray, constraint->constraintFunction_dt);
-		MatrixN* dc_dx = ConstraintEvaluateSymbolMatrix(constraint, array->nodeArray,  matrixNArray,
-														constraint->constraintFunction_dx);
-		MatrixN* dc_dxdt = ConstraintEvaluateSymbolMatrix(constraint, array->nodeArray, matrixNArray,
-														  constraint->constraintFunction_dxdt);
+	ConstraintArrayEvaluate(constraints);
 
-		*MatrixNGet(C, constraint->index, 0) += c;
-		*MatrixNGet(dC, constraint->index, 0) += dc_dt;
-		for (unsigned int j = 0; j < constraint->particles->size; ++j) {
-			Particle* constrainedParticle = constraint->particles->start[j];
-
-			for (unsigned int k = 0; k < d; ++k) {
-				// The constraint/particle index is for the simulation, each constraint has its own (smaller) indices
-				// and has to be reindexed into the full matrix
-				*MatrixNGet(J, constraint->index, constrainedParticle->index + n * k) += *MatrixNGet(dc_dx, j, k);
-				*MatrixNGet(dJ, constraint->index, constrainedParticle->index + n * k) += *MatrixNGet(dc_dxdt, j, k);
-			}
+	for (unsigned int i = 0; i < constraints->size; ++i) {
+		Constraint* constraint = constraints->start[i];
+		ConstraintTemplate* constraintTemplate = constraint->constraintTemplate;
+		const unsigned int count = constraintTemplate->constraintCount;
+		const unsigned int lane = constraint->lane;
+
+		// Outputs are f, then df/dx for each particle and dimension, their tangents are the time derivatives
+		const float* outputs = constraintTemplate->batchOutputs;
+		const float* outputTangents = constraintTemplate->batchOutputTangents;
+
+		*MatrixNGet(C, constraint->index, 0) += outputs[lane];
+		*MatrixNGet(dC, constraint->index, 0) += outputTangents[lane];
+
+		// Entries of df/dx known to be zero are skipped, the same particle twice adds up when J is compressed
+		for (unsigned int e = 0; e < constraintTemplate->jacobianEntryCount; ++e) {
+			const unsigned int entry = constraintTemplate->jacobianEntries[e];
+			const unsigned int output = 1 + entry;
+			const unsigned int k = entry % d;
+			Particle* constrainedParticle = constraint->particles->start[entry / d];
+
+			// The constraint/particle index is for the simulation, each constraint has its own (smaller) indices
+			// and has to be reindexed into the full matrix
+			MatrixNTripletsAdd(JTriplets, constraint->index, constrainedParticle->index + n * k,
+			                   outputs[output * count + lane]);
+			MatrixNTripletsAdd(dJTriplets, constraint->index, constrainedParticle->index + n * k,
+			                   outputTangents[output * count + lane]);
 		}
 	}
 
-	MatrixNPrint(J);
+	MatrixNSparse* J = MatrixNSparseCreate(matrixNArray, JTriplets);
+	MatrixNSparse* dJ = MatrixNSparseCreate(matrixNArray, dJTriplets);
 
-	// Compute f(X) = dJdq + J W Q + ks C + kd dC
-	MatrixN* t1 = MatrixNMultiply(matrixNArray, dJ, dq);                          // dJ dq
-	MatrixN* t2 = MatrixNMultiply(matrixNArray, J, W);                            // J W
-	MatrixN* t3 = MatrixNMultiply(matrixNArray, t2, Q);                           // J W Q
-	MatrixN* t4 = MatrixNMultiplyValue(matrixNArray, C, ks);                      // ks C
-	MatrixN* t5 = MatrixNMultiplyValue(matrixNArray, dC, kd);                     // kd dC
-	MatrixN* t6 = MatrixNAdd(matrixNArray, t1, t3);                               // dJ dq + J W Q
-	MatrixN* t7 = MatrixNAdd(matrixNArray, t6, t4);                               // dJ dq + J W Q + ks C
-	MatrixN* f = MatrixNAdd(matrixNArray, t7, t5);                                // dJ dq + J W Q + ks C + kd dC
+	// Compute f(X) = dJdq + J W Q + ks C + kd dC, every term is added to f as it is computed
+	MatrixN* f = MatrixNCreate(matrixNArray, m, 1);
+	MatrixNMultiplyValueInto(f, C, ks);                                           // ks C
+	MatrixNMultiplyValueAddInto(f, dC, kd);                                       // ks C + kd dC
+	MatrixNSparseMultiplyAddInto(f, dJ, dq);                                      // dJ dq + ks C + kd dC
+	MatrixNSparseMultiplyAddInto(f, J, WQ);                                       // dJ dq + J W Q + ks C + kd dC
 
-	// Compute g(X) = J W J'
-	MatrixN* t8 = MatrixNMultiply(matrixNArray, J, W);                            // J W
-	MatrixN* t9 = MatrixNTranspose(matrixNArray, J);                              // J'
-	MatrixN* g = MatrixNMultiply(matrixNArray, t8, t9);                           // J W J'
+	// Compute g(X) = J W J', only constraints sharing a particle that can move are coupled
+	MatrixNSparse* g = MatrixNSparseMultiplyWeightedTranspose(matrixNArray, J, W); // J W J'
 
 	return (SimulatorMatrices) {
 		.f = f,
 		.g = g,
 		.J = J,
+		.W = W,
 		.norm = ks * MatrixNNorm(C) + kd * MatrixNNorm(dC)
 	};
 }
@@ -262,17 +508,23 @@ Simulator SimulatorCreate(ParticleArray* particles, ConstraintArray* constraints
 	return (Simulator) {
 		.ks = ks,
 		.kd = ks * 0.1f,
+		.regularization = 1e-5f,
 		.particles = particles,
 		.constraints = constraints,
 		.printData = printData,
 		.time = 0,
 		.error = 0,
+		.matrixNArray = MatrixNArrayCreate(),
 	};
 }
 
+void SimulatorFree(Simulator* simulator) {
+	MatrixNArrayFree(simulator->matrixNArray);
+}
+
 void SimulatorUpdate(Simulator* simulator, float timestep) {
-	SymbolMatrixArray* symbolMatrixArray = SymbolMatrixArrayCreate();
-	MatrixNArray* matrixNArray = MatrixNArrayCreate();
+	MatrixNArray* matrixNArray = simulator->matrixNArray;
+	MatrixNArrayReset(matrixNArray);
 
 	for (unsigned int i = 0; i < simulator->particles->size; ++i) {
 		Particle* particle = simulator->particles->start[i];
@@ -281,27 +533,28 @@ void SimulatorUpdate(Simulator* simulator, float timestep) {
 			continue;
 		}
 
-		particle->aApplied = Vector2Zero(); // TODO apply force
-		particle->a = particle->aApplied;
+		particle->aApplied = Vector2Scale(particle->fApplied, particle->inverseMass);
 	}
 
-	SimulatorMatrices matrices = GetMatrices(symbolMatrixArray, matrixNArray, simulator->ks,
-											 simulator->kd, simulator->particles, simulator->constraints);
+	SimulatorMatrices matrices = GetMatrices(matrixNArray, simulator->ks, simulator->kd, simulator->particles,
+	                                         simulator->constraints);
 
 	assert(matrices.f->rows == simulator->constraints->size && matrices.f->cols == 1, "Wrong size for simulator matrices!");
 	assert(matrices.g->rows == simulator->constraints->size && matrices.g->cols == simulator->constraints->size, "Wrong size for simulator matrices!");
 	assert(matrices.J->rows == simulator->constraints->size && matrices.J->cols == simulator->particles->size * 2, "Wrong size for simulator matrices!");
 
-	// Solve for x in g(X) * λ = -f(X)
-	MatrixN* t10 = MatrixNPseudoinverse(matrixNArray, matrices.g);
-	MatrixN* t11 = MatrixNNegate(matrixNArray, matrices.f);
-	MatrixN* lambda = MatrixNMultiply(matrixNArray, t10, t11);
+	// Solve for x in g(X) * λ = -f(X), g = J W J' is symmetric positive semidefinite so it is factored instead of inverted
+	MatrixNSparse* t10 = MatrixNSparseCholesky(matrixNArray, matrices.g, simulator->regularization);
+	MatrixN* lambda = MatrixNCreate(matrixNArray, simulator->constraints->size, 1);
+	MatrixNNegateInto(lambda, matrices.f);                                        // -f
+	MatrixNSparseCholeskySolveInto(lambda, t10, lambda);                          // g⁻¹ -f
 
 	assert(lambda->rows == simulator->constraints->size && lambda->cols == 1, "Wrong size for simulator matrices!");
 
-	// Solve for accelerations in J' * λ = â
-	MatrixN* transposeJ = MatrixNTranspose(matrixNArray, matrices.J);
-	MatrixN* aConstraint = MatrixNMultiply(matrixNArray, transposeJ, lambda);
+	// Solve for accelerations in W J' * λ = â, the constraint force J' λ moves lighter particles more
+	MatrixN* aConstraint = MatrixNCreate(matrixNArray, simulator->particles->size * 2, 1);
+	MatrixNSparseTransposeMultiplyInto(aConstraint, matrices.J, lambda);          // J' λ
+	MatrixNDiagonalMultiplyInto(aConstraint, matrices.W, aConstraint);            // W J' λ
 	MatrixNReshape(aConstraint, simulator->particles->size, 2);
 
 	for (unsigned int i = 0; i < simulator->particles->size; ++i) {
@@ -327,18 +580,17 @@ void SimulatorUpdate(Simulator* simulator, float timestep) {
 		TraceLog(LOG_DEBUG, "ks %f", simulator->ks);
 		TraceLog(LOG_DEBUG, "kd %f", simulator->kd);
 		TraceLog(LOG_DEBUG, "J");
-		MatrixNPrint(matrices.J);
+		MatrixNSparsePrint(matrices.J);
 		TraceLog(LOG_DEBUG, "f = dJ dq + J W Q + ks C + kd dC");
 		MatrixNPrint(matrices.f);
 		TraceLog(LOG_DEBUG, "g = J W J.T");
-		MatrixNPrint(matrices.g);
+		MatrixNSparsePrint(matrices.g);
 		TraceLog(LOG_DEBUG, "λ");
 		MatrixNPrint(lambda);
 		TraceLog(LOG_DEBUG, "g λ' + f");
-		MatrixN* r = MatrixNAdd(matrixNArray, MatrixNMultiply(matrixNArray, matrices.g, lambda), matrices.f);
+		MatrixN* r = MatrixNCreate(matrixNArray, simulator->constraints->size, 1);
+		MatrixNSparseMultiplyInto(r, matrices.g, lambda);                         // g λ
+		MatrixNAddInto(r, r, matrices.f);                                         // g λ + f
 		MatrixNPrint(r);
 	}
-
-	SymbolMatrixArrayFree(symbolMatrixArray);
-	MatrixNArrayFree(matrixNArray);
 }
@@ -16,8 +16,12 @@ typedef struct Particle {
 	Vector2 x;
 	Vector2 v;
 	Vector2 a;
+	// Force applied to the particle, kept between steps, aApplied is the acceleration it gives
+	Vector2 fApplied;
 	Vector2 aApplied;
 	Vector2 aConstraint;
+	// 1 / mass, 0 for a static particle, which no force can move
+	float inverseMass;
 	bool isStatic;
 } Particle;
 
@@ -33,8 +37,14 @@ void ParticleArrayFree(ParticleArray* particles);
 
 ParticleArray* ParticleArrayOf(unsigned int size, ...);
 
+// Particles have a mass of 1 unless it is changed with ParticleSetMass
 Particle* ParticleCreate(ParticleArray* array, Vector2 x, bool isStatic);
 
+void ParticleSetMass(Particle* particle, float mass);
+
+// The force stays applied on every step until it is set again
+void ParticleSetForce(Particle* particle, Vector2 force);
+
 //-----------------------------------------------------------------------------
 // Constraint
 //-----------------------------------------------------------------------------
@@ -42,48 +52,132 @@ Particle* ParticleCreate(ParticleArray* array, Vector2 x, bool isStatic);
 typedef enum ConstraintType {
 	CIRCLE,
 	DISTANCE,
+	CONSTRAINT_TYPE_COUNT,
 } ConstraintType;
 
+#define CONSTRAINT_MAX_PARAMETERS 4
+
+// Straight-line evaluation of a constraint type, with the signature and batch layout of SymbolTapeEvaluateDualBatch
+typedef void (*ConstraintKernelFunction)(unsigned int count, const float* inputs, const float* inputTangents,
+                                         float* outputs, float* outputTangents);
+
+typedef struct ConstraintKernel {
+	ConstraintKernelFunction evaluate;
+	unsigned int particleCount;
+	unsigned int parameterCount;
+	// Structural nonzeros of df/dx as in ConstraintTemplate, NULL when there are none
+	const unsigned int* jacobianEntries;
+	unsigned int jacobianEntryCount;
+} ConstraintKernel;
+
+// Symbolic function of a ConstraintType, built and compiled once and shared by all its constraints
+// Values that differ between constraints (center, radius, distance...) are parameter variables instead of constants
+typedef struct ConstraintTemplate {
+	ConstraintType type;
+	unsigned int particleCount;
+	unsigned int parameterCount;
+	unsigned int inputCount;
+	unsigned int outputCount;
+
+	// Symbolic form, NULL when the template comes from a generated kernel
+	SymbolMatrix* x;
+	SymbolMatrix* parameters;
+
+	// Specialized for t = 0, so they only depend on the parameters and positions
+	SymbolNode* constraintFunction;
+	SymbolMatrix* constraintFunction_dx;
+
+	// Entries of df/dx that are not structurally zero, in increasing order, entry j * 2 + k is particle j along
+	// dimension k and output 1 + j * 2 + k, the other entries of J and dJ are 0 for every constraint of the template
+	unsigned int* jacobianEntries;
+	unsigned int jacobianEntryCount;
+
+	// Pointer-free form of f and df/dx with the inputs and outputs of the tape, what the graph cache stores
+	// NULL unless the template was built from its symbolic form
+	SymbolGraph* graph;
+
+	// Compiled form of f and df/dx, inputs are the parameters then the position of each particle
+	// Time derivatives df/dt and d²f/dxdt are the output tangents of a dual number evaluation seeded with dx/dt = v
+	SymbolTape* tape;
+
+	// Generated kernel of a built-in type, or else the tape compiled to native code, NULL when it is interpreted
+	ConstraintKernelFunction kernel;
+	SymbolJit* jit;
+
+	// All constraints of the template are evaluated together, each one in its own lane of the batch
+	unsigned int constraintCount;
+	unsigned int batchCapacity;
+	float* batchInputs;
+	float* batchInputTangents;
+	float* batchOutputs;
+	float* batchOutputTangents;
+} ConstraintTemplate;
+
+ConstraintTemplate* ConstraintTemplateCreate(ConstraintType type, SymbolMatrix* parameters, SymbolMatrix* x,
+                                             SymbolNode* f, SymbolMatrix* df_dx);
+
+// Template compiled from the graph of another one, such as a cached graph, the graph is not kept
+ConstraintTemplate* ConstraintTemplateCreateGraph(ConstraintType type, const SymbolGraph* graph);
+
+// Template evaluated by a generated kernel instead of a tape, nothing has to be built or differentiated
+ConstraintTemplate* ConstraintTemplateCreateKernel(ConstraintType type, const ConstraintKernel* kernel);
+
+void ConstraintTemplateFree(ConstraintTemplate* constraintTemplate);
+
+// Values a constraint was created with, by type
+typedef union ConstraintMetadata {
+	struct {
+		Vector2 center;
+		Vector2 radius;
+	} circle;
+	struct {
+		float distance;
+	} distance;
+} ConstraintMetadata;
+
 typedef struct Constraint {
 	ConstraintType type;
 	unsigned int index;
 
 	ParticleArray* particles;
 
-	SymbolNode* t;
-	SymbolMatrix* x;
-	SymbolMatrix* v;
-	SymbolMatrix* a;
+	ConstraintTemplate* constraintTemplate;
+	unsigned int lane;
+	float parameters[CONSTRAINT_MAX_PARAMETERS];
 
-	SymbolNode* constraintFunction;
-	SymbolNode* constraintFunction_dt;
-	SymbolMatrix* constraintFunction_dx;
-	SymbolMatrix* constraintFunction_dxdt;
-
-	union {
-		struct {
-			Vector2 center;
-			Vector2 radius;
-		} circle;
-		struct {
-			float distance;
-		} distance;
-	} metadata;
+	ConstraintMetadata metadata;
 } Constraint;
 
 typedef struct ConstraintArray {
 	Constraint** start;
 	unsigned int capacity;
 	unsigned int size;
+	ConstraintTemplate* templates[CONSTRAINT_TYPE_COUNT];
+
+	// Where the graphs of templates without a generated kernel are cached between runs, NULL to always build them
+	const char* cacheDirectory;
 } ConstraintArray;
 
 ConstraintArray* ConstraintArrayCreate();
 
 void ConstraintArrayFree(ConstraintArray* particles);
 
-Constraint* ConstraintCreate(ConstraintArray* array, ParticleArray* particlesArray, ConstraintType type, SymbolNode* t,
-                             SymbolMatrix* x, SymbolMatrix* v, SymbolMatrix* a, SymbolNode* f, SymbolNode* df_dt,
-                             SymbolMatrix* df_dx, SymbolMatrix* df_dxdt);
+// Makes room for capacity constraints in total, so adding up to that many does not reallocate
+void ConstraintArrayReserve(ConstraintArray* array, unsigned int capacity);
+
+Constraint* ConstraintCreate(ConstraintArray* array, ParticleArray* particlesArray, ConstraintTemplate* constraintTemplate,
+                             const float* parameters);
+
+// Gives count more constraints of the template a lane in the batch buffers, returns the first of them
+unsigned int ConstraintTemplateAddLanes(ConstraintTemplate* constraintTemplate, unsigned int count);
+
+// Whether df/dx of the constraint for one of its particles along dimension can be nonzero
+bool ConstraintJacobianNonzero(const Constraint* constraint, unsigned int particle, unsigned int dimension);
+
+// Structural nonzeros of J, one row per constraint, enough to preallocate its sparse structure
+unsigned int ConstraintArrayJacobianNonzeroCount(const ConstraintArray* array);
+
+void ConstraintArrayEvaluate(ConstraintArray* array);
 
 //-----------------------------------------------------------------------------
 // Simulator
@@ -92,22 +186,30 @@ Constraint* ConstraintCreate(ConstraintArray* array, ParticleArray* particlesArr
 typedef struct Simulator {
 	float ks;
 	float kd;
+	// Smallest pivot of the factorization of g relative to its largest diagonal entry, see MatrixNCholesky
+	float regularization;
 	ParticleArray* particles;
 	ConstraintArray* constraints;
 	bool printData;
 	float time;
 	float error;
+
+	// Matrices of a single step, reset at the start of the next one
+	MatrixNArray* matrixNArray;
 } Simulator;
 
 typedef struct SimulatorMatrices {
 	MatrixN* f;
-	MatrixN* g;
-	MatrixN* J;
+	MatrixNSparse* g;
+	MatrixNSparse* J;
+	MatrixN* W;
 	float norm;
 } SimulatorMatrices;
 
 Simulator SimulatorCreate(ParticleArray* particles, ConstraintArray* constraints, bool printData);
 
+void SimulatorFree(Simulator* simulator);
+
 void SimulatorUpdate(Simulator* simulator, float timestep);
 
 #endif //CONSTRAINT_BASED_SIMULATOR_SIMULATOR_H
@@ -1,34 +1,230 @@
 #include "symdiff.h"
 
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <raylib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <config.h>
 #include "custom_assert.h"
 
+// The JIT maps its code pages itself, apart from the graph files
+#if defined(__x86_64__) && !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+//-----------------------------------------------------------------------------
+// SymbolNodeMap
+//-----------------------------------------------------------------------------
+
+typedef union SymbolNodeMapValue {
+	unsigned int index;
+	SymbolNode* node;
+} SymbolNodeMapValue;
+
+// Open addressing map from node pointer to an index or node, used by the passes that have to visit a DAG only once
+typedef struct SymbolNodeMap {
+	SymbolNode** keys;
+	SymbolNodeMapValue* values;
+	size_t capacity;
+	size_t size;
+} SymbolNodeMap;
+
+static size_t SymbolNodeMapHash(SymbolNode* node) {
+	uint64_t hash = (uint64_t) (uintptr_t) node;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	return (size_t) hash;
+}
+
+static SymbolNodeMap SymbolNodeMapCreate() {
+	const size_t capacity = 64;
+	return (SymbolNodeMap) {
+		.keys = calloc(capacity, sizeof(SymbolNode*)),
+		.values = calloc(capacity, sizeof(SymbolNodeMapValue)),
+		.capacity = capacity,
+		.size = 0,
+	};
+}
+
+static void SymbolNodeMapFree(SymbolNodeMap* map) {
+	free(map->keys);
+	free(map->values);
+}
+
+static SymbolNodeMapValue* SymbolNodeMapFind(SymbolNodeMap* map, SymbolNode* key) {
+	for (size_t i = SymbolNodeMapHash(key) & (map->capacity - 1); map->keys[i] != NULL; i = (i + 1) & (map->capacity - 1)) {
+		if(map->keys[i] == key) {
+			return &map->values[i];
+		}
+	}
+	return NULL;
+}
+
+static void SymbolNodeMapInsert(SymbolNodeMap* map, SymbolNode* key, SymbolNodeMapValue value) {
+	if(2 * (map->size + 1) > map->capacity) {
+		SymbolNodeMap grown = {
+			.keys = calloc(map->capacity * 2, sizeof(SymbolNode*)),
+			.values = calloc(map->capacity * 2, sizeof(SymbolNodeMapValue)),
+			.capacity = map->capacity * 2,
+			.size = 0,
+		};
+		assert(grown.keys != NULL && grown.values != NULL, "No memory!");
+
+		for (size_t i = 0; i < map->capacity; ++i) {
+			if(map->keys[i] != NULL) {
+				SymbolNodeMapInsert(&grown, map->keys[i], map->values[i]);
+			}
+		}
+		SymbolNodeMapFree(map);
+		*map = grown;
+	}
+
+	size_t i = SymbolNodeMapHash(key) & (map->capacity - 1);
+	while (map->keys[i] != NULL && map->keys[i] != key) {
+		i = (i + 1) & (map->capacity - 1);
+	}
+	if(map->keys[i] == NULL) {
+		map->size++;
+	}
+	map->keys[i] = key;
+	map->values[i] = value;
+}
+
+static SymbolNode* SymbolNodeMapNode(SymbolNodeMap* map, SymbolNode* key) {
+	SymbolNodeMapValue* value = SymbolNodeMapFind(map, key);
+	assert(value != NULL, "Node was not visited!");
+	return value->node;
+}
+
+static unsigned int SymbolNodeMapIndex(SymbolNodeMap* map, SymbolNode* key) {
+	SymbolNodeMapValue* value = SymbolNodeMapFind(map, key);
+	assert(value != NULL, "Node was not visited!");
+	return value->index;
+}
+
+//-----------------------------------------------------------------------------
+// SymbolNodeStack
+//-----------------------------------------------------------------------------
+
+static void SymbolNodeStackPush(SymbolNodeStack* stack, SymbolNode* node, unsigned int state) {
+	if(stack->size == stack->capacity) {
+		stack->capacity = stack->capacity == 0 ? 64 : stack->capacity * 2;
+		stack->start = reallocarray(stack->start, stack->capacity, sizeof(SymbolNodeStackEntry));
+
+		assert(stack->start != NULL, "No memory!");
+	}
+
+	stack->start[stack->size++] = (SymbolNodeStackEntry) { .node = node, .state = state };
+}
+
+enum {
+	SYMBOL_NODE_ENTER,
+	SYMBOL_NODE_EXIT,
+};
+
+typedef void (*SymbolNodeVisit)(SymbolNode* node, void* context);
+
+// Calls visit on every node reachable from expression that is not in done, operands before the nodes using them and
+// left operands before right ones, in the same order as a recursive post order traversal
+// The factors of DOT are visited a term at a time, the left factor of a term before its right one
+// Nodes in done are not descended into, visit has to add its node to done
+// Only entries above the top of the stack are touched, so it is shared by nested and consecutive traversals
+static void SymbolNodeTraverse(SymbolNodeStack* stack, SymbolNode* expression, SymbolNodeMap* done, SymbolNodeVisit visit,
+                               void* context) {
+	const size_t base = stack->size;
+	SymbolNodeStackPush(stack, expression, SYMBOL_NODE_ENTER);
+
+	while (stack->size > base) {
+		const SymbolNodeStackEntry entry = stack->start[--stack->size];
+
+		if(entry.state == SYMBOL_NODE_EXIT) {
+			visit(entry.node, context);
+			continue;
+		}
+		if(SymbolNodeMapFind(done, entry.node) != NULL) {
+			continue;
+		}
+
+		SymbolNodeStackPush(stack, entry.node, SYMBOL_NODE_EXIT);
+		switch(entry.node->operation) {
+			case CONSTANT:
+			case VARIABLE:
+				break;
+			case ADD:
+			case SUSTRACT:
+			case MULTIPLY:
+				SymbolNodeStackPush(stack, entry.node->data.children.right, SYMBOL_NODE_ENTER);
+				SymbolNodeStackPush(stack, entry.node->data.children.left, SYMBOL_NODE_ENTER);
+				break;
+			case SQUARE:
+			case NEGATE:
+				SymbolNodeStackPush(stack, entry.node->data.children.left, SYMBOL_NODE_ENTER);
+				break;
+			case FMA:
+				SymbolNodeStackPush(stack, entry.node->data.children.addend, SYMBOL_NODE_ENTER);
+				SymbolNodeStackPush(stack, entry.node->data.children.right, SYMBOL_NODE_ENTER);
+				SymbolNodeStackPush(stack, entry.node->data.children.left, SYMBOL_NODE_ENTER);
+				break;
+			case DOT:
+				for (unsigned int i = entry.node->data.dot.count; i-- > 0;) {
+					SymbolNodeStackPush(stack, entry.node->data.dot.right[i], SYMBOL_NODE_ENTER);
+					SymbolNodeStackPush(stack, entry.node->data.dot.left[i], SYMBOL_NODE_ENTER);
+				}
+				break;
+			default:
+				assert(false, "Unhandled operation!");
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// SymbolNode
+//-----------------------------------------------------------------------------
+
 SymbolNodeArray* SymbolNodeArrayCreate() {
 	SymbolNodeArray* array = malloc(sizeof(SymbolNodeArray));
-	*array = (SymbolNodeArray) { .start = NULL, .capacity = 0, .size = 0};
+	*array = (SymbolNodeArray) {
+		.arena = ArenaCreate(64 * sizeof(SymbolNode)),
+		.start = NULL,
+		.capacity = 0,
+		.size = 0,
+		.internTable = NULL,
+		.internCapacity = 0,
+		.internSize = 0,
+		.variableCount = 0,
+		.stack = { .start = NULL, .capacity = 0, .size = 0 },
+	};
 	return array;
 }
 
 void SymbolNodeArrayFree(SymbolNodeArray* array) {
-	for (unsigned int i = 0; i < array->size; ++i) {
-		free(array->start[i]);
-	}
+	ArenaFree(array->arena);
 	free(array->start);
+	free(array->internTable);
+	free(array->stack.start);
 	free(array);
 }
 
 SymbolNode* NodeArrayAdd(SymbolNodeArray* array) {
 	if(array->size == array->capacity) {
-		array->capacity++;
+		array->capacity = array->capacity == 0 ? 64 : array->capacity * 2;
 		array->start = reallocarray(array->start, array->capacity, sizeof(SymbolNode*));
 
 		assert(array->start != NULL, "No memory");
 	}
 
-	SymbolNode* node = malloc(sizeof(SymbolNode));
+	SymbolNode* node = ArenaAllocate(array->arena, sizeof(SymbolNode), alignof(SymbolNode));
 	array->start[array->size] = node;
 	array->size++;
 	return node;
@@ -41,17 +237,121 @@ void SymbolNodeArrayPrint(SymbolNodeArray* array) {
 	}
 }
 
-SymbolNode* SymbolNodeConstant(SymbolNodeArray* array, float value) {
+static size_t SymbolNodeStructuralHash(const SymbolNode* node) {
+	uint64_t hash = (uint64_t) node->operation * 0x9e3779b97f4a7c15ULL;
+
+	switch(node->operation) {
+		case CONSTANT: {
+			uint32_t bits;
+			memcpy(&bits, &node->data.value, sizeof(bits));
+			hash ^= bits;
+			break;
+		}
+		case VARIABLE:
+			hash ^= node->data.variableId;
+			break;
+		case DOT:
+			for (unsigned int i = 0; i < 2 * node->data.dot.count; ++i) {
+				hash ^= (uint64_t) (uintptr_t) node->data.dot.left[i];
+				hash *= 0xff51afd7ed558ccdULL;
+			}
+			break;
+		default:
+			hash ^= (uint64_t) (uintptr_t) node->data.children.left;
+			hash *= 0xff51afd7ed558ccdULL;
+			hash ^= (uint64_t) (uintptr_t) node->data.children.right;
+			hash *= 0xff51afd7ed558ccdULL;
+			hash ^= (uint64_t) (uintptr_t) node->data.children.addend;
+			break;
+	}
+
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return (size_t) hash;
+}
+
+static bool SymbolNodeStructuralEqual(const SymbolNode* a, const SymbolNode* b) {
+	if(a->operation != b->operation) {
+		return false;
+	}
+
+	switch(a->operation) {
+		case CONSTANT:
+			// Compare bits so that 0.0 and -0.0 stay different nodes
+			return memcmp(&a->data.value, &b->data.value, sizeof(float)) == 0;
+		case VARIABLE:
+			return a->data.variableId == b->data.variableId;
+		case DOT:
+			// Right factors follow the left ones, so both are compared at once
+			return a->data.dot.count == b->data.dot.count
+			       && memcmp(a->data.dot.left, b->data.dot.left, 2 * a->data.dot.count * sizeof(SymbolNode*)) == 0;
+		default:
+			return a->data.children.left == b->data.children.left && a->data.children.right == b->data.children.right
+			       && a->data.children.addend == b->data.children.addend;
+	}
+}
+
+static void SymbolNodeInternInsert(SymbolNodeArray* array, SymbolNode* node) {
+	size_t i = SymbolNodeStructuralHash(node) & (array->internCapacity - 1);
+	while (array->internTable[i] != NULL) {
+		i = (i + 1) & (array->internCapacity - 1);
+	}
+	array->internTable[i] = node;
+	array->internSize++;
+}
+
+// Returns the existing node with the same structure as prototype, or a new node copied from it
+// The factors of a DOT prototype can be anywhere, a new node gets its own copy in the arena
+static SymbolNode* SymbolNodeIntern(SymbolNodeArray* array, SymbolNode prototype) {
+	if(array->internCapacity != 0) {
+		for (size_t i = SymbolNodeStructuralHash(&prototype) & (array->internCapacity - 1);
+		     array->internTable[i] != NULL;
+		     i = (i + 1) & (array->internCapacity - 1)) {
+			if(SymbolNodeStructuralEqual(array->internTable[i], &prototype)) {
+				return array->internTable[i];
+			}
+		}
+	}
+
+	if(2 * (array->internSize + 1) > array->internCapacity) {
+		SymbolNode** oldTable = array->internTable;
+		const size_t oldCapacity = array->internCapacity;
+
+		array->internCapacity = oldCapacity == 0 ? 64 : oldCapacity * 2;
+		array->internTable = calloc(array->internCapacity, sizeof(SymbolNode*));
+		array->internSize = 0;
+
+		assert(array->internTable != NULL, "No memory!");
+
+		for (size_t i = 0; i < oldCapacity; ++i) {
+			if(oldTable[i] != NULL) {
+				SymbolNodeInternInsert(array, oldTable[i]);
+			}
+		}
+		free(oldTable);
+	}
+
 	SymbolNode* node = NodeArrayAdd(array);
-	*node = (SymbolNode)  { .operation = CONSTANT, .data.value = value };
+	*node = prototype;
+	if(prototype.operation == DOT) {
+		const size_t size = 2 * prototype.data.dot.count * sizeof(SymbolNode*);
+		node->data.dot.left = ArenaAllocate(array->arena, size, alignof(SymbolNode*));
+		node->data.dot.right = node->data.dot.left + prototype.data.dot.count;
+		memcpy(node->data.dot.left, prototype.data.dot.left, size);
+	}
+	SymbolNodeInternInsert(array, node);
 	return node;
 }
 
+SymbolNode* SymbolNodeConstant(SymbolNodeArray* array, float value) {
+	return SymbolNodeIntern(array, (SymbolNode) { .operation = CONSTANT, .data.value = value });
+}
+
 SymbolNode *SymbolNodeVariable(SymbolNodeArray *array) {
-	static unsigned int variableId = 0;
 	SymbolNode* node = NodeArrayAdd(array);
-	*node = (SymbolNode)  { .operation = VARIABLE, .data.variableId = variableId};
-	variableId++;
+	*node = (SymbolNode)  { .operation = VARIABLE, .data.variableId = array->variableCount};
+	array->variableCount++;
 	return node;
 }
 
@@ -59,197 +359,944 @@ SymbolNode* SymbolNodeBinary(SymbolNodeArray* array, Operation operation, Symbol
 	assert(left != NULL, "Operand is NULL!");
 	assert(right != NULL, "Operand is NULL!");
 
-	SymbolNode* node = NodeArrayAdd(array);
-	*node = (SymbolNode)  { .operation = operation, .data.children.left = left, .data.children.right = right };
+	return SymbolNodeIntern(array, (SymbolNode) {
+		.operation = operation,
+		.data.children.left = left,
+		.data.children.right = right
+	});
+}
+
+SymbolNode* SymbolNodeUnary(SymbolNodeArray* array, Operation operation, SymbolNode* operand) {
+	assert(operand != NULL, "Operand is NULL!");
+	assert(operation == SQUARE || operation == NEGATE, "Operation is not unary!");
+
+	return SymbolNodeIntern(array, (SymbolNode) {
+		.operation = operation,
+		.data.children.left = operand,
+		.data.children.right = NULL
+	});
+}
+
+SymbolNode* SymbolNodeFma(SymbolNodeArray* array, SymbolNode* left, SymbolNode* right, SymbolNode* addend) {
+	assert(left != NULL && right != NULL && addend != NULL, "Operand is NULL!");
+
+	return SymbolNodeIntern(array, (SymbolNode) {
+		.operation = FMA,
+		.data.children.left = left,
+		.data.children.right = right,
+		.data.children.addend = addend
+	});
+}
+
+SymbolNode* SymbolNodeDot(SymbolNodeArray* array, SymbolNode** left, SymbolNode** right, unsigned int count) {
+	assert(count > 0, "Dot product has no terms!");
+
+	// Interning compares the factors as one array, so the prototype gets them next to each other too
+	SymbolNode** factors = malloc(2 * count * sizeof(SymbolNode*));
+	assert(factors != NULL, "No memory!");
+	for (unsigned int i = 0; i < count; ++i) {
+		assert(left[i] != NULL && right[i] != NULL, "Operand is NULL!");
+		factors[i] = left[i];
+		factors[count + i] = right[i];
+	}
+
+	SymbolNode* node = SymbolNodeIntern(array, (SymbolNode) {
+		.operation = DOT,
+		.data.dot.left = factors,
+		.data.dot.right = factors + count,
+		.data.dot.count = count
+	});
+
+	free(factors);
 	return node;
 }
 
-SymbolNode* SymbolNodeDifferentiate(SymbolNode* expression, SymbolNodeArray* array, SymbolNode* variable) {
-	assert(variable->operation == VARIABLE, "Tried to differentiate against expression that is not a variable!");
+static void SymbolNodeMarkVisit(SymbolNode* node, void* context) {
+	SymbolNodeMapInsert(context, node, (SymbolNodeMapValue) { .node = node });
+}
+
+void SymbolNodeArrayCollect(SymbolNodeArray* array, SymbolNode** roots, size_t rootCount) {
+	// Marked nodes map to themselves until they are moved, then to their copy
+	SymbolNodeMap moved = SymbolNodeMapCreate();
+	for (size_t i = 0; i < rootCount; ++i) {
+		if(roots[i] != NULL) {
+			SymbolNodeTraverse(&array->stack, roots[i], &moved, SymbolNodeMarkVisit, &moved);
+		}
+	}
+
+	// Operands are always created before the nodes using them, so in creation order they are moved first
+	Arena* arena = ArenaCreate((moved.size > 64 ? moved.size : 64) * sizeof(SymbolNode));
+	const size_t size = array->size;
+	array->size = 0;
+	for (size_t i = 0; i < size; ++i) {
+		SymbolNode* node = array->start[i];
+		SymbolNodeMapValue* value = SymbolNodeMapFind(&moved, node);
+		if(value == NULL) {
+			continue;
+		}
+
+		SymbolNode* copy = ArenaAllocate(arena, sizeof(SymbolNode), alignof(SymbolNode));
+		*copy = *node;
+		if(node->operation == DOT) {
+			const unsigned int count = node->data.dot.count;
+			copy->data.dot.left = ArenaAllocate(arena, 2 * count * sizeof(SymbolNode*), alignof(SymbolNode*));
+			copy->data.dot.right = copy->data.dot.left + count;
+			for (unsigned int j = 0; j < 2 * count; ++j) {
+				copy->data.dot.left[j] = SymbolNodeMapNode(&moved, node->data.dot.left[j]);
+			}
+		} else if(node->operation != CONSTANT && node->operation != VARIABLE) {
+			copy->data.children.left = SymbolNodeMapNode(&moved, node->data.children.left);
+			if(node->data.children.right != NULL) {
+				copy->data.children.right = SymbolNodeMapNode(&moved, node->data.children.right);
+			}
+			if(node->data.children.addend != NULL) {
+				copy->data.children.addend = SymbolNodeMapNode(&moved, node->data.children.addend);
+			}
+		}
+
+		value->node = copy;
+		array->start[array->size++] = copy;
+	}
+
+	// Children moved, so does the structural hash of their parents, the table is rebuilt from scratch
+	free(array->internTable);
+	array->internCapacity = 64;
+	while (2 * (array->size + 1) > array->internCapacity) {
+		array->internCapacity *= 2;
+	}
+	array->internTable = calloc(array->internCapacity, sizeof(SymbolNode*));
+	array->internSize = 0;
+	assert(array->internTable != NULL, "No memory!");
 
+	for (size_t i = 0; i < array->size; ++i) {
+		if(array->start[i]->operation != VARIABLE) {
+			SymbolNodeInternInsert(array, array->start[i]);
+		}
+	}
+
+	for (size_t i = 0; i < rootCount; ++i) {
+		if(roots[i] != NULL) {
+			roots[i] = SymbolNodeMapNode(&moved, roots[i]);
+		}
+	}
+
+	TraceLog(LOG_DEBUG, "Symbol nodes collected, %zu of %zu kept", array->size, size);
+
+	SymbolNodeMapFree(&moved);
+	ArenaFree(array->arena);
+	array->arena = arena;
+}
+
+SymbolMemoryStatistics SymbolNodeArrayStatistics(SymbolNodeArray* array) {
+	return (SymbolMemoryStatistics) {
+		.nodeCount = array->size,
+		.matrixCount = 0,
+		.usedBytes = ArenaSize(array->arena),
+		.reservedBytes = ArenaCapacity(array->arena) + (array->capacity + array->internCapacity) * sizeof(SymbolNode*)
+		                 + array->stack.capacity * sizeof(SymbolNodeStackEntry),
+	};
+}
+
+typedef struct SymbolNodeDifferentiateContext {
+	SymbolNodeArray* array;
+	SymbolNode* variable;
+	SymbolNodeMap* derivatives;
+} SymbolNodeDifferentiateContext;
+
+static void SymbolNodeDifferentiateVisit(SymbolNode* expression, void* context) {
+	SymbolNodeDifferentiateContext* differentiate = context;
+	SymbolNodeArray* array = differentiate->array;
+	SymbolNodeMap* derivatives = differentiate->derivatives;
+
+	SymbolNode* result;
 	switch(expression->operation) {
 		case CONSTANT: {
-			return SymbolNodeConstant(array, 0.0f);
+			result = SymbolNodeConstant(array, 0.0f);
+			break;
 		}
 		case VARIABLE: {
-			if(expression->data.variableId == variable->data.variableId) {
-				return SymbolNodeConstant(array, 1.0f);
+			if(expression->data.variableId == differentiate->variable->data.variableId) {
+				result = SymbolNodeConstant(array, 1.0f);
 			} else {
-				return SymbolNodeConstant(array, 0.0f);
+				result = SymbolNodeConstant(array, 0.0f);
 			}
+			break;
 		}
 		case ADD: {
-			return SymbolNodeBinary(
+			result = SymbolNodeBinary(
 				array,
 				ADD,
-				SymbolNodeDifferentiate(expression->data.children.left, array, variable),
-				SymbolNodeDifferentiate(expression->data.children.right, array, variable)
+				SymbolNodeMapNode(derivatives, expression->data.children.left),
+				SymbolNodeMapNode(derivatives, expression->data.children.right)
 			);
+			break;
 		}
 		case SUSTRACT: {
-			return SymbolNodeBinary(
+			result = SymbolNodeBinary(
 				array,
 				SUSTRACT,
-				SymbolNodeDifferentiate(expression->data.children.left, array, variable),
-				SymbolNodeDifferentiate(expression->data.children.right, array, variable)
+				SymbolNodeMapNode(derivatives, expression->data.children.left),
+				SymbolNodeMapNode(derivatives, expression->data.children.right)
 			);
+			break;
 		}
 		case MULTIPLY: {
-			return SymbolNodeBinary(
+			result = SymbolNodeBinary(
 				array,
 				ADD,
 				SymbolNodeBinary(
 					array, MULTIPLY,
 					expression->data.children.left,
-					SymbolNodeDifferentiate(expression->data.children.right, array, variable)
+					SymbolNodeMapNode(derivatives, expression->data.children.right)
 				),
 				SymbolNodeBinary(
 					array, MULTIPLY,
-					SymbolNodeDifferentiate(expression->data.children.left, array, variable),
+					SymbolNodeMapNode(derivatives, expression->data.children.left),
 					expression->data.children.right
 				)
 			);
+			break;
+		}
+		case SQUARE: {
+			result = SymbolNodeBinary(
+				array,
+				MULTIPLY,
+				SymbolNodeBinary(array, MULTIPLY, SymbolNodeConstant(array, 2.0f), expression->data.children.left),
+				SymbolNodeMapNode(derivatives, expression->data.children.left)
+			);
+			break;
+		}
+		case NEGATE: {
+			result = SymbolNodeUnary(
+				array,
+				NEGATE,
+				SymbolNodeMapNode(derivatives, expression->data.children.left)
+			);
+			break;
+		}
+		case FMA: {
+			// left * right' + (left' * right + addend')
+			result = SymbolNodeFma(
+				array,
+				expression->data.children.left,
+				SymbolNodeMapNode(derivatives, expression->data.children.right),
+				SymbolNodeFma(
+					array,
+					SymbolNodeMapNode(derivatives, expression->data.children.left),
+					expression->data.children.right,
+					SymbolNodeMapNode(derivatives, expression->data.children.addend)
+				)
+			);
+			break;
+		}
+		case DOT: {
+			// Sum of left[i] * right[i]' and left[i]' * right[i], a dot product of twice the terms
+			const unsigned int count = expression->data.dot.count;
+			SymbolNode** left = malloc(4 * count * sizeof(SymbolNode*));
+			assert(left != NULL, "No memory!");
+			SymbolNode** right = left + 2 * count;
+			for (unsigned int i = 0; i < count; ++i) {
+				left[i] = expression->data.dot.left[i];
+				right[i] = SymbolNodeMapNode(derivatives, expression->data.dot.right[i]);
+				left[count + i] = SymbolNodeMapNode(derivatives, expression->data.dot.left[i]);
+				right[count + i] = expression->data.dot.right[i];
+			}
+			result = SymbolNodeDot(array, left, right, 2 * count);
+			free(left);
+			break;
 		}
 		default:
 			assert(false, "Unhandled operation!");
+			__builtin_unreachable();
 	}
+
+	SymbolNodeMapInsert(derivatives, expression, (SymbolNodeMapValue) { .node = result });
 }
 
-SymbolNode* SymbolNodeEvaluate(SymbolNode* expression, SymbolNodeArray* array, SymbolNode *variable, float value) {
+// Derivatives of the nodes already visited for this variable, so a node shared by several parents is differentiated once
+static SymbolNode* SymbolNodeDifferentiateInternal(SymbolNode* expression, SymbolNodeArray* array, SymbolNode* variable,
+                                                   SymbolNodeMap* derivatives) {
+	SymbolNodeDifferentiateContext context = { .array = array, .variable = variable, .derivatives = derivatives };
+	SymbolNodeTraverse(&array->stack, expression, derivatives, SymbolNodeDifferentiateVisit, &context);
+	return SymbolNodeMapNode(derivatives, expression);
+}
+
+SymbolNode* SymbolNodeDifferentiate(SymbolNode* expression, SymbolNodeArray* array, SymbolNode* variable) {
+	assert(variable->operation == VARIABLE, "Tried to differentiate against expression that is not a variable!");
+
+	SymbolNodeMap derivatives = SymbolNodeMapCreate();
+	SymbolNode* result = SymbolNodeDifferentiateInternal(expression, array, variable, &derivatives);
+	SymbolNodeMapFree(&derivatives);
+	return result;
+}
+
+typedef struct SymbolNodeEvaluateContext {
+	SymbolNodeArray* array;
+	SymbolNode* variable;
+	float value;
+	SymbolNodeMap* evaluated;
+} SymbolNodeEvaluateContext;
+
+static void SymbolNodeEvaluateVisit(SymbolNode* expression, void* context) {
+	SymbolNodeEvaluateContext* evaluate = context;
+	SymbolNodeArray* array = evaluate->array;
+	SymbolNodeMap* evaluated = evaluate->evaluated;
+
+	SymbolNode* result;
 	switch(expression->operation) {
 		case CONSTANT:
-			return expression;
+			result = expression;
+			break;
 		case VARIABLE:
-			if(expression->data.variableId == variable->data.variableId) {
-				return SymbolNodeConstant(array, value);
+			if(expression->data.variableId == evaluate->variable->data.variableId) {
+				result = SymbolNodeConstant(array, evaluate->value);
 			} else {
-				return expression;
+				result = expression;
 			}
+			break;
 		case ADD:
 		case SUSTRACT:
 		case MULTIPLY: {
-			SymbolNode *left = SymbolNodeEvaluate(expression->data.children.left, array, variable, value);
-			SymbolNode *right = SymbolNodeEvaluate(expression->data.children.right, array, variable, value);
+			SymbolNode *left = SymbolNodeMapNode(evaluated, expression->data.children.left);
+			SymbolNode *right = SymbolNodeMapNode(evaluated, expression->data.children.right);
 			if(left->operation == CONSTANT && right->operation == CONSTANT) {
 				switch(expression->operation) {
 					case ADD:
-						return SymbolNodeConstant(array, left->data.value + right->data.value);
+						result = SymbolNodeConstant(array, left->data.value + right->data.value);
+						break;
 					case SUSTRACT:
-						return SymbolNodeConstant(array, left->data.value - right->data.value);
+						result = SymbolNodeConstant(array, left->data.value - right->data.value);
+						break;
 					case MULTIPLY:
-						return SymbolNodeConstant(array, left->data.value * right->data.value);
+						result = SymbolNodeConstant(array, left->data.value * right->data.value);
+						break;
 					default:
 						__builtin_unreachable(); // This should be impossible
 				}
+			} else {
+				result = SymbolNodeBinary(array, expression->operation, left, right);
 			}
-
-			return SymbolNodeBinary(array, expression->operation, left, right);
-		}
-		default: {
-			assert(false, "Unhandled operation!");
+			break;
 		}
-	}
-}
-
-static void SymbolNodePrintInternal(SymbolNode* expression, char **end) {
-	switch(expression->operation) {
-		case CONSTANT:
-			sprintf(*end, "%f", expression->data.value); *end += strlen(*end);
+		case SQUARE:
+		case NEGATE: {
+			SymbolNode *operand = SymbolNodeMapNode(evaluated, expression->data.children.left);
+			if(operand->operation == CONSTANT) {
+				const float x = operand->data.value;
+				result = SymbolNodeConstant(array, expression->operation == SQUARE ? x * x : -x);
+			} else {
+				result = SymbolNodeUnary(array, expression->operation, operand);
+			}
 			break;
-		case VARIABLE:
-			sprintf(*end, "x_%u", expression->data.variableId); *end += strlen(*end);
+		}
+		case FMA: {
+			SymbolNode *left = SymbolNodeMapNode(evaluated, expression->data.children.left);
+			SymbolNode *right = SymbolNodeMapNode(evaluated, expression->data.children.right);
+			SymbolNode *addend = SymbolNodeMapNode(evaluated, expression->data.children.addend);
+			if(left->operation == CONSTANT && right->operation == CONSTANT && addend->operation == CONSTANT) {
+				result = SymbolNodeConstant(array, fmaf(left->data.value, right->data.value, addend->data.value));
+			} else {
+				result = SymbolNodeFma(array, left, right, addend);
+			}
 			break;
-		case ADD:
-		case SUSTRACT:
-		case MULTIPLY: {
-			SymbolNodePrintInternal(expression->data.children.left, end);
-			switch (expression->operation) {
-				case ADD:
-					sprintf(*end, "+"); *end += strlen(*end);
-					break;
-				case SUSTRACT:
-					sprintf(*end, "-"); *end += strlen(*end);
-					break;
-				case MULTIPLY:
-					sprintf(*end, "*"); *end += strlen(*end);
-					break;
-				default:
-					__builtin_unreachable(); // This should be impossible
+		}
+		case DOT: {
+			// Folded in the order the tape evaluates it, a product and then one fused multiply add per term
+			const unsigned int count = expression->data.dot.count;
+			SymbolNode** factors = malloc(2 * count * sizeof(SymbolNode*));
+			assert(factors != NULL, "No memory!");
+			bool constant = true;
+			for (unsigned int i = 0; i < 2 * count; ++i) {
+				factors[i] = SymbolNodeMapNode(evaluated, expression->data.dot.left[i]);
+				constant = constant && factors[i]->operation == CONSTANT;
+			}
+
+			if(constant) {
+				float sum = factors[0]->data.value * factors[count]->data.value;
+				for (unsigned int i = 1; i < count; ++i) {
+					sum = fmaf(factors[i]->data.value, factors[count + i]->data.value, sum);
+				}
+				result = SymbolNodeConstant(array, sum);
+			} else {
+				result = SymbolNodeDot(array, factors, factors + count, count);
 			}
-			SymbolNodePrintInternal(expression->data.children.right, end);
+			free(factors);
 			break;
 		}
 		default:
 			assert(false, "Unhandled operation!");
+			__builtin_unreachable();
 	}
-}
-
-void SymbolNodePrint(SymbolNode* expression) {
-	char buffer[MAX_TRACELOG_MSG_LENGTH] = { 0 };
-	char* end = buffer;
 
-	SymbolNodePrintInternal(expression, &end);
-	TraceLog(LOG_DEBUG, buffer);
+	SymbolNodeMapInsert(evaluated, expression, (SymbolNodeMapValue) { .node = result });
 }
 
-//-----------------------------------------------------------------------------
-// SymbolMatrix
-//-----------------------------------------------------------------------------
-
-SymbolMatrixArray* SymbolMatrixArrayCreate() {
-	SymbolMatrixArray* array = malloc(sizeof(SymbolMatrixArray));
-	*array = (SymbolMatrixArray) { .start = NULL, .nodeArray = SymbolNodeArrayCreate(), .capacity = 0, .size = 0};
-	return array;
+SymbolNode* SymbolNodeEvaluate(SymbolNode* expression, SymbolNodeArray* array, SymbolNode *variable, float value) {
+	SymbolNodeMap evaluated = SymbolNodeMapCreate();
+	SymbolNodeEvaluateContext context = { .array = array, .variable = variable, .value = value, .evaluated = &evaluated };
+	SymbolNodeTraverse(&array->stack, expression, &evaluated, SymbolNodeEvaluateVisit, &context);
+	SymbolNode* result = SymbolNodeMapNode(&evaluated, expression);
+	SymbolNodeMapFree(&evaluated);
+	return result;
 }
 
-void SymbolMatrixArrayFree(SymbolMatrixArray* array) {
-	SymbolNodeArrayFree(array->nodeArray);
-
-	for (unsigned int i = 0; i < array->size; ++i) {
-		SymbolMatrixFree(array->start[i]);
-		free(array->start[i]);
-	}
-
-	free(array->start);
-	free(array);
+static bool SymbolNodeIsConstant(SymbolNode* expression, float value) {
+	return expression->operation == CONSTANT && expression->data.value == value;
 }
 
-SymbolMatrix* SymbolMatrixArrayAdd(SymbolMatrixArray* array) {
-	if(array->size == array->capacity) {
-		array->capacity++;
-		array->start = reallocarray(array->start, array->capacity, sizeof(SymbolNode*));
+static SymbolNode* SymbolNodeSimplifyBinary(SymbolNodeArray* array, Operation operation, SymbolNode* left,
+                                            SymbolNode* right);
 
-		assert(array->start != NULL, "No memory!");
+// Builds operation(operand) for an already simplified operand
+static SymbolNode* SymbolNodeSimplifyUnary(SymbolNodeArray* array, Operation operation, SymbolNode* operand) {
+	if(operand->operation == CONSTANT) {
+		const float value = operand->data.value;
+		return SymbolNodeConstant(array, operation == SQUARE ? value * value : -value);
 	}
 
+	switch(operation) {
+		case SQUARE: {
+			// (-x)^2 = x^2
+			if(operand->operation == NEGATE) {
+				return SymbolNodeSimplifyUnary(array, SQUARE, operand->data.children.left);
+			}
+			break;
+		}
+		case NEGATE: {
+			if(operand->operation == NEGATE) {
+				return operand->data.children.left;
+			}
+			if(operand->operation == SUSTRACT) {
+				return SymbolNodeSimplifyBinary(array, SUSTRACT, operand->data.children.right, operand->data.children.left);
+			}
+			if(operand->operation == MULTIPLY && operand->data.children.left->operation == CONSTANT) {
+				SymbolNode* constant = SymbolNodeConstant(array, -operand->data.children.left->data.value);
+				return SymbolNodeSimplifyBinary(array, MULTIPLY, constant, operand->data.children.right);
+			}
+			break;
+		}
+		default:
+			assert(false, "Unhandled operation!");
+	}
 
-	SymbolMatrix* matrix = malloc(sizeof(SymbolMatrix));
-	array->start[array->size] = matrix;
-	array->size++;
-	return matrix;
+	return SymbolNodeUnary(array, operation, operand);
 }
 
-void SymbolMatrixArrayPrint(SymbolMatrixArray* array) {
-	for (unsigned int i = 0; i < array->size; ++i) {
-		printf("%u:\n", i);
-		SymbolMatrixPrint(array->start[i]);
+// Builds operation(left, right) for already simplified operands
+// Constants are kept on the left of ADD and MULTIPLY so that chains like c1 * (c2 * x) fold into (c1 * c2) * x
+static SymbolNode* SymbolNodeSimplifyBinary(SymbolNodeArray* array, Operation operation, SymbolNode* left,
+                                            SymbolNode* right) {
+	if(left->operation == CONSTANT && right->operation == CONSTANT) {
+		switch(operation) {
+			case ADD:
+				return SymbolNodeConstant(array, left->data.value + right->data.value);
+			case SUSTRACT:
+				return SymbolNodeConstant(array, left->data.value - right->data.value);
+			case MULTIPLY:
+				return SymbolNodeConstant(array, left->data.value * right->data.value);
+			default:
+				__builtin_unreachable(); // This should be impossible
+		}
 	}
-}
 
-SymbolMatrix *SymbolMatrixCreate(SymbolMatrixArray *array, unsigned int rows, unsigned int cols) {
+	switch(operation) {
+		case ADD: {
+			if(SymbolNodeIsConstant(left, 0.0f)) {
+				return right;
+			}
+			if(SymbolNodeIsConstant(right, 0.0f)) {
+				return left;
+			}
+			if(right->operation == CONSTANT) {
+				return SymbolNodeSimplifyBinary(array, ADD, right, left);
+			}
+			if(left->operation == CONSTANT && right->operation == ADD
+			   && right->data.children.left->operation == CONSTANT) {
+				SymbolNode* constant = SymbolNodeConstant(array, left->data.value + right->data.children.left->data.value);
+				return SymbolNodeSimplifyBinary(array, ADD, constant, right->data.children.right);
+			}
+			if(right->operation == NEGATE) {
+				return SymbolNodeSimplifyBinary(array, SUSTRACT, left, right->data.children.left);
+			}
+			if(left->operation == NEGATE) {
+				return SymbolNodeSimplifyBinary(array, SUSTRACT, right, left->data.children.left);
+			}
+			break;
+		}
+		case SUSTRACT: {
+			if(SymbolNodeIsConstant(right, 0.0f)) {
+				return left;
+			}
+			if(SymbolNodeIsConstant(left, 0.0f)) {
+				return SymbolNodeSimplifyUnary(array, NEGATE, right);
+			}
+			if(left == right) {
+				return SymbolNodeConstant(array, 0.0f);
+			}
+			if(right->operation == CONSTANT) {
+				return SymbolNodeSimplifyBinary(array, ADD, SymbolNodeConstant(array, -right->data.value), left);
+			}
+			if(right->operation == NEGATE) {
+				return SymbolNodeSimplifyBinary(array, ADD, left, right->data.children.left);
+			}
+			break;
+		}
+		case MULTIPLY: {
+			if(SymbolNodeIsConstant(left, 0.0f) || SymbolNodeIsConstant(right, 0.0f)) {
+				return SymbolNodeConstant(array, 0.0f);
+			}
+			if(SymbolNodeIsConstant(left, 1.0f)) {
+				return right;
+			}
+			if(SymbolNodeIsConstant(right, 1.0f)) {
+				return left;
+			}
+			if(SymbolNodeIsConstant(left, -1.0f)) {
+				return SymbolNodeSimplifyUnary(array, NEGATE, right);
+			}
+			if(right->operation == CONSTANT) {
+				return SymbolNodeSimplifyBinary(array, MULTIPLY, right, left);
+			}
+			if(left == right) {
+				return SymbolNodeSimplifyUnary(array, SQUARE, left);
+			}
+			if(left->operation == CONSTANT && right->operation == MULTIPLY
+			   && right->data.children.left->operation == CONSTANT) {
+				SymbolNode* constant = SymbolNodeConstant(array, left->data.value * right->data.children.left->data.value);
+				return SymbolNodeSimplifyBinary(array, MULTIPLY, constant, right->data.children.right);
+			}
+			break;
+		}
+		default:
+			assert(false, "Unhandled operation!");
+	}
+
+	return SymbolNodeBinary(array, operation, left, right);
+}
+
+// Builds left * right + addend for already simplified operands
+// Constants are kept on the left, like in products
+static SymbolNode* SymbolNodeSimplifyFma(SymbolNodeArray* array, SymbolNode* left, SymbolNode* right,
+                                         SymbolNode* addend) {
+	if(left->operation == CONSTANT && right->operation == CONSTANT) {
+		if(addend->operation == CONSTANT) {
+			return SymbolNodeConstant(array, fmaf(left->data.value, right->data.value, addend->data.value));
+		}
+		return SymbolNodeSimplifyBinary(array, ADD, SymbolNodeConstant(array, left->data.value * right->data.value),
+		                                addend);
+	}
+	if(SymbolNodeIsConstant(addend, 0.0f)) {
+		return SymbolNodeSimplifyBinary(array, MULTIPLY, left, right);
+	}
+	if(SymbolNodeIsConstant(left, 0.0f) || SymbolNodeIsConstant(right, 0.0f)) {
+		return addend;
+	}
+	if(right->operation == CONSTANT) {
+		return SymbolNodeSimplifyFma(array, right, left, addend);
+	}
+	if(SymbolNodeIsConstant(left, 1.0f)) {
+		return SymbolNodeSimplifyBinary(array, ADD, right, addend);
+	}
+	if(SymbolNodeIsConstant(left, -1.0f)) {
+		return SymbolNodeSimplifyBinary(array, SUSTRACT, addend, right);
+	}
+
+	return SymbolNodeFma(array, left, right, addend);
+}
+
+// Builds the sum of left[i] * right[i] for already simplified factors
+// Terms with a zero factor are dropped and constant terms are folded into a constant added to the rest, a single term
+// left is a product or a multiply add
+static SymbolNode* SymbolNodeSimplifyDot(SymbolNodeArray* array, SymbolNode** left, SymbolNode** right,
+                                         unsigned int count) {
+	SymbolNode** kept = malloc(2 * count * sizeof(SymbolNode*));
+	assert(kept != NULL, "No memory!");
+
+	float constant = 0.0f;
+	unsigned int size = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		if(SymbolNodeIsConstant(left[i], 0.0f) || SymbolNodeIsConstant(right[i], 0.0f)) {
+			continue;
+		}
+		if(left[i]->operation == CONSTANT && right[i]->operation == CONSTANT) {
+			constant = fmaf(left[i]->data.value, right[i]->data.value, constant);
+			continue;
+		}
+
+		// Constants are kept on the left, so sums have every left factor 1
+		const bool swap = right[i]->operation == CONSTANT;
+		kept[size] = swap ? right[i] : left[i];
+		kept[count + size] = swap ? left[i] : right[i];
+		size++;
+	}
+
+	SymbolNode* result;
+	if(size == 0) {
+		result = SymbolNodeConstant(array, constant);
+	} else if(size == 1) {
+		result = SymbolNodeSimplifyFma(array, kept[0], kept[count], SymbolNodeConstant(array, constant));
+	} else {
+		result = SymbolNodeSimplifyBinary(array, ADD, SymbolNodeConstant(array, constant),
+		                                  SymbolNodeDot(array, kept, kept + count, size));
+	}
+
+	free(kept);
+	return result;
+}
+
+typedef struct SymbolNodeSimplifyContext {
+	SymbolNodeArray* array;
+	SymbolNodeMap* simplified;
+} SymbolNodeSimplifyContext;
+
+static void SymbolNodeSimplifyVisit(SymbolNode* expression, void* context) {
+	SymbolNodeSimplifyContext* simplify = context;
+	SymbolNodeArray* array = simplify->array;
+	SymbolNodeMap* simplified = simplify->simplified;
+
+	SymbolNode* result;
+	switch(expression->operation) {
+		case CONSTANT:
+		case VARIABLE:
+			result = expression;
+			break;
+		case ADD:
+		case SUSTRACT:
+		case MULTIPLY: {
+			SymbolNode* left = SymbolNodeMapNode(simplified, expression->data.children.left);
+			SymbolNode* right = SymbolNodeMapNode(simplified, expression->data.children.right);
+			result = SymbolNodeSimplifyBinary(array, expression->operation, left, right);
+			break;
+		}
+		case SQUARE:
+		case NEGATE: {
+			SymbolNode* operand = SymbolNodeMapNode(simplified, expression->data.children.left);
+			result = SymbolNodeSimplifyUnary(array, expression->operation, operand);
+			break;
+		}
+		case FMA: {
+			SymbolNode* left = SymbolNodeMapNode(simplified, expression->data.children.left);
+			SymbolNode* right = SymbolNodeMapNode(simplified, expression->data.children.right);
+			SymbolNode* addend = SymbolNodeMapNode(simplified, expression->data.children.addend);
+			result = SymbolNodeSimplifyFma(array, left, right, addend);
+			break;
+		}
+		case DOT: {
+			const unsigned int count = expression->data.dot.count;
+			SymbolNode** factors = malloc(2 * count * sizeof(SymbolNode*));
+			assert(factors != NULL, "No memory!");
+			for (unsigned int i = 0; i < 2 * count; ++i) {
+				factors[i] = SymbolNodeMapNode(simplified, expression->data.dot.left[i]);
+			}
+			result = SymbolNodeSimplifyDot(array, factors, factors + count, count);
+			free(factors);
+			break;
+		}
+		default:
+			assert(false, "Unhandled operation!");
+			__builtin_unreachable();
+	}
+
+	SymbolNodeMapInsert(simplified, expression, (SymbolNodeMapValue) { .node = result });
+}
+
+static SymbolNode* SymbolNodeSimplifyInternal(SymbolNode* expression, SymbolNodeArray* array, SymbolNodeMap* simplified) {
+	SymbolNodeSimplifyContext context = { .array = array, .simplified = simplified };
+	SymbolNodeTraverse(&array->stack, expression, simplified, SymbolNodeSimplifyVisit, &context);
+	return SymbolNodeMapNode(simplified, expression);
+}
+
+SymbolNode* SymbolNodeSimplify(SymbolNode* expression, SymbolNodeArray* array) {
+	SymbolNodeMap simplified = SymbolNodeMapCreate();
+	SymbolNode* result = SymbolNodeSimplifyInternal(expression, array, &simplified);
+	SymbolNodeMapFree(&simplified);
+	return result;
+}
+
+typedef struct SymbolNodeCountContext {
+	SymbolNodeMap* visited;
+	unsigned int count;
+} SymbolNodeCountContext;
+
+static void SymbolNodeCountVisit(SymbolNode* expression, void* context) {
+	SymbolNodeCountContext* count = context;
+	SymbolNodeMapInsert(count->visited, expression, (SymbolNodeMapValue) { .index = 0 });
+	count->count++;
+}
+
+// Nodes reachable from expression that are not in visited yet, which they are added to
+static unsigned int SymbolNodeCountInternal(SymbolNode* expression, SymbolNodeStack* stack, SymbolNodeMap* visited) {
+	SymbolNodeCountContext context = { .visited = visited, .count = 0 };
+	SymbolNodeTraverse(stack, expression, visited, SymbolNodeCountVisit, &context);
+	return context.count;
+}
+
+unsigned int SymbolNodeCount(SymbolNode* expression) {
+	SymbolNodeStack stack = { 0 };
+	SymbolNodeMap visited = SymbolNodeMapCreate();
+	const unsigned int count = SymbolNodeCountInternal(expression, &stack, &visited);
+	SymbolNodeMapFree(&visited);
+	free(stack.start);
+	return count;
+}
+
+// Bounded text output, once full everything else is dropped and the text ends with "..."
+typedef struct SymbolNodePrinter {
+	char* buffer;
+	size_t capacity;
+	size_t size;
+	bool full;
+} SymbolNodePrinter;
+
+// Room for "..." is always kept, so the text can be cut at any point
+static void SymbolNodePrinterAppend(SymbolNodePrinter* printer, const char* text) {
+	static const char ellipsis[] = "...";
+	assert(printer->capacity >= sizeof(ellipsis), "Print buffer is too small!");
+
+	if(printer->full) {
+		return;
+	}
+
+	const size_t length = strlen(text);
+	const size_t available = printer->capacity - sizeof(ellipsis) - printer->size;
+	if(length <= available) {
+		memcpy(printer->buffer + printer->size, text, length + 1);
+		printer->size += length;
+		return;
+	}
+
+	memcpy(printer->buffer + printer->size, text, available);
+	memcpy(printer->buffer + printer->size + available, ellipsis, sizeof(ellipsis));
+	printer->size += available + sizeof(ellipsis) - 1;
+	printer->full = true;
+}
+
+enum {
+	SYMBOL_NODE_PRINT_EXPRESSION,
+	SYMBOL_NODE_PRINT_OPERATOR,
+	SYMBOL_NODE_PRINT_CLOSE,
+	// Operators inside FMA and DOT, which have more than one
+	SYMBOL_NODE_PRINT_TIMES,
+	SYMBOL_NODE_PRINT_PLUS,
+};
+
+// Expressions are expanded from a stack of pending pieces, a node, the operator between its operands or the text
+// after them, so deep expressions print without recursion and stop as soon as the output is full
+static void SymbolNodePrintInternal(SymbolNode* expression, SymbolNodeStack* stack, SymbolNodePrinter* printer) {
+	const size_t base = stack->size;
+	SymbolNodeStackPush(stack, expression, SYMBOL_NODE_PRINT_EXPRESSION);
+
+	while (stack->size > base && !printer->full) {
+		const SymbolNodeStackEntry entry = stack->start[--stack->size];
+		SymbolNode* node = entry.node;
+		char text[64];
+
+		if(entry.state == SYMBOL_NODE_PRINT_OPERATOR) {
+			switch (node->operation) {
+				case ADD:
+					SymbolNodePrinterAppend(printer, "+");
+					break;
+				case SUSTRACT:
+					SymbolNodePrinterAppend(printer, "-");
+					break;
+				case MULTIPLY:
+					SymbolNodePrinterAppend(printer, "*");
+					break;
+				default:
+					__builtin_unreachable(); // This should be impossible
+			}
+			continue;
+		}
+		if(entry.state == SYMBOL_NODE_PRINT_CLOSE) {
+			SymbolNodePrinterAppend(printer, node->operation == SQUARE ? ")^2" : ")");
+			continue;
+		}
+		if(entry.state == SYMBOL_NODE_PRINT_TIMES || entry.state == SYMBOL_NODE_PRINT_PLUS) {
+			SymbolNodePrinterAppend(printer, entry.state == SYMBOL_NODE_PRINT_TIMES ? "*" : "+");
+			continue;
+		}
+
+		switch(node->operation) {
+			case CONSTANT:
+				snprintf(text, sizeof(text), "%f", node->data.value);
+				SymbolNodePrinterAppend(printer, text);
+				break;
+			case VARIABLE:
+				snprintf(text, sizeof(text), "x_%u", node->data.variableId);
+				SymbolNodePrinterAppend(printer, text);
+				break;
+			case ADD:
+			case SUSTRACT:
+			case MULTIPLY:
+				SymbolNodeStackPush(stack, node->data.children.right, SYMBOL_NODE_PRINT_EXPRESSION);
+				SymbolNodeStackPush(stack, node, SYMBOL_NODE_PRINT_OPERATOR);
+				SymbolNodeStackPush(stack, node->data.children.left, SYMBOL_NODE_PRINT_EXPRESSION);
+				break;
+			case SQUARE:
+			case NEGATE:
+				SymbolNodePrinterAppend(printer, node->operation == SQUARE ? "(" : "-(");
+				SymbolNodeStackPush(stack, node, SYMBOL_NODE_PRINT_CLOSE);
+				SymbolNodeStackPush(stack, node->data.children.left, SYMBOL_NODE_PRINT_EXPRESSION);
+				break;
+			case FMA:
+				SymbolNodePrinterAppend(printer, "(");
+				SymbolNodeStackPush(stack, node, SYMBOL_NODE_PRINT_CLOSE);
+				SymbolNodeStackPush(stack, node->data.children.addend, SYMBOL_NODE_PRINT_EXPRESSION);
+				SymbolNodeStackPush(stack, node, SYMBOL_NODE_PRINT_PLUS);
+				SymbolNodeStackPush(stack, node->data.children.right, SYMBOL_NODE_PRINT_EXPRESSION);
+				SymbolNodeStackPush(stack, node, SYMBOL_NODE_PRINT_TIMES);
+				SymbolNodeStackPush(stack, node->data.children.left, SYMBOL_NODE_PRINT_EXPRESSION);
+				break;
+			case DOT:
+				SymbolNodePrinterAppend(printer, "(");
+				SymbolNodeStackPush(stack, node, SYMBOL_NODE_PRINT_CLOSE);
+				for (unsigned int i = node->data.dot.count; i-- > 0;) {
+					SymbolNodeStackPush(stack, node->data.dot.right[i], SYMBOL_NODE_PRINT_EXPRESSION);
+					SymbolNodeStackPush(stack, node, SYMBOL_NODE_PRINT_TIMES);
+					SymbolNodeStackPush(stack, node->data.dot.left[i], SYMBOL_NODE_PRINT_EXPRESSION);
+					if(i > 0) {
+						SymbolNodeStackPush(stack, node, SYMBOL_NODE_PRINT_PLUS);
+					}
+				}
+				break;
+			default:
+				assert(false, "Unhandled operation!");
+		}
+	}
+
+	// Pieces left after the output filled up are dropped
+	stack->size = base;
+}
+
+void SymbolNodePrint(SymbolNode* expression) {
+	char buffer[MAX_TRACELOG_MSG_LENGTH] = { 0 };
+	SymbolNodePrinter printer = { .buffer = buffer, .capacity = sizeof(buffer), .size = 0, .full = false };
+	SymbolNodeStack stack = { 0 };
+
+	SymbolNodePrintInternal(expression, &stack, &printer);
+	TraceLog(LOG_DEBUG, "%s", buffer);
+
+	free(stack.start);
+}
+
+//-----------------------------------------------------------------------------
+// SymbolMatrix
+//-----------------------------------------------------------------------------
+
+SymbolMatrixArray* SymbolMatrixArrayCreate() {
+	SymbolMatrixArray* array = malloc(sizeof(SymbolMatrixArray));
+	*array = (SymbolMatrixArray) {
+		.arena = ArenaCreate(64 * (sizeof(SymbolMatrix) + 4 * sizeof(SymbolNode*))),
+		.start = NULL,
+		.nodeArray = SymbolNodeArrayCreate(),
+		.capacity = 0,
+		.size = 0,
+	};
+	return array;
+}
+
+void SymbolMatrixArrayFree(SymbolMatrixArray* array) {
+	SymbolNodeArrayFree(array->nodeArray);
+	ArenaFree(array->arena);
+	free(array->start);
+	free(array);
+}
+
+SymbolMatrix* SymbolMatrixArrayAdd(SymbolMatrixArray* array) {
+	if(array->size == array->capacity) {
+		array->capacity = array->capacity == 0 ? 64 : array->capacity * 2;
+		array->start = reallocarray(array->start, array->capacity, sizeof(SymbolMatrix*));
+
+		assert(array->start != NULL, "No memory!");
+	}
+
+	SymbolMatrix* matrix = ArenaAllocate(array->arena, sizeof(SymbolMatrix), alignof(SymbolMatrix));
+	array->start[array->size] = matrix;
+	array->size++;
+	return matrix;
+}
+
+void SymbolMatrixArrayPrint(SymbolMatrixArray* array) {
+	for (unsigned int i = 0; i < array->size; ++i) {
+		printf("%u:\n", i);
+		SymbolMatrixPrint(array->start[i]);
+	}
+}
+
+void SymbolMatrixArrayCollect(SymbolMatrixArray* array, SymbolMatrix** matrixRoots, size_t matrixRootCount,
+                              SymbolNode** nodeRoots, size_t nodeRootCount) {
+	// Values of the matrices are node roots too, gathered after nodeRoots so all the nodes are moved at once
+	size_t nodeCount = nodeRootCount;
+	for (size_t i = 0; i < matrixRootCount; ++i) {
+		nodeCount += matrixRoots[i]->rows * matrixRoots[i]->cols;
+	}
+	SymbolNode** nodes = malloc((nodeCount + 1) * sizeof(SymbolNode*));
+	assert(nodes != NULL, "No memory!");
+
+	memcpy(nodes, nodeRoots, nodeRootCount * sizeof(SymbolNode*));
+	size_t offset = nodeRootCount;
+	for (size_t i = 0; i < matrixRootCount; ++i) {
+		const size_t valueCount = matrixRoots[i]->rows * matrixRoots[i]->cols;
+		memcpy(nodes + offset, matrixRoots[i]->values, valueCount * sizeof(SymbolNode*));
+		offset += valueCount;
+	}
+
+	SymbolNodeArrayCollect(array->nodeArray, nodes, nodeCount);
+	memcpy(nodeRoots, nodes, nodeRootCount * sizeof(SymbolNode*));
+
+	// Matrices are created again in a new arena, the old one still holds the roots until they are all copied
+	Arena* arena = array->arena;
+	const size_t size = array->size;
+	array->arena = ArenaCreate(64 * (sizeof(SymbolMatrix) + 4 * sizeof(SymbolNode*)));
+	array->size = 0;
+
+	SymbolMatrix** moved = malloc((matrixRootCount + 1) * sizeof(SymbolMatrix*));
+	assert(moved != NULL, "No memory!");
+
+	offset = nodeRootCount;
+	for (size_t i = 0; i < matrixRootCount; ++i) {
+		const size_t valueCount = matrixRoots[i]->rows * matrixRoots[i]->cols;
+
+		// The same matrix can be a root more than once, there are few roots so earlier ones are searched linearly
+		moved[i] = NULL;
+		for (size_t j = 0; j < i && moved[i] == NULL; ++j) {
+			if(matrixRoots[j] == matrixRoots[i]) {
+				moved[i] = moved[j];
+			}
+		}
+		if(moved[i] == NULL) {
+			moved[i] = SymbolMatrixCreate(array, matrixRoots[i]->rows, matrixRoots[i]->cols);
+			memcpy(moved[i]->values, nodes + offset, valueCount * sizeof(SymbolNode*));
+		}
+		offset += valueCount;
+	}
+	memcpy(matrixRoots, moved, matrixRootCount * sizeof(SymbolMatrix*));
+
+	TraceLog(LOG_DEBUG, "Symbol matrices collected, %zu of %zu kept", array->size, size);
+
+	free(moved);
+	free(nodes);
+	ArenaFree(arena);
+}
+
+SymbolMemoryStatistics SymbolMatrixArrayStatistics(SymbolMatrixArray* array) {
+	SymbolMemoryStatistics statistics = SymbolNodeArrayStatistics(array->nodeArray);
+	statistics.matrixCount = array->size;
+	statistics.usedBytes += ArenaSize(array->arena);
+	statistics.reservedBytes += ArenaCapacity(array->arena) + array->capacity * sizeof(SymbolMatrix*);
+	return statistics;
+}
+
+SymbolMatrix *SymbolMatrixCreate(SymbolMatrixArray *array, unsigned int rows, unsigned int cols) {
 	SymbolMatrix* matrix = SymbolMatrixArrayAdd(array);
 	*matrix = (SymbolMatrix) {
-		.values = calloc(cols * rows, sizeof(SymbolNode*)),
+		.values = ArenaAllocateZero(array->arena, cols * rows * sizeof(SymbolNode*), alignof(SymbolNode*)),
 		.cols = cols,
 		.rows = rows,
 	};
 	return matrix;
 }
 
-void SymbolMatrixFree(SymbolMatrix *matrix) {
-	free(matrix->values);
-}
-
 void SymbolMatrixSet(SymbolMatrix *matrix, unsigned int row, unsigned int col, SymbolNode *value) {
 	assert(row < matrix->rows && col < matrix->cols, "Indexing nonexistent element!");
 
@@ -309,6 +1356,22 @@ SymbolMatrix* SymbolMatrixMultiplyElementWise(SymbolMatrixArray* array, SymbolMa
 	return matrix;
 }
 
+SymbolMatrix* SymbolMatrixSquareElementWise(SymbolMatrixArray* array, SymbolMatrix* matrix) {
+	SymbolMatrix* result = SymbolMatrixCreate(array, matrix->rows, matrix->cols);
+
+	for (unsigned int i = 0; i < matrix->rows * matrix->cols; ++i) {
+		result->values[i] = SymbolNodeUnary(array->nodeArray, SQUARE, matrix->values[i]);
+	}
+
+	return result;
+}
+
+SymbolNode* SymbolMatrixDot(SymbolMatrixArray* array, SymbolMatrix* left, SymbolMatrix* right) {
+	assert(left->rows == right->rows && left->cols == right->cols, "Matrix dimensions don't match!");
+
+	return SymbolNodeDot(array->nodeArray, left->values, right->values, left->rows * left->cols);
+}
+
 SymbolMatrix* SymbolNodeDifferentiateSymbolMatrix(SymbolNode* expression, SymbolMatrixArray* array, SymbolMatrix* variableMatrix) {
 	SymbolMatrix * result = SymbolMatrixCreate(array, variableMatrix->rows, variableMatrix->cols);
 	for (unsigned int col = 0; col < variableMatrix->cols; ++col) {
@@ -321,32 +1384,1752 @@ SymbolMatrix* SymbolNodeDifferentiateSymbolMatrix(SymbolNode* expression, Symbol
 	return result;
 }
 
+typedef struct SymbolNodeOrderContext {
+	SymbolNodeMap* order;
+	SymbolNode** nodes;
+	unsigned int size;
+	unsigned int capacity;
+} SymbolNodeOrderContext;
+
+static void SymbolNodeOrderVisit(SymbolNode* expression, void* context) {
+	SymbolNodeOrderContext* order = context;
+
+	if(order->size == order->capacity) {
+		order->capacity = order->capacity == 0 ? 64 : order->capacity * 2;
+		order->nodes = reallocarray(order->nodes, order->capacity, sizeof(SymbolNode*));
+
+		assert(order->nodes != NULL, "No memory!");
+	}
+
+	SymbolNodeMapInsert(order->order, expression, (SymbolNodeMapValue) { .index = order->size });
+	order->nodes[order->size] = expression;
+	order->size++;
+}
+
+// Post order of the DAG, every node comes after its operands
+static void SymbolNodeTopologicalOrder(SymbolNode* expression, SymbolNodeStack* stack, SymbolNodeMap* order,
+                                       SymbolNode*** nodes, unsigned int* size, unsigned int* capacity) {
+	SymbolNodeOrderContext context = { .order = order, .nodes = *nodes, .size = *size, .capacity = *capacity };
+	SymbolNodeTraverse(stack, expression, order, SymbolNodeOrderVisit, &context);
+	*nodes = context.nodes;
+	*size = context.size;
+	*capacity = context.capacity;
+}
+
+static void SymbolNodeAccumulateAdjoint(SymbolNodeArray* array, SymbolNode** adjoint, Operation operation,
+                                        SymbolNode* value) {
+	if(*adjoint == NULL) {
+		*adjoint = operation == ADD ? value : SymbolNodeSimplifyUnary(array, NEGATE, value);
+	} else {
+		*adjoint = SymbolNodeSimplifyBinary(array, operation, *adjoint, value);
+	}
+}
+
+SymbolMatrix* SymbolNodeGradientSymbolMatrix(SymbolNode* expression, SymbolMatrixArray* array, SymbolMatrix* variableMatrix) {
+	SymbolNodeArray* nodeArray = array->nodeArray;
+
+	SymbolNodeMap order = SymbolNodeMapCreate();
+	SymbolNode** nodes = NULL;
+	unsigned int size = 0;
+	unsigned int capacity = 0;
+	SymbolNodeTopologicalOrder(expression, &nodeArray->stack, &order, &nodes, &size, &capacity);
+
+	SymbolNode** adjoints = calloc(size, sizeof(SymbolNode*));
+	adjoints[size - 1] = SymbolNodeConstant(nodeArray, 1.0f);
+
+	// Single backward sweep, each node passes its adjoint to its operands
+	for (unsigned int i = size; i-- > 0;) {
+		SymbolNode* node = nodes[i];
+		SymbolNode* adjoint = adjoints[i];
+
+		if(adjoint == NULL || node->operation == CONSTANT || node->operation == VARIABLE) {
+			continue;
+		}
+
+		if(node->operation == DOT) {
+			for (unsigned int j = 0; j < node->data.dot.count; ++j) {
+				SymbolNode* leftFactor = node->data.dot.left[j];
+				SymbolNode* rightFactor = node->data.dot.right[j];
+				SymbolNode** left = &adjoints[SymbolNodeMapFind(&order, leftFactor)->index];
+
+				// A factor squared passes 2 * factor once, like SQUARE, instead of the factor twice
+				if(leftFactor == rightFactor) {
+					SymbolNode* twice = SymbolNodeSimplifyBinary(nodeArray, MULTIPLY, SymbolNodeConstant(nodeArray, 2.0f),
+					                                             leftFactor);
+					SymbolNodeAccumulateAdjoint(nodeArray, left, ADD,
+					                            SymbolNodeSimplifyBinary(nodeArray, MULTIPLY, adjoint, twice));
+					continue;
+				}
+
+				SymbolNode** right = &adjoints[SymbolNodeMapFind(&order, rightFactor)->index];
+				SymbolNodeAccumulateAdjoint(nodeArray, left, ADD,
+				                            SymbolNodeSimplifyBinary(nodeArray, MULTIPLY, adjoint, rightFactor));
+				SymbolNodeAccumulateAdjoint(nodeArray, right, ADD,
+				                            SymbolNodeSimplifyBinary(nodeArray, MULTIPLY, adjoint, leftFactor));
+			}
+			continue;
+		}
+
+		SymbolNode** left = &adjoints[SymbolNodeMapFind(&order, node->data.children.left)->index];
+		SymbolNode** right = node->data.children.right != NULL
+		                     ? &adjoints[SymbolNodeMapFind(&order, node->data.children.right)->index] : NULL;
+
+		switch(node->operation) {
+			case ADD:
+				SymbolNodeAccumulateAdjoint(nodeArray, left, ADD, adjoint);
+				SymbolNodeAccumulateAdjoint(nodeArray, right, ADD, adjoint);
+				break;
+			case SUSTRACT:
+				SymbolNodeAccumulateAdjoint(nodeArray, left, ADD, adjoint);
+				SymbolNodeAccumulateAdjoint(nodeArray, right, SUSTRACT, adjoint);
+				break;
+			case MULTIPLY:
+				SymbolNodeAccumulateAdjoint(nodeArray, left, ADD,
+				                            SymbolNodeSimplifyBinary(nodeArray, MULTIPLY, adjoint, node->data.children.right));
+				SymbolNodeAccumulateAdjoint(nodeArray, right, ADD,
+				                            SymbolNodeSimplifyBinary(nodeArray, MULTIPLY, adjoint, node->data.children.left));
+				break;
+			case SQUARE: {
+				SymbolNode* twice = SymbolNodeSimplifyBinary(nodeArray, MULTIPLY, SymbolNodeConstant(nodeArray, 2.0f),
+				                                             node->data.children.left);
+				SymbolNodeAccumulateAdjoint(nodeArray, left, ADD, SymbolNodeSimplifyBinary(nodeArray, MULTIPLY, adjoint, twice));
+				break;
+			}
+			case NEGATE:
+				SymbolNodeAccumulateAdjoint(nodeArray, left, SUSTRACT, adjoint);
+				break;
+			case FMA: {
+				SymbolNode** addend = &adjoints[SymbolNodeMapFind(&order, node->data.children.addend)->index];
+				SymbolNodeAccumulateAdjoint(nodeArray, left, ADD,
+				                            SymbolNodeSimplifyBinary(nodeArray, MULTIPLY, adjoint, node->data.children.right));
+				SymbolNodeAccumulateAdjoint(nodeArray, right, ADD,
+				                            SymbolNodeSimplifyBinary(nodeArray, MULTIPLY, adjoint, node->data.children.left));
+				SymbolNodeAccumulateAdjoint(nodeArray, addend, ADD, adjoint);
+				break;
+			}
+			default:
+				assert(false, "Unhandled operation!");
+		}
+	}
+
+	SymbolMatrix* result = SymbolMatrixCreate(array, variableMatrix->rows, variableMatrix->cols);
+	for (unsigned int i = 0; i < variableMatrix->rows * variableMatrix->cols; ++i) {
+		SymbolNode* variable = variableMatrix->values[i];
+		assert(variable->operation == VARIABLE, "Tried to differentiate against expression that is not a variable!");
+
+		SymbolNodeMapValue* index = SymbolNodeMapFind(&order, variable);
+		SymbolNode* adjoint = index != NULL ? adjoints[index->index] : NULL;
+		result->values[i] = adjoint != NULL ? adjoint : SymbolNodeConstant(nodeArray, 0.0f);
+	}
+
+	free(adjoints);
+	free(nodes);
+	SymbolNodeMapFree(&order);
+
+	return result;
+}
+
+// The variable is the same for every value, so values sharing subexpressions share their derivatives too
 SymbolMatrix* SymbolMatrixDifferentiateSymbolNode(SymbolMatrix* expression, SymbolMatrixArray* array, SymbolNode* variable) {
+	assert(variable->operation == VARIABLE, "Tried to differentiate against expression that is not a variable!");
+
 	SymbolMatrix * result = SymbolMatrixCreate(array, expression->rows, expression->cols);
+	SymbolNodeMap derivatives = SymbolNodeMapCreate();
 	for (unsigned int col = 0; col < expression->cols; ++col) {
 		for (unsigned int row = 0; row < expression->rows; ++row) {
 			SymbolNode* valueExpression = SymbolMatrixGet(expression, row, col);
-			SymbolNode* r = SymbolNodeDifferentiate(valueExpression, array->nodeArray, variable);
+			SymbolNode* r = SymbolNodeDifferentiateInternal(valueExpression, array->nodeArray, variable, &derivatives);
 			SymbolMatrixSet(result, row, col, r);
 		}
 	}
+	SymbolNodeMapFree(&derivatives);
 	return result;
 }
 
+SymbolMatrix* SymbolMatrixSimplify(SymbolMatrix* expression, SymbolMatrixArray* array) {
+	SymbolMatrix* result = SymbolMatrixCreate(array, expression->rows, expression->cols);
+	SymbolNodeMap simplified = SymbolNodeMapCreate();
+
+	for (unsigned int i = 0; i < expression->rows * expression->cols; ++i) {
+		result->values[i] = SymbolNodeSimplifyInternal(expression->values[i], array->nodeArray, &simplified);
+	}
+
+	SymbolNodeMapFree(&simplified);
+	return result;
+}
+
+unsigned int SymbolMatrixSparsity(SymbolMatrix* expression, bool* nonzero) {
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < expression->rows * expression->cols; ++i) {
+		nonzero[i] = !SymbolNodeIsConstant(expression->values[i], 0.0f);
+		count += nonzero[i];
+	}
+
+	return count;
+}
+
+unsigned int SymbolMatrixCount(SymbolMatrix* expression) {
+	SymbolNodeStack stack = { 0 };
+	SymbolNodeMap visited = SymbolNodeMapCreate();
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < expression->rows * expression->cols; ++i) {
+		count += SymbolNodeCountInternal(expression->values[i], &stack, &visited);
+	}
+
+	SymbolNodeMapFree(&visited);
+	free(stack.start);
+	return count;
+}
+
 void SymbolMatrixPrintInternal(SymbolMatrix* expression) {
-	char buffer[MAX_TRACELOG_MSG_LENGTH] = { 0 };
-	char* end = buffer;
+	char buffer[MAX_TRACELOG_MSG_LENGTH];
+	SymbolNodeStack stack = { 0 };
 
 	for (unsigned int col = 0; col < expression->cols; ++col) {
 		for (unsigned int row = 0; row < expression->rows; ++row) {
-			sprintf(end, "(%u, %u) ", row, col); end += strlen(end);
+			SymbolNodePrinter printer = { .buffer = buffer, .capacity = sizeof(buffer), .size = 0, .full = false };
+			char position[32];
+			snprintf(position, sizeof(position), "(%u, %u) ", row, col);
+			SymbolNodePrinterAppend(&printer, position);
+
 			SymbolNode* valueExpression = SymbolMatrixGet(expression, row, col);
-			SymbolNodePrintInternal(valueExpression, &end);
-			TraceLog(LOG_DEBUG, buffer); end = buffer;
+			SymbolNodePrintInternal(valueExpression, &stack, &printer);
+			TraceLog(LOG_DEBUG, "%s", buffer);
 		}
 	}
+
+	free(stack.start);
 }
 
 void SymbolMatrixPrint(SymbolMatrix* expression) {
 	SymbolMatrixPrintInternal(expression);
 }
+
+
+//-----------------------------------------------------------------------------
+// SymbolGraph
+//-----------------------------------------------------------------------------
+
+typedef struct SymbolGraphBuilder {
+	SymbolGraphNode* nodes;
+	unsigned int size;
+	unsigned int capacity;
+	uint32_t* factors;
+	unsigned int factorSize;
+	unsigned int factorCapacity;
+} SymbolGraphBuilder;
+
+static uint32_t SymbolGraphBuilderAdd(SymbolGraphBuilder* builder, SymbolGraphNode node) {
+	if(builder->size == builder->capacity) {
+		builder->capacity = builder->capacity == 0 ? 64 : builder->capacity * 2;
+		builder->nodes = reallocarray(builder->nodes, builder->capacity, sizeof(SymbolGraphNode));
+
+		assert(builder->nodes != NULL, "No memory!");
+	}
+
+	builder->nodes[builder->size] = node;
+	return builder->size++;
+}
+
+static void SymbolGraphBuilderAddFactor(SymbolGraphBuilder* builder, uint32_t factor) {
+	if(builder->factorSize == builder->factorCapacity) {
+		builder->factorCapacity = builder->factorCapacity == 0 ? 64 : builder->factorCapacity * 2;
+		builder->factors = reallocarray(builder->factors, builder->factorCapacity, sizeof(uint32_t));
+
+		assert(builder->factors != NULL, "No memory!");
+	}
+
+	builder->factors[builder->factorSize++] = factor;
+}
+
+typedef struct SymbolGraphBuildContext {
+	SymbolGraphBuilder* builder;
+	SymbolNodeMap* indices;
+} SymbolGraphBuildContext;
+
+// Children are added before their parents, so indices always point backwards
+static void SymbolGraphBuildVisit(SymbolNode* expression, void* context) {
+	SymbolGraphBuildContext* build = context;
+
+	SymbolGraphNode node = { .operation = expression->operation };
+	switch(expression->operation) {
+		case CONSTANT:
+			node.data.value = expression->data.value;
+			break;
+		case VARIABLE:
+			assert(false, "Variable is not an input of the graph!");
+			__builtin_unreachable();
+		case ADD:
+		case SUSTRACT:
+		case MULTIPLY:
+			node.data.children.left = SymbolNodeMapIndex(build->indices, expression->data.children.left);
+			node.data.children.right = SymbolNodeMapIndex(build->indices, expression->data.children.right);
+			break;
+		case SQUARE:
+		case NEGATE:
+			node.data.children.left = SymbolNodeMapIndex(build->indices, expression->data.children.left);
+			node.data.children.right = node.data.children.left;
+			break;
+		case FMA:
+			node.data.factors.first = build->builder->factorSize;
+			node.data.factors.count = 1;
+			SymbolGraphBuilderAddFactor(build->builder,
+			                            SymbolNodeMapIndex(build->indices, expression->data.children.left));
+			SymbolGraphBuilderAddFactor(build->builder,
+			                            SymbolNodeMapIndex(build->indices, expression->data.children.right));
+			SymbolGraphBuilderAddFactor(build->builder,
+			                            SymbolNodeMapIndex(build->indices, expression->data.children.addend));
+			break;
+		case DOT:
+			node.data.factors.first = build->builder->factorSize;
+			node.data.factors.count = expression->data.dot.count;
+			for (unsigned int i = 0; i < 2 * expression->data.dot.count; ++i) {
+				const uint32_t factor = SymbolNodeMapIndex(build->indices, expression->data.dot.left[i]);
+				SymbolGraphBuilderAddFactor(build->builder, factor);
+			}
+			break;
+		default:
+			assert(false, "Unhandled operation!");
+			__builtin_unreachable();
+	}
+
+	const uint32_t index = SymbolGraphBuilderAdd(build->builder, node);
+	SymbolNodeMapInsert(build->indices, expression, (SymbolNodeMapValue) { .index = index });
+}
+
+static uint32_t SymbolGraphBuild(SymbolGraphBuilder* builder, SymbolNodeStack* stack, SymbolNodeMap* indices,
+                                 SymbolNode* expression) {
+	SymbolGraphBuildContext context = { .builder = builder, .indices = indices };
+	SymbolNodeTraverse(stack, expression, indices, SymbolGraphBuildVisit, &context);
+	return SymbolNodeMapIndex(indices, expression);
+}
+
+SymbolGraph* SymbolGraphCreate(SymbolNode** inputs, unsigned int inputCount, SymbolNode** outputs,
+                               unsigned int outputCount) {
+	SymbolGraphBuilder builder = {
+		.nodes = NULL,
+		.size = 0,
+		.capacity = 0,
+		.factors = NULL,
+		.factorSize = 0,
+		.factorCapacity = 0,
+	};
+	SymbolNodeStack stack = { 0 };
+	SymbolNodeMap indices = SymbolNodeMapCreate();
+
+	for (unsigned int i = 0; i < inputCount; ++i) {
+		assert(inputs[i]->operation == VARIABLE, "Graph input is not a variable!");
+		const SymbolGraphNode node = { .operation = VARIABLE, .data.input = i };
+		SymbolNodeMapInsert(&indices, inputs[i], (SymbolNodeMapValue) { .index = SymbolGraphBuilderAdd(&builder, node) });
+	}
+
+	uint32_t* outputIndices = calloc(outputCount, sizeof(uint32_t));
+	assert(outputIndices != NULL, "No memory!");
+	for (unsigned int i = 0; i < outputCount; ++i) {
+		outputIndices[i] = SymbolGraphBuild(&builder, &stack, &indices, outputs[i]);
+	}
+
+	SymbolNodeMapFree(&indices);
+	free(stack.start);
+
+	SymbolGraph* graph = malloc(sizeof(SymbolGraph) + builder.size * sizeof(SymbolGraphNode)
+	                            + (outputCount + builder.factorSize) * sizeof(uint32_t));
+	assert(graph != NULL, "No memory!");
+	graph->nodeCount = builder.size;
+	graph->inputCount = inputCount;
+	graph->outputCount = outputCount;
+	graph->factorCount = builder.factorSize;
+	memcpy(graph->nodes, builder.nodes, builder.size * sizeof(SymbolGraphNode));
+	memcpy(SymbolGraphOutputs(graph), outputIndices, outputCount * sizeof(uint32_t));
+	if(builder.factorSize > 0) {
+		memcpy(SymbolGraphFactors(graph), builder.factors, builder.factorSize * sizeof(uint32_t));
+	}
+
+	free(builder.nodes);
+	free(builder.factors);
+	free(outputIndices);
+
+	return graph;
+}
+
+void SymbolGraphFree(SymbolGraph* graph) {
+	free(graph);
+}
+
+size_t SymbolGraphSize(const SymbolGraph* graph) {
+	return sizeof(SymbolGraph) + graph->nodeCount * sizeof(SymbolGraphNode)
+	       + ((size_t) graph->outputCount + graph->factorCount) * sizeof(uint32_t);
+}
+
+uint32_t* SymbolGraphOutputs(const SymbolGraph* graph) {
+	return (uint32_t*) (graph->nodes + graph->nodeCount);
+}
+
+uint32_t* SymbolGraphFactors(const SymbolGraph* graph) {
+	return SymbolGraphOutputs(graph) + graph->outputCount;
+}
+
+void SymbolGraphEvaluate(const SymbolGraph* graph, const float* inputs, float* values, float* outputs) {
+	const uint32_t* factors = SymbolGraphFactors(graph);
+
+	for (uint32_t i = 0; i < graph->nodeCount; ++i) {
+		const SymbolGraphNode node = graph->nodes[i];
+
+		switch(node.operation) {
+			case CONSTANT:
+				values[i] = node.data.value;
+				break;
+			case VARIABLE:
+				values[i] = inputs[node.data.input];
+				break;
+			case ADD:
+				values[i] = values[node.data.children.left] + values[node.data.children.right];
+				break;
+			case SUSTRACT:
+				values[i] = values[node.data.children.left] - values[node.data.children.right];
+				break;
+			case MULTIPLY:
+				values[i] = values[node.data.children.left] * values[node.data.children.right];
+				break;
+			case SQUARE:
+				values[i] = values[node.data.children.left] * values[node.data.children.left];
+				break;
+			case NEGATE:
+				values[i] = -values[node.data.children.left];
+				break;
+			case FMA: {
+				const uint32_t* operands = factors + node.data.factors.first;
+				values[i] = fmaf(values[operands[0]], values[operands[1]], values[operands[2]]);
+				break;
+			}
+			case DOT: {
+				// Same order as the tape, a product and then one fused multiply add per term
+				const uint32_t* left = factors + node.data.factors.first;
+				const uint32_t* right = left + node.data.factors.count;
+				float sum = values[left[0]] * values[right[0]];
+				for (uint32_t j = 1; j < node.data.factors.count; ++j) {
+					sum = fmaf(values[left[j]], values[right[j]], sum);
+				}
+				values[i] = sum;
+				break;
+			}
+			default:
+				assert(false, "Unhandled operation!");
+				__builtin_unreachable();
+		}
+	}
+
+	const uint32_t* outputIndices = SymbolGraphOutputs(graph);
+	for (uint32_t i = 0; i < graph->outputCount; ++i) {
+		outputs[i] = values[outputIndices[i]];
+	}
+}
+
+unsigned int SymbolGraphSparsity(const SymbolGraph* graph, bool* nonzero) {
+	const uint32_t* outputIndices = SymbolGraphOutputs(graph);
+	unsigned int count = 0;
+
+	for (uint32_t i = 0; i < graph->outputCount; ++i) {
+		const SymbolGraphNode node = graph->nodes[outputIndices[i]];
+		nonzero[i] = node.operation != CONSTANT || node.data.value != 0.0f;
+		count += nonzero[i];
+	}
+
+	return count;
+}
+
+void SymbolGraphToNodes(const SymbolGraph* graph, SymbolNodeArray* array, SymbolNode** inputs, SymbolNode** outputs) {
+	SymbolNode** nodes = calloc(graph->nodeCount, sizeof(SymbolNode*));
+	SymbolNode** factors = calloc(graph->factorCount + 1, sizeof(SymbolNode*));
+	assert(nodes != NULL && factors != NULL, "No memory!");
+	const uint32_t* factorIndices = SymbolGraphFactors(graph);
+
+	for (uint32_t i = 0; i < graph->nodeCount; ++i) {
+		const SymbolGraphNode node = graph->nodes[i];
+
+		switch(node.operation) {
+			case CONSTANT:
+				nodes[i] = SymbolNodeConstant(array, node.data.value);
+				break;
+			case VARIABLE:
+				nodes[i] = inputs[node.data.input];
+				break;
+			case ADD:
+			case SUSTRACT:
+			case MULTIPLY:
+				nodes[i] = SymbolNodeBinary(array, node.operation, nodes[node.data.children.left],
+				                            nodes[node.data.children.right]);
+				break;
+			case SQUARE:
+			case NEGATE:
+				nodes[i] = SymbolNodeUnary(array, node.operation, nodes[node.data.children.left]);
+				break;
+			case FMA: {
+				const uint32_t* operands = factorIndices + node.data.factors.first;
+				nodes[i] = SymbolNodeFma(array, nodes[operands[0]], nodes[operands[1]], nodes[operands[2]]);
+				break;
+			}
+			case DOT: {
+				SymbolNode** left = factors + node.data.factors.first;
+				for (uint32_t j = 0; j < 2 * node.data.factors.count; ++j) {
+					left[j] = nodes[factorIndices[node.data.factors.first + j]];
+				}
+				nodes[i] = SymbolNodeDot(array, left, left + node.data.factors.count, node.data.factors.count);
+				break;
+			}
+			default:
+				assert(false, "Unhandled operation!");
+				__builtin_unreachable();
+		}
+	}
+
+	const uint32_t* outputIndices = SymbolGraphOutputs(graph);
+	for (uint32_t i = 0; i < graph->outputCount; ++i) {
+		outputs[i] = nodes[outputIndices[i]];
+	}
+
+	free(factors);
+	free(nodes);
+}
+
+static const char symbolGraphFileMagic[4] = { 'S', 'Y', 'M', 'G' };
+
+// Indices come from disk, so every one is checked before the graph is used
+static bool SymbolGraphValid(const SymbolGraph* graph, size_t size) {
+	if(size < sizeof(SymbolGraph) || SymbolGraphSize(graph) != size) {
+		return false;
+	}
+
+	const uint32_t* factors = SymbolGraphFactors(graph);
+
+	for (uint32_t i = 0; i < graph->nodeCount; ++i) {
+		const SymbolGraphNode node = graph->nodes[i];
+
+		switch(node.operation) {
+			case CONSTANT:
+				break;
+			case VARIABLE:
+				if(node.data.input >= graph->inputCount) {
+					return false;
+				}
+				break;
+			case ADD:
+			case SUSTRACT:
+			case MULTIPLY:
+			case SQUARE:
+			case NEGATE:
+				if(node.data.children.left >= i || node.data.children.right >= i) {
+					return false;
+				}
+				break;
+			case FMA:
+			case DOT: {
+				if(node.data.factors.first > graph->factorCount) {
+					return false;
+				}
+
+				// FMA has its addend after its only pair of factors
+				const uint32_t available = graph->factorCount - node.data.factors.first;
+				const uint32_t count = node.operation == FMA ? 3 : 2 * node.data.factors.count;
+				const bool valid = node.operation == FMA
+				                   ? node.data.factors.count == 1 && available >= 3
+				                   : node.data.factors.count > 0 && node.data.factors.count <= available / 2;
+				if(!valid) {
+					return false;
+				}
+				for (uint32_t j = 0; j < count; ++j) {
+					if(factors[node.data.factors.first + j] >= i) {
+						return false;
+					}
+				}
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+
+	const uint32_t* outputIndices = SymbolGraphOutputs(graph);
+	for (uint32_t i = 0; i < graph->outputCount; ++i) {
+		if(outputIndices[i] >= graph->nodeCount) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Written to a temporary file first and renamed, so a reader never maps a partial graph
+bool SymbolGraphWrite(const SymbolGraph* graph, uint64_t key, const char* path) {
+	char temporaryPath[4096];
+	if(snprintf(temporaryPath, sizeof(temporaryPath), "%s.%d.tmp", path, getpid()) >= (int) sizeof(temporaryPath)) {
+		return false;
+	}
+
+	FILE* file = fopen(temporaryPath, "wb");
+	if(file == NULL) {
+		return false;
+	}
+
+	SymbolGraphFileHeader header = {
+		.version = SYMBOL_GRAPH_FILE_VERSION,
+		.key = key,
+		.size = SymbolGraphSize(graph),
+	};
+	memcpy(header.magic, symbolGraphFileMagic, sizeof(header.magic));
+
+	fwrite(&header, sizeof(SymbolGraphFileHeader), 1, file);
+	fwrite(graph, SymbolGraphSize(graph), 1, file);
+
+	const bool failed = ferror(file) != 0;
+	if(fclose(file) != 0 || failed || rename(temporaryPath, path) != 0) {
+		remove(temporaryPath);
+		return false;
+	}
+
+	return true;
+}
+
+SymbolGraphFile* SymbolGraphFileOpen(const char* path, uint64_t key) {
+	const int descriptor = open(path, O_RDONLY);
+	if(descriptor == -1) {
+		return NULL;
+	}
+
+	struct stat status;
+	if(fstat(descriptor, &status) != 0 || (size_t) status.st_size < sizeof(SymbolGraphFileHeader)) {
+		close(descriptor);
+		return NULL;
+	}
+
+	const size_t mappingSize = status.st_size;
+	void* mapping = mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+
+	if(mapping == MAP_FAILED) {
+		return NULL;
+	}
+
+	const SymbolGraphFileHeader* header = mapping;
+	const SymbolGraph* graph = (const SymbolGraph*) (header + 1);
+	if(memcmp(header->magic, symbolGraphFileMagic, sizeof(header->magic)) != 0
+	   || header->version != SYMBOL_GRAPH_FILE_VERSION || header->key != key
+	   || header->size != mappingSize - sizeof(SymbolGraphFileHeader)
+	   || !SymbolGraphValid(graph, header->size)) {
+		munmap(mapping, mappingSize);
+		return NULL;
+	}
+
+	SymbolGraphFile* file = malloc(sizeof(SymbolGraphFile));
+	assert(file != NULL, "No memory!");
+	*file = (SymbolGraphFile) {
+		.mapping = mapping,
+		.mappingSize = mappingSize,
+		.graph = graph,
+	};
+
+	return file;
+}
+
+void SymbolGraphFileClose(SymbolGraphFile* file) {
+	munmap(file->mapping, file->mappingSize);
+	free(file);
+}
+
+//-----------------------------------------------------------------------------
+// SymbolTape
+//-----------------------------------------------------------------------------
+
+static unsigned int SymbolTapeAddRegister(SymbolTape* tape, float value) {
+	if(tape->registerCount == tape->registerCapacity) {
+		tape->registerCapacity = tape->registerCapacity == 0 ? 16 : tape->registerCapacity * 2;
+		tape->registers = reallocarray(tape->registers, tape->registerCapacity, sizeof(float));
+
+		assert(tape->registers != NULL, "No memory!");
+	}
+
+	tape->registers[tape->registerCount] = value;
+	return tape->registerCount++;
+}
+
+static unsigned int SymbolTapeAddInstruction(SymbolTape* tape, Operation operation, unsigned int left,
+                                             unsigned int right, unsigned int addend) {
+	if(tape->instructionCount == tape->instructionCapacity) {
+		tape->instructionCapacity = tape->instructionCapacity == 0 ? 16 : tape->instructionCapacity * 2;
+		tape->instructions = reallocarray(tape->instructions, tape->instructionCapacity, sizeof(SymbolInstruction));
+
+		assert(tape->instructions != NULL, "No memory!");
+	}
+
+	const unsigned int result = SymbolTapeAddRegister(tape, 0.0f);
+	tape->instructions[tape->instructionCount] = (SymbolInstruction) {
+		.operation = operation,
+		.result = result,
+		.left = left,
+		.right = right,
+		.addend = addend,
+	};
+	tape->instructionCount++;
+	return result;
+}
+
+// Stands for a left factor of DOT that is the constant 1
+#define SYMBOL_TAPE_ONE UINT32_MAX
+
+// Sum of left[i] * right[i] as a product, or a square, followed by a chain of FMA, terms with a left factor of
+// SYMBOL_TAPE_ONE are added instead
+static unsigned int SymbolTapeAddDot(SymbolTape* tape, const unsigned int* left, const unsigned int* right,
+                                     unsigned int count) {
+	unsigned int result;
+	if(left[0] == SYMBOL_TAPE_ONE) {
+		result = right[0];
+	} else {
+		result = SymbolTapeAddInstruction(tape, left[0] == right[0] ? SQUARE : MULTIPLY, left[0], right[0], left[0]);
+	}
+
+	for (unsigned int i = 1; i < count; ++i) {
+		if(left[i] == SYMBOL_TAPE_ONE) {
+			result = SymbolTapeAddInstruction(tape, ADD, result, right[i], result);
+		} else {
+			result = SymbolTapeAddInstruction(tape, FMA, left[i], right[i], result);
+		}
+	}
+
+	return result;
+}
+
+typedef struct SymbolTapeCompileContext {
+	SymbolTape* tape;
+	SymbolNodeMap* registers;
+} SymbolTapeCompileContext;
+
+static void SymbolTapeCompileVisit(SymbolNode* expression, void* context) {
+	SymbolTapeCompileContext* compile = context;
+	SymbolTape* tape = compile->tape;
+
+	unsigned int result;
+	switch(expression->operation) {
+		case CONSTANT:
+			result = SymbolTapeAddRegister(tape, expression->data.value);
+			break;
+		case VARIABLE:
+			assert(false, "Variable is not an input of the tape!");
+			__builtin_unreachable();
+		case ADD:
+		case SUSTRACT:
+		case MULTIPLY: {
+			const unsigned int left = SymbolNodeMapIndex(compile->registers, expression->data.children.left);
+			const unsigned int right = SymbolNodeMapIndex(compile->registers, expression->data.children.right);
+			result = SymbolTapeAddInstruction(tape, expression->operation, left, right, left);
+			break;
+		}
+		case SQUARE:
+		case NEGATE: {
+			const unsigned int operand = SymbolNodeMapIndex(compile->registers, expression->data.children.left);
+			result = SymbolTapeAddInstruction(tape, expression->operation, operand, operand, operand);
+			break;
+		}
+		case FMA: {
+			const unsigned int left = SymbolNodeMapIndex(compile->registers, expression->data.children.left);
+			const unsigned int right = SymbolNodeMapIndex(compile->registers, expression->data.children.right);
+			const unsigned int addend = SymbolNodeMapIndex(compile->registers, expression->data.children.addend);
+			result = SymbolTapeAddInstruction(tape, FMA, left, right, addend);
+			break;
+		}
+		case DOT: {
+			const unsigned int count = expression->data.dot.count;
+			unsigned int* left = malloc(2 * count * sizeof(unsigned int));
+			assert(left != NULL, "No memory!");
+			unsigned int* right = left + count;
+			for (unsigned int i = 0; i < count; ++i) {
+				left[i] = SymbolNodeIsConstant(expression->data.dot.left[i], 1.0f)
+				          ? SYMBOL_TAPE_ONE : SymbolNodeMapIndex(compile->registers, expression->data.dot.left[i]);
+				right[i] = SymbolNodeMapIndex(compile->registers, expression->data.dot.right[i]);
+			}
+			result = SymbolTapeAddDot(tape, left, right, count);
+			free(left);
+			break;
+		}
+		default:
+			assert(false, "Unhandled operation!");
+			__builtin_unreachable();
+	}
+
+	SymbolNodeMapInsert(compile->registers, expression, (SymbolNodeMapValue) { .index = result });
+}
+
+// Each node is emitted once, shared subexpressions reuse the register of their first emission
+static unsigned int SymbolTapeCompile(SymbolTape* tape, SymbolNodeStack* stack, SymbolNodeMap* registers,
+                                      SymbolNode* expression) {
+	SymbolTapeCompileContext context = { .tape = tape, .registers = registers };
+	SymbolNodeTraverse(stack, expression, registers, SymbolTapeCompileVisit, &context);
+	return SymbolNodeMapIndex(registers, expression);
+}
+
+static SymbolTape* SymbolTapeAllocate(unsigned int inputCount, unsigned int outputCount) {
+	SymbolTape* tape = malloc(sizeof(SymbolTape));
+	*tape = (SymbolTape) {
+		.instructions = NULL,
+		.instructionCount = 0,
+		.instructionCapacity = 0,
+		.registers = NULL,
+		.tangents = NULL,
+		.batchRegisters = NULL,
+		.batchTangents = NULL,
+		.registerCount = 0,
+		.registerCapacity = 0,
+		.outputs = calloc(outputCount, sizeof(unsigned int)),
+		.outputCount = outputCount,
+		.inputCount = inputCount,
+	};
+
+	for (unsigned int i = 0; i < inputCount; ++i) {
+		SymbolTapeAddRegister(tape, 0.0f);
+	}
+
+	return tape;
+}
+
+// Allocates what evaluation needs once all registers are known
+static void SymbolTapeFinish(SymbolTape* tape) {
+	tape->tangents = calloc(tape->registerCapacity, sizeof(float));
+
+	// Room for the widest batch kernel, aligned to its vector size
+	const size_t batchSize = ((tape->registerCount * SYMBOL_TAPE_MAX_BATCH_WIDTH * sizeof(float) + 63) / 64) * 64;
+	tape->batchRegisters = aligned_alloc(64, batchSize);
+	tape->batchTangents = aligned_alloc(64, batchSize);
+
+	assert(tape->batchRegisters != NULL && tape->batchTangents != NULL, "No memory!");
+}
+
+SymbolTape* SymbolTapeCreate(SymbolNode** inputs, unsigned int inputCount, SymbolNode** outputs,
+                             unsigned int outputCount) {
+	SymbolTape* tape = SymbolTapeAllocate(inputCount, outputCount);
+	SymbolNodeStack stack = { 0 };
+	SymbolNodeMap registers = SymbolNodeMapCreate();
+
+	for (unsigned int i = 0; i < inputCount; ++i) {
+		assert(inputs[i]->operation == VARIABLE, "Tape input is not a variable!");
+		SymbolNodeMapInsert(&registers, inputs[i], (SymbolNodeMapValue) { .index = i });
+	}
+
+	for (unsigned int i = 0; i < outputCount; ++i) {
+		tape->outputs[i] = SymbolTapeCompile(tape, &stack, &registers, outputs[i]);
+	}
+
+	SymbolNodeMapFree(&registers);
+	free(stack.start);
+	SymbolTapeFinish(tape);
+
+	return tape;
+}
+
+// Nodes are already in evaluation order, so this is a single pass giving each node its register
+SymbolTape* SymbolTapeCreateGraph(const SymbolGraph* graph) {
+	SymbolTape* tape = SymbolTapeAllocate(graph->inputCount, graph->outputCount);
+	unsigned int* registers = calloc(graph->nodeCount, sizeof(unsigned int));
+	assert(registers != NULL, "No memory!");
+
+	for (uint32_t i = 0; i < graph->nodeCount; ++i) {
+		const SymbolGraphNode node = graph->nodes[i];
+
+		switch(node.operation) {
+			case CONSTANT:
+				registers[i] = SymbolTapeAddRegister(tape, node.data.value);
+				break;
+			case VARIABLE:
+				registers[i] = node.data.input;
+				break;
+			case ADD:
+			case SUSTRACT:
+			case MULTIPLY:
+			case SQUARE:
+			case NEGATE:
+				registers[i] = SymbolTapeAddInstruction(tape, node.operation, registers[node.data.children.left],
+				                                        registers[node.data.children.right],
+				                                        registers[node.data.children.left]);
+				break;
+			case FMA: {
+				const uint32_t* operands = SymbolGraphFactors(graph) + node.data.factors.first;
+				registers[i] = SymbolTapeAddInstruction(tape, FMA, registers[operands[0]], registers[operands[1]],
+				                                        registers[operands[2]]);
+				break;
+			}
+			case DOT: {
+				const uint32_t* factors = SymbolGraphFactors(graph) + node.data.factors.first;
+				unsigned int* left = malloc(2 * node.data.factors.count * sizeof(unsigned int));
+				assert(left != NULL, "No memory!");
+				unsigned int* right = left + node.data.factors.count;
+				for (uint32_t j = 0; j < node.data.factors.count; ++j) {
+					const SymbolGraphNode factor = graph->nodes[factors[j]];
+					left[j] = factor.operation == CONSTANT && factor.data.value == 1.0f
+					          ? SYMBOL_TAPE_ONE : registers[factors[j]];
+					right[j] = registers[factors[node.data.factors.count + j]];
+				}
+				registers[i] = SymbolTapeAddDot(tape, left, right, node.data.factors.count);
+				free(left);
+				break;
+			}
+			default:
+				assert(false, "Unhandled operation!");
+				__builtin_unreachable();
+		}
+	}
+
+	const uint32_t* outputIndices = SymbolGraphOutputs(graph);
+	for (uint32_t i = 0; i < graph->outputCount; ++i) {
+		tape->outputs[i] = registers[outputIndices[i]];
+	}
+
+	free(registers);
+	SymbolTapeFinish(tape);
+
+	return tape;
+}
+
+void SymbolTapeFree(SymbolTape* tape) {
+	free(tape->instructions);
+	free(tape->registers);
+	free(tape->tangents);
+	free(tape->batchRegisters);
+	free(tape->batchTangents);
+	free(tape->outputs);
+	free(tape);
+}
+
+void SymbolTapeEvaluate(SymbolTape* tape, const float* inputs, float* outputs) {
+	float* registers = tape->registers;
+
+	memcpy(registers, inputs, tape->inputCount * sizeof(float));
+
+	for (unsigned int i = 0; i < tape->instructionCount; ++i) {
+		const SymbolInstruction instruction = tape->instructions[i];
+
+		switch(instruction.operation) {
+			case ADD:
+				registers[instruction.result] = registers[instruction.left] + registers[instruction.right];
+				break;
+			case SUSTRACT:
+				registers[instruction.result] = registers[instruction.left] - registers[instruction.right];
+				break;
+			case MULTIPLY:
+				registers[instruction.result] = registers[instruction.left] * registers[instruction.right];
+				break;
+			case SQUARE:
+				registers[instruction.result] = registers[instruction.left] * registers[instruction.left];
+				break;
+			case NEGATE:
+				registers[instruction.result] = -registers[instruction.left];
+				break;
+			case FMA:
+				registers[instruction.result] = fmaf(registers[instruction.left], registers[instruction.right],
+				                                     registers[instruction.addend]);
+				break;
+			default:
+				__builtin_unreachable(); // The compiler only emits arithmetic operations
+		}
+	}
+
+	for (unsigned int i = 0; i < tape->outputCount; ++i) {
+		outputs[i] = registers[tape->outputs[i]];
+	}
+}
+
+// Runs the instructions over the dual numbers already in the registers
+static void SymbolTapeRunDual(SymbolTape* tape) {
+	float* registers = tape->registers;
+	float* tangents = tape->tangents;
+
+	for (unsigned int i = 0; i < tape->instructionCount; ++i) {
+		const SymbolInstruction instruction = tape->instructions[i];
+		const float left = registers[instruction.left];
+		const float right = registers[instruction.right];
+		const float leftTangent = tangents[instruction.left];
+		const float rightTangent = tangents[instruction.right];
+
+		switch(instruction.operation) {
+			case ADD:
+				registers[instruction.result] = left + right;
+				tangents[instruction.result] = leftTangent + rightTangent;
+				break;
+			case SUSTRACT:
+				registers[instruction.result] = left - right;
+				tangents[instruction.result] = leftTangent - rightTangent;
+				break;
+			case MULTIPLY:
+				registers[instruction.result] = left * right;
+				tangents[instruction.result] = leftTangent * right + left * rightTangent;
+				break;
+			case SQUARE:
+				registers[instruction.result] = left * left;
+				tangents[instruction.result] = 2.0f * left * leftTangent;
+				break;
+			case NEGATE:
+				registers[instruction.result] = -left;
+				tangents[instruction.result] = -leftTangent;
+				break;
+			case FMA:
+				// leftTangent * right + (left * rightTangent + addendTangent), fused the same way by every backend
+				registers[instruction.result] = fmaf(left, right, registers[instruction.addend]);
+				tangents[instruction.result] = fmaf(leftTangent, right,
+				                                    fmaf(left, rightTangent, tangents[instruction.addend]));
+				break;
+			default:
+				__builtin_unreachable(); // The compiler only emits arithmetic operations
+		}
+	}
+}
+
+void SymbolTapeEvaluateDual(SymbolTape* tape, const float* inputs, const float* inputTangents, float* outputs,
+                            float* outputTangents) {
+	memcpy(tape->registers, inputs, tape->inputCount * sizeof(float));
+	memcpy(tape->tangents, inputTangents, tape->inputCount * sizeof(float));
+
+	SymbolTapeRunDual(tape);
+
+	for (unsigned int i = 0; i < tape->outputCount; ++i) {
+		outputs[i] = tape->registers[tape->outputs[i]];
+		outputTangents[i] = tape->tangents[tape->outputs[i]];
+	}
+}
+
+typedef unsigned int (*SymbolTapeBatchKernel)(SymbolTape* tape, unsigned int count, const float* inputs,
+                                              const float* inputTangents, float* outputs, float* outputTangents);
+
+// Evaluates the sets in groups of width, each register holds one vector of values and one of tangents
+// Returns how many sets were evaluated, the remainder is smaller than width
+#define SYMBOL_TAPE_BATCH_KERNEL(name, width, targetName, fmadd)                                                       \
+typedef float name##Vector __attribute__((vector_size((width) * sizeof(float))));                                      \
+                                                                                                                       \
+/* left * right + addend rounded once in every lane, as fmaf does for the sets evaluated one by one */                 \
+__attribute__((target(targetName)))                                                                                    \
+static inline name##Vector name##Fma(name##Vector left, name##Vector right, name##Vector addend) {                     \
+	name##Vector result;                                                                                               \
+	fmadd(result, width, left, right, addend);                                                                         \
+	return result;                                                                                                     \
+}                                                                                                                      \
+                                                                                                                       \
+__attribute__((target(targetName)))                                                                                    \
+static unsigned int name(SymbolTape* tape, unsigned int count, const float* inputs, const float* inputTangents,        \
+                         float* outputs, float* outputTangents) {                                                      \
+	name##Vector* registers = (name##Vector*) tape->batchRegisters;                                                    \
+	name##Vector* tangents = (name##Vector*) tape->batchTangents;                                                      \
+                                                                                                                       \
+	for (unsigned int i = tape->inputCount; i < tape->registerCount; ++i) {                                            \
+		registers[i] = (name##Vector) { 0 } + tape->registers[i];                                                      \
+		tangents[i] = (name##Vector) { 0 };                                                                            \
+	}                                                                                                                  \
+                                                                                                                       \
+	unsigned int group = 0;                                                                                            \
+	for (; group + (width) <= count; group += (width)) {                                                               \
+		for (unsigned int i = 0; i < tape->inputCount; ++i) {                                                          \
+			memcpy(&registers[i], &inputs[i * count + group], sizeof(name##Vector));                                  \
+			memcpy(&tangents[i], &inputTangents[i * count + group], sizeof(name##Vector));                            \
+		}                                                                                                              \
+                                                                                                                       \
+		for (unsigned int i = 0; i < tape->instructionCount; ++i) {                                                    \
+			const SymbolInstruction instruction = tape->instructions[i];                                               \
+			const name##Vector left = registers[instruction.left];                                                     \
+			const name##Vector right = registers[instruction.right];                                                   \
+			const name##Vector leftTangent = tangents[instruction.left];                                               \
+			const name##Vector rightTangent = tangents[instruction.right];                                             \
+                                                                                                                       \
+			switch(instruction.operation) {                                                                            \
+				case ADD:                                                                                              \
+					registers[instruction.result] = left + right;                                                      \
+					tangents[instruction.result] = leftTangent + rightTangent;                                         \
+					break;                                                                                             \
+				case SUSTRACT:                                                                                         \
+					registers[instruction.result] = left - right;                                                      \
+					tangents[instruction.result] = leftTangent - rightTangent;                                         \
+					break;                                                                                             \
+				case MULTIPLY:                                                                                         \
+					registers[instruction.result] = left * right;                                                      \
+					tangents[instruction.result] = leftTangent * right + left * rightTangent;                          \
+					break;                                                                                             \
+				case SQUARE:                                                                                           \
+					registers[instruction.result] = left * left;                                                       \
+					tangents[instruction.result] = 2.0f * left * leftTangent;                                          \
+					break;                                                                                             \
+				case NEGATE:                                                                                           \
+					registers[instruction.result] = -left;                                                             \
+					tangents[instruction.result] = -leftTangent;                                                       \
+					break;                                                                                             \
+				case FMA: {                                                                                            \
+					const name##Vector inner = name##Fma(left, rightTangent, tangents[instruction.addend]);            \
+					registers[instruction.result] = name##Fma(left, right, registers[instruction.addend]);             \
+					tangents[instruction.result] = name##Fma(leftTangent, right, inner);                               \
+					break;                                                                                             \
+				}                                                                                                      \
+				default:                                                                                               \
+					__builtin_unreachable(); /* The compiler only emits arithmetic operations */                       \
+			}                                                                                                          \
+		}                                                                                                              \
+                                                                                                                       \
+		for (unsigned int i = 0; i < tape->outputCount; ++i) {                                                         \
+			memcpy(&outputs[i * count + group], &registers[tape->outputs[i]], sizeof(name##Vector));                  \
+			memcpy(&outputTangents[i * count + group], &tangents[tape->outputs[i]], sizeof(name##Vector));            \
+		}                                                                                                              \
+	}                                                                                                                  \
+                                                                                                                       \
+	return group;                                                                                                      \
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// SSE has no fused multiply add, every lane goes through fmaf, the other targets have an instruction for it
+#define SYMBOL_TAPE_FMADD_LANES(result, width, left, right, addend)                                                    \
+	for (unsigned int lane = 0; lane < (width); ++lane) {                                                              \
+		(result)[lane] = __builtin_fmaf((left)[lane], (right)[lane], (addend)[lane]);                                  \
+	}
+#define SYMBOL_TAPE_FMADD_AVX2(result, width, left, right, addend)                                                     \
+	(result) = (typeof(result)) _mm256_fmadd_ps((__m256) (left), (__m256) (right), (__m256) (addend))
+#define SYMBOL_TAPE_FMADD_AVX512(result, width, left, right, addend)                                                   \
+	(result) = (typeof(result)) _mm512_fmadd_ps((__m512) (left), (__m512) (right), (__m512) (addend))
+
+SYMBOL_TAPE_BATCH_KERNEL(SymbolTapeBatchSse, 4, "sse2", SYMBOL_TAPE_FMADD_LANES)
+SYMBOL_TAPE_BATCH_KERNEL(SymbolTapeBatchAvx2, 8, "avx2,fma", SYMBOL_TAPE_FMADD_AVX2)
+SYMBOL_TAPE_BATCH_KERNEL(SymbolTapeBatchAvx512, 16, "avx512f", SYMBOL_TAPE_FMADD_AVX512)
+#endif
+
+static SymbolTapeBatchKernel SymbolTapeSelectBatchKernel() {
+#if defined(__x86_64__) || defined(__i386__)
+	if(__builtin_cpu_supports("avx512f")) {
+		return SymbolTapeBatchAvx512;
+	}
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return SymbolTapeBatchAvx2;
+	}
+	if(__builtin_cpu_supports("sse2")) {
+		return SymbolTapeBatchSse;
+	}
+#endif
+	return NULL;
+}
+
+// Kernel for this processor, selected by the first batch evaluated, threads racing to select it store the same one
+// Only processors without SSE2 have no kernel and select again on every batch
+static SymbolTapeBatchKernel symbolTapeBatchKernel = NULL;
+
+void SymbolTapeEvaluateDualBatch(SymbolTape* tape, unsigned int count, const float* inputs, const float* inputTangents,
+                                 float* outputs, float* outputTangents) {
+	SymbolTapeBatchKernel kernel = __atomic_load_n(&symbolTapeBatchKernel, __ATOMIC_RELAXED);
+	if(kernel == NULL) {
+		kernel = SymbolTapeSelectBatchKernel();
+		__atomic_store_n(&symbolTapeBatchKernel, kernel, __ATOMIC_RELAXED);
+	}
+	const unsigned int evaluated = kernel != NULL ? kernel(tape, count, inputs, inputTangents, outputs, outputTangents) : 0;
+
+	for (unsigned int j = evaluated; j < count; ++j) {
+		for (unsigned int i = 0; i < tape->inputCount; ++i) {
+			tape->registers[i] = inputs[i * count + j];
+			tape->tangents[i] = inputTangents[i * count + j];
+		}
+
+		SymbolTapeRunDual(tape);
+
+		for (unsigned int i = 0; i < tape->outputCount; ++i) {
+			outputs[i * count + j] = tape->registers[tape->outputs[i]];
+			outputTangents[i * count + j] = tape->tangents[tape->outputs[i]];
+		}
+	}
+}
+
+void SymbolTapePrint(SymbolTape* tape) {
+	TraceLog(LOG_DEBUG, "tape: %u inputs, %u registers, %u instructions, %u outputs", tape->inputCount,
+	         tape->registerCount, tape->instructionCount, tape->outputCount);
+
+	for (unsigned int i = 0; i < tape->instructionCount; ++i) {
+		const SymbolInstruction instruction = tape->instructions[i];
+		const char* operation;
+		switch(instruction.operation) {
+			case ADD:
+				operation = "+";
+				break;
+			case SUSTRACT:
+				operation = "-";
+				break;
+			case MULTIPLY:
+				operation = "*";
+				break;
+			case SQUARE:
+				TraceLog(LOG_DEBUG, "r_%u = r_%u^2", instruction.result, instruction.left);
+				continue;
+			case NEGATE:
+				TraceLog(LOG_DEBUG, "r_%u = -r_%u", instruction.result, instruction.left);
+				continue;
+			case FMA:
+				TraceLog(LOG_DEBUG, "r_%u = r_%u * r_%u + r_%u", instruction.result, instruction.left, instruction.right,
+				         instruction.addend);
+				continue;
+			default:
+				__builtin_unreachable(); // The compiler only emits arithmetic operations
+		}
+		TraceLog(LOG_DEBUG, "r_%u = r_%u %s r_%u", instruction.result, instruction.left, operation, instruction.right);
+	}
+}
+
+// Writes the value or the tangent of a register as a C expression
+// Registers neither input nor written by an instruction are constants, their tangent is never referenced
+static void SymbolTapeGenerateRegister(SymbolTape* tape, const bool* written, unsigned int index, bool tangent,
+                                       FILE* file) {
+	if(index < tape->inputCount) {
+		fprintf(file, "%s[%u * n + j]", tangent ? "inputTangents" : "inputs", index);
+	} else if(written[index]) {
+		fprintf(file, "%c%u", tangent ? 'd' : 'r', index);
+	} else {
+		assert(__builtin_isfinite(tape->registers[index]), "Constant can not be written as C!");
+		fprintf(file, "(%af)", tape->registers[index]);
+	}
+}
+
+void SymbolTapeGenerateC(SymbolTape* tape, const char* name, FILE* file) {
+	// Registers written by an instruction and registers known to have a zero tangent, constants and anything built
+	// only from constants, whose tangent terms are dropped instead of multiplied by 0
+	bool* written = calloc(tape->registerCount, sizeof(bool));
+	bool* zeroTangent = calloc(tape->registerCount, sizeof(bool));
+	assert(written != NULL && zeroTangent != NULL, "No memory!");
+
+	for (unsigned int i = 0; i < tape->instructionCount; ++i) {
+		written[tape->instructions[i].result] = true;
+	}
+	for (unsigned int i = tape->inputCount; i < tape->registerCount; ++i) {
+		zeroTangent[i] = !written[i];
+	}
+
+	// Cloned for the same instruction sets as the batch kernels, picked when the program is loaded
+	// The FMA clone stands in for AVX2, FMA implies the AVX float arithmetic the kernels use and runs their fused
+	// multiply adds as single instructions, the default clone calls fmaf for them
+	fprintf(file, "#if defined(__x86_64__) || defined(__i386__)\n"
+	              "__attribute__((target_clones(\"avx512f\", \"fma\", \"default\")))\n"
+	              "#endif\n");
+	fprintf(file, "static void %s(unsigned int count, const float* restrict inputs, const float* restrict inputTangents,\n"
+	              "\t\tfloat* restrict outputs, float* restrict outputTangents) {\n", name);
+	// Indexing with size_t keeps the addresses affine in j, unsigned int wrap around would prevent vectorization
+	// Rows of the same buffer never overlap, but there are too many of them for the compiler to check at runtime
+	fprintf(file, "\tconst size_t n = count;\n");
+	fprintf(file, "\t#pragma GCC ivdep\n");
+	fprintf(file, "\tfor (size_t j = 0; j < n; ++j) {\n");
+
+	for (unsigned int i = 0; i < tape->instructionCount; ++i) {
+		const SymbolInstruction instruction = tape->instructions[i];
+		const bool leftZero = zeroTangent[instruction.left];
+		const bool rightZero = zeroTangent[instruction.right];
+		const bool addendZero = zeroTangent[instruction.addend];
+		const char* operation;
+		switch(instruction.operation) {
+			case ADD:
+				operation = "+";
+				break;
+			case SUSTRACT:
+				operation = "-";
+				break;
+			case MULTIPLY:
+			case SQUARE:
+			case FMA:
+				operation = "*";
+				break;
+			case NEGATE:
+				operation = NULL;
+				break;
+			default:
+				__builtin_unreachable(); // The compiler only emits arithmetic operations
+		}
+
+		fprintf(file, "\t\tconst float r%u = ", instruction.result);
+		if(instruction.operation == FMA) {
+			fprintf(file, "__builtin_fmaf(");
+			SymbolTapeGenerateRegister(tape, written, instruction.left, false, file);
+			fprintf(file, ", ");
+			SymbolTapeGenerateRegister(tape, written, instruction.right, false, file);
+			fprintf(file, ", ");
+			SymbolTapeGenerateRegister(tape, written, instruction.addend, false, file);
+			fprintf(file, ")");
+		} else if(operation != NULL) {
+			SymbolTapeGenerateRegister(tape, written, instruction.left, false, file);
+			fprintf(file, " %s ", operation);
+			SymbolTapeGenerateRegister(tape, written, instruction.right, false, file);
+		} else {
+			fprintf(file, "-");
+			SymbolTapeGenerateRegister(tape, written, instruction.left, false, file);
+		}
+		fprintf(file, ";\n");
+
+		zeroTangent[instruction.result] = leftZero && rightZero && (instruction.operation != FMA || addendZero);
+		if(zeroTangent[instruction.result]) {
+			continue;
+		}
+
+		fprintf(file, "\t\tconst float d%u = ", instruction.result);
+		switch(instruction.operation) {
+			case ADD:
+			case SUSTRACT:
+				if(leftZero) {
+					fprintf(file, "%s", instruction.operation == SUSTRACT ? "-" : "");
+					SymbolTapeGenerateRegister(tape, written, instruction.right, true, file);
+				} else if(rightZero) {
+					SymbolTapeGenerateRegister(tape, written, instruction.left, true, file);
+				} else {
+					SymbolTapeGenerateRegister(tape, written, instruction.left, true, file);
+					fprintf(file, " %s ", operation);
+					SymbolTapeGenerateRegister(tape, written, instruction.right, true, file);
+				}
+				break;
+			case MULTIPLY:
+				if(!leftZero) {
+					SymbolTapeGenerateRegister(tape, written, instruction.left, true, file);
+					fprintf(file, " * ");
+					SymbolTapeGenerateRegister(tape, written, instruction.right, false, file);
+				}
+				if(!leftZero && !rightZero) {
+					fprintf(file, " + ");
+				}
+				if(!rightZero) {
+					SymbolTapeGenerateRegister(tape, written, instruction.left, false, file);
+					fprintf(file, " * ");
+					SymbolTapeGenerateRegister(tape, written, instruction.right, true, file);
+				}
+				break;
+			case SQUARE:
+				fprintf(file, "2.0f * ");
+				SymbolTapeGenerateRegister(tape, written, instruction.left, false, file);
+				fprintf(file, " * ");
+				SymbolTapeGenerateRegister(tape, written, instruction.left, true, file);
+				break;
+			case NEGATE:
+				fprintf(file, "-");
+				SymbolTapeGenerateRegister(tape, written, instruction.left, true, file);
+				break;
+			case FMA: {
+				// fmaf(leftTangent, right, fmaf(left, rightTangent, addendTangent)) like the interpreter, a zero
+				// tangent leaves its product out, which rounds the same
+				const bool inner = !rightZero || !addendZero;
+				if(!leftZero) {
+					fprintf(file, inner ? "__builtin_fmaf(" : "");
+					SymbolTapeGenerateRegister(tape, written, instruction.left, true, file);
+					fprintf(file, inner ? ", " : " * ");
+					SymbolTapeGenerateRegister(tape, written, instruction.right, false, file);
+					fprintf(file, inner ? ", " : "");
+				}
+				if(!rightZero) {
+					fprintf(file, !addendZero ? "__builtin_fmaf(" : "");
+					SymbolTapeGenerateRegister(tape, written, instruction.left, false, file);
+					fprintf(file, !addendZero ? ", " : " * ");
+					SymbolTapeGenerateRegister(tape, written, instruction.right, true, file);
+					fprintf(file, !addendZero ? ", " : "");
+				}
+				if(!addendZero) {
+					SymbolTapeGenerateRegister(tape, written, instruction.addend, true, file);
+				}
+				if(!rightZero && !addendZero) {
+					fprintf(file, ")");
+				}
+				if(!leftZero && inner) {
+					fprintf(file, ")");
+				}
+				break;
+			}
+			default:
+				__builtin_unreachable();
+		}
+		fprintf(file, ";\n");
+	}
+
+	for (unsigned int i = 0; i < tape->outputCount; ++i) {
+		const unsigned int output = tape->outputs[i];
+
+		fprintf(file, "\t\toutputs[%u * n + j] = ", i);
+		SymbolTapeGenerateRegister(tape, written, output, false, file);
+		fprintf(file, ";\n");
+
+		fprintf(file, "\t\toutputTangents[%u * n + j] = ", i);
+		if(zeroTangent[output]) {
+			fprintf(file, "0.0f");
+		} else {
+			SymbolTapeGenerateRegister(tape, written, output, true, file);
+		}
+		fprintf(file, ";\n");
+	}
+
+	fprintf(file, "\t}\n}\n");
+
+	free(written);
+	free(zeroTangent);
+}
+
+//----------------------------------------------------------------------------------
+// SymbolJit
+//----------------------------------------------------------------------------------
+
+#if defined(__x86_64__) && !defined(_WIN32)
+
+// Every tape register has a slot for its value and one for its tangent in the scratch memory of the JIT, wide
+// enough for the 8 lanes of an AVX register
+#define SYMBOL_JIT_SLOT_SIZE 32
+
+typedef struct SymbolJitBuffer {
+	unsigned char* start;
+	size_t capacity;
+	size_t size;
+} SymbolJitBuffer;
+
+// Encoding of the SSE operations, scalar ones on a single lane and packed ones on 4 or 8
+// Fused multiply adds are only emitted with fma, which needs vex
+typedef struct SymbolJitForm {
+	bool vex;
+	bool scalar;
+	unsigned int lanes;
+	bool fma;
+} SymbolJitForm;
+
+enum {
+	SYMBOL_JIT_MOV_LOAD = 0x10,                                                                 // movss, movups
+	SYMBOL_JIT_MOV_STORE = 0x11,
+	SYMBOL_JIT_ADD = 0x58,                                                                      // addss, addps
+	SYMBOL_JIT_MULTIPLY = 0x59,                                                                 // mulss, mulps
+	SYMBOL_JIT_SUBTRACT = 0x5C,                                                                 // subss, subps
+	SYMBOL_JIT_XOR = 0x57,                                                                      // xorps
+	SYMBOL_JIT_FMA_PACKED = 0xB8,                                                               // vfmadd231ps
+	SYMBOL_JIT_FMA_SCALAR = 0xB9,                                                               // vfmadd231ss
+};
+
+static void SymbolJitEmit(SymbolJitBuffer* buffer, const unsigned char* bytes, size_t count) {
+	if(buffer->size + count > buffer->capacity) {
+		buffer->capacity = buffer->capacity == 0 ? 256 : buffer->capacity * 2;
+		buffer->start = realloc(buffer->start, buffer->capacity);
+		assert(buffer->start != NULL, "No memory!");
+	}
+
+	memcpy(buffer->start + buffer->size, bytes, count);
+	buffer->size += count;
+}
+
+static void SymbolJitEmit32(SymbolJitBuffer* buffer, uint32_t value) {
+	const unsigned char bytes[] = { value, value >> 8, value >> 16, value >> 24 };
+	SymbolJitEmit(buffer, bytes, sizeof(bytes));
+}
+
+// Emits opcode with xmm as the register operand, modrm selects the other one
+// With VEX arithmetic reads xmm as its first source, the legacy encoding always does
+static void SymbolJitEmitOperation(SymbolJitBuffer* buffer, SymbolJitForm form, unsigned char opcode, unsigned int xmm,
+                                   unsigned char modrm) {
+	const bool arithmetic = opcode != SYMBOL_JIT_MOV_LOAD && opcode != SYMBOL_JIT_MOV_STORE;
+
+	if(form.vex) {
+		const unsigned int source = arithmetic ? (~xmm & 0xF) : 0xF;
+		const unsigned char bytes[] = { 0xC5, 0x80 | (source << 3) | (form.lanes == 8 ? 0x04 : 0) | (form.scalar ? 0x02 : 0),
+		                                opcode, modrm };
+		SymbolJitEmit(buffer, bytes, sizeof(bytes));
+	} else if(form.scalar) {
+		const unsigned char bytes[] = { 0xF3, 0x0F, opcode, modrm };
+		SymbolJitEmit(buffer, bytes, sizeof(bytes));
+	} else {
+		const unsigned char bytes[] = { 0x0F, opcode, modrm };
+		SymbolJitEmit(buffer, bytes, sizeof(bytes));
+	}
+}
+
+// vfmadd231 xmm, source, other, xmm += source * other, in the three byte VEX form of the 0F38 map with the 66 prefix
+// operand is the modrm byte selecting the other operand, xmm is added to it as the register operand
+static void SymbolJitEmitFma(SymbolJitBuffer* buffer, SymbolJitForm form, unsigned int xmm, unsigned int source,
+                             unsigned char operand) {
+	assert(form.fma, "Fused multiply add is not available!");
+
+	const unsigned char bytes[] = { 0xC4, 0xE2, ((~source & 0xF) << 3) | (form.lanes == 8 ? 0x04 : 0) | 0x01,
+	                                form.scalar ? SYMBOL_JIT_FMA_SCALAR : SYMBOL_JIT_FMA_PACKED, operand | (xmm << 3) };
+	SymbolJitEmit(buffer, bytes, sizeof(bytes));
+}
+
+// vfmadd231 xmm, source, [rdi + offset]
+static void SymbolJitEmitFmaSlot(SymbolJitBuffer* buffer, SymbolJitForm form, unsigned int xmm, unsigned int source,
+                                 uint32_t offset) {
+	SymbolJitEmitFma(buffer, form, xmm, source, 0x87);
+	SymbolJitEmit32(buffer, offset);
+}
+
+// vfmadd231 xmm, source, other
+static void SymbolJitEmitFmaRegister(SymbolJitBuffer* buffer, SymbolJitForm form, unsigned int xmm, unsigned int source,
+                                     unsigned int other) {
+	SymbolJitEmitFma(buffer, form, xmm, source, 0xC0 | other);
+}
+
+// op xmm, [rdi + offset], rdi holds the scratch memory
+static void SymbolJitEmitSlot(SymbolJitBuffer* buffer, SymbolJitForm form, unsigned char opcode, unsigned int xmm,
+                              uint32_t offset) {
+	SymbolJitEmitOperation(buffer, form, opcode, xmm, 0x87 | (xmm << 3));
+	SymbolJitEmit32(buffer, offset);
+}
+
+// op xmm, other
+static void SymbolJitEmitRegister(SymbolJitBuffer* buffer, SymbolJitForm form, unsigned char opcode, unsigned int xmm,
+                                  unsigned int other) {
+	SymbolJitEmitOperation(buffer, form, opcode, xmm, 0xC0 | (xmm << 3) | other);
+}
+
+// Copies rows between a batch buffer and the scratch memory, one row of the batch is count floats apart
+// rex and sib select the argument register holding the buffer, r9 is the offset of the current set
+static void SymbolJitEmitRows(SymbolJitBuffer* buffer, SymbolJitForm form, unsigned char rex, unsigned char sib,
+                              const unsigned int* registers, unsigned int registerCount, uint32_t offset, bool load) {
+	const unsigned char lea[] = { rex, 0x8D, 0x04, sib };                                       // lea rax, [base + r9]
+	const unsigned char addStride[] = { 0x4C, 0x01, 0xD8 };                                     // add rax, r11
+	SymbolJitEmit(buffer, lea, sizeof(lea));
+
+	for (unsigned int i = 0; i < registerCount; ++i) {
+		const uint32_t slot = offset + registers[i] * SYMBOL_JIT_SLOT_SIZE;
+
+		if(load) {
+			SymbolJitEmitOperation(buffer, form, SYMBOL_JIT_MOV_LOAD, 0, 0x00);                // mov xmm0, [rax]
+			SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_STORE, 0, slot);
+		} else {
+			SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_LOAD, 0, slot);
+			SymbolJitEmitOperation(buffer, form, SYMBOL_JIT_MOV_STORE, 0, 0x00);               // mov [rax], xmm0
+		}
+		SymbolJitEmit(buffer, addStride, sizeof(addStride));
+	}
+}
+
+// Evaluates form.lanes sets of inputs starting at the set r9 points to
+static void SymbolJitEmitBody(SymbolTape* tape, SymbolJitBuffer* buffer, SymbolJitForm form, unsigned int* registers) {
+	// Values of all registers come first, then their tangents
+	const uint32_t tangentOffset = tape->registerCount * SYMBOL_JIT_SLOT_SIZE;
+
+	// Register i is input i
+	for (unsigned int i = 0; i < tape->inputCount; ++i) {
+		registers[i] = i;
+	}
+	SymbolJitEmitRows(buffer, form, 0x4A, 0x0E, registers, tape->inputCount, 0, true);                        // rsi
+	SymbolJitEmitRows(buffer, form, 0x4A, 0x0A, registers, tape->inputCount, tangentOffset, true);            // rdx
+
+	for (unsigned int i = 0; i < tape->instructionCount; ++i) {
+		const SymbolInstruction instruction = tape->instructions[i];
+		const uint32_t left = instruction.left * SYMBOL_JIT_SLOT_SIZE;
+		const uint32_t right = instruction.right * SYMBOL_JIT_SLOT_SIZE;
+		const uint32_t addend = instruction.addend * SYMBOL_JIT_SLOT_SIZE;
+		const uint32_t result = instruction.result * SYMBOL_JIT_SLOT_SIZE;
+
+		switch(instruction.operation) {
+			case ADD:
+			case SUSTRACT: {
+				const unsigned char opcode = instruction.operation == ADD ? SYMBOL_JIT_ADD : SYMBOL_JIT_SUBTRACT;
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_LOAD, 0, left);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_LOAD, 1, tangentOffset + left);
+				SymbolJitEmitSlot(buffer, form, opcode, 0, right);
+				SymbolJitEmitSlot(buffer, form, opcode, 1, tangentOffset + right);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_STORE, 0, result);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_STORE, 1, tangentOffset + result);
+				break;
+			}
+			case MULTIPLY:
+				// leftTangent * right + left * rightTangent, like the interpreter
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_LOAD, 0, left);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_LOAD, 1, tangentOffset + left);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_LOAD, 2, tangentOffset + right);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MULTIPLY, 1, right);
+				SymbolJitEmitRegister(buffer, form, SYMBOL_JIT_MULTIPLY, 2, 0);
+				SymbolJitEmitRegister(buffer, form, SYMBOL_JIT_ADD, 1, 2);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MULTIPLY, 0, right);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_STORE, 0, result);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_STORE, 1, tangentOffset + result);
+				break;
+			case SQUARE:
+				// 2 * left * leftTangent as (left * leftTangent) + (left * leftTangent)
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_LOAD, 0, left);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_LOAD, 1, tangentOffset + left);
+				SymbolJitEmitRegister(buffer, form, SYMBOL_JIT_MULTIPLY, 1, 0);
+				SymbolJitEmitRegister(buffer, form, SYMBOL_JIT_ADD, 1, 1);
+				SymbolJitEmitRegister(buffer, form, SYMBOL_JIT_MULTIPLY, 0, 0);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_STORE, 0, result);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_STORE, 1, tangentOffset + result);
+				break;
+			case NEGATE: {
+				// 0 - left, xorps has no scalar form but clearing the whole register is the same
+				const SymbolJitForm clear = { .vex = form.vex, .scalar = false, .lanes = form.lanes == 8 ? 8 : 4 };
+				SymbolJitEmitRegister(buffer, clear, SYMBOL_JIT_XOR, 0, 0);
+				SymbolJitEmitRegister(buffer, clear, SYMBOL_JIT_XOR, 1, 1);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_SUBTRACT, 0, left);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_SUBTRACT, 1, tangentOffset + left);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_STORE, 0, result);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_STORE, 1, tangentOffset + result);
+				break;
+			}
+			case FMA: {
+				// leftTangent * right + (left * rightTangent + addendTangent), like the interpreter
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_LOAD, 0, left);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_LOAD, 1, tangentOffset + addend);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_LOAD, 2, tangentOffset + right);
+				SymbolJitEmitFmaRegister(buffer, form, 1, 0, 2);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_LOAD, 2, tangentOffset + left);
+				SymbolJitEmitFmaSlot(buffer, form, 1, 2, right);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_LOAD, 2, addend);
+				SymbolJitEmitFmaSlot(buffer, form, 2, 0, right);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_STORE, 2, result);
+				SymbolJitEmitSlot(buffer, form, SYMBOL_JIT_MOV_STORE, 1, tangentOffset + result);
+				break;
+			}
+			default:
+				__builtin_unreachable(); // The compiler only emits arithmetic operations
+		}
+	}
+
+	for (unsigned int i = 0; i < tape->outputCount; ++i) {
+		registers[i] = tape->outputs[i];
+	}
+	SymbolJitEmitRows(buffer, form, 0x4A, 0x09, registers, tape->outputCount, 0, false);                      // rcx
+	SymbolJitEmitRows(buffer, form, 0x4B, 0x08, registers, tape->outputCount, tangentOffset, false);          // r8
+}
+
+// Patches the rel32 at position to jump to the current end of the code
+static void SymbolJitPatchJump(SymbolJitBuffer* buffer, size_t position) {
+	const uint32_t distance = buffer->size - (position + 4);
+	memcpy(buffer->start + position, &distance, sizeof(distance));
+}
+
+// Arguments are count in edi, inputs in rsi, inputTangents in rdx, outputs in rcx and outputTangents in r8
+// Sets are evaluated in packed lanes while there are enough of them left, then one at a time
+static void SymbolJitCompile(SymbolTape* tape, SymbolJitBuffer* buffer, void* scratch, bool avx, bool fma) {
+	const SymbolJitForm packed = { .vex = avx, .scalar = false, .lanes = avx ? 8 : 4, .fma = avx && fma };
+	const SymbolJitForm scalar = { .vex = avx, .scalar = true, .lanes = 1, .fma = avx && fma };
+
+	unsigned int* registers = calloc(tape->inputCount > tape->outputCount ? tape->inputCount : tape->outputCount,
+	                                 sizeof(unsigned int));
+	assert(registers != NULL, "No memory!");
+
+	const unsigned char setup[] = {
+		0x41, 0x89, 0xFB,                                                                       // mov r11d, edi
+		0x49, 0xC1, 0xE3, 0x02,                                                                 // shl r11, 2
+		0x45, 0x31, 0xC9,                                                                       // xor r9d, r9d
+		0x41, 0x89, 0xFA,                                                                       // mov r10d, edi
+		0x48, 0xBF,                                                                             // mov rdi, scratch
+	};
+	SymbolJitEmit(buffer, setup, sizeof(setup));
+	const uint64_t address = (uintptr_t) scratch;
+	SymbolJitEmit32(buffer, address);
+	SymbolJitEmit32(buffer, address >> 32);
+
+	const size_t packedLoop = buffer->size;
+	const unsigned char packedCheck[] = {
+		0x49, 0x83, 0xFA, packed.lanes,                                                         // cmp r10, lanes
+		0x0F, 0x82,                                                                             // jb scalar
+	};
+	SymbolJitEmit(buffer, packedCheck, sizeof(packedCheck));
+	const size_t scalarJump = buffer->size;
+	SymbolJitEmit32(buffer, 0);
+
+	SymbolJitEmitBody(tape, buffer, packed, registers);
+
+	const unsigned char packedNext[] = {
+		0x49, 0x83, 0xC1, packed.lanes * 4,                                                     // add r9, lanes * 4
+		0x49, 0x83, 0xEA, packed.lanes,                                                         // sub r10, lanes
+		0xE9,                                                                                   // jmp packed
+	};
+	SymbolJitEmit(buffer, packedNext, sizeof(packedNext));
+	SymbolJitEmit32(buffer, (uint32_t) (packedLoop - (buffer->size + 4)));
+
+	SymbolJitPatchJump(buffer, scalarJump);
+	const unsigned char scalarCheck[] = {
+		0x4D, 0x85, 0xD2,                                                                       // test r10, r10
+		0x0F, 0x84,                                                                             // jz end
+	};
+	SymbolJitEmit(buffer, scalarCheck, sizeof(scalarCheck));
+	const size_t endJump = buffer->size;
+	SymbolJitEmit32(buffer, 0);
+
+	const size_t scalarLoop = buffer->size;
+	SymbolJitEmitBody(tape, buffer, scalar, registers);
+
+	const unsigned char scalarNext[] = {
+		0x49, 0x83, 0xC1, 0x04,                                                                 // add r9, 4
+		0x49, 0xFF, 0xCA,                                                                       // dec r10
+		0x0F, 0x85,                                                                             // jnz scalar
+	};
+	SymbolJitEmit(buffer, scalarNext, sizeof(scalarNext));
+	SymbolJitEmit32(buffer, (uint32_t) (scalarLoop - (buffer->size + 4)));
+
+	SymbolJitPatchJump(buffer, endJump);
+	if(avx) {
+		const unsigned char vzeroupper[] = { 0xC5, 0xF8, 0x77 };                                // vzeroupper
+		SymbolJitEmit(buffer, vzeroupper, sizeof(vzeroupper));
+	}
+	const unsigned char ret[] = { 0xC3 };                                                       // ret
+	SymbolJitEmit(buffer, ret, sizeof(ret));
+
+	free(registers);
+}
+
+SymbolJit* SymbolJitCreate(SymbolTape* tape) {
+	__builtin_cpu_init();
+	const bool avx = __builtin_cpu_supports("avx");
+	const bool fma = avx && __builtin_cpu_supports("fma");
+
+	// Rounding FMA twice would give other results than the interpreters, those tapes are left to them
+	for (unsigned int i = 0; i < tape->instructionCount && !fma; ++i) {
+		if(tape->instructions[i].operation == FMA) {
+			return NULL;
+		}
+	}
+
+	// Constants are broadcast to every lane of their slot once, with a zero tangent, the code never writes them
+	const size_t scratchSize = (size_t) tape->registerCount * 2 * SYMBOL_JIT_SLOT_SIZE;
+	float* scratch = aligned_alloc(SYMBOL_JIT_SLOT_SIZE, scratchSize);
+	assert(scratch != NULL, "No memory!");
+	memset(scratch, 0, scratchSize);
+	for (unsigned int i = tape->inputCount; i < tape->registerCount; ++i) {
+		for (unsigned int j = 0; j < SYMBOL_JIT_SLOT_SIZE / sizeof(float); ++j) {
+			scratch[i * SYMBOL_JIT_SLOT_SIZE / sizeof(float) + j] = tape->registers[i];
+		}
+	}
+
+	SymbolJitBuffer buffer = { 0 };
+	SymbolJitCompile(tape, &buffer, scratch, avx, fma);
+
+	// Written while writable, then switched to executable so the page is never both
+	const size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+	const size_t size = (buffer.size + pageSize - 1) / pageSize * pageSize;
+	void* code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(code == MAP_FAILED) {
+		free(buffer.start);
+		free(scratch);
+		return NULL;
+	}
+
+	memcpy(code, buffer.start, buffer.size);
+	free(buffer.start);
+
+	if(mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(code, size);
+		free(scratch);
+		return NULL;
+	}
+
+	SymbolJit* jit = malloc(sizeof(SymbolJit));
+	assert(jit != NULL, "No memory!");
+	*jit = (SymbolJit) {
+		.code = code,
+		.size = size,
+		.scratch = scratch,
+	};
+	// Object to function pointer conversion is the point of a JIT, POSIX guarantees it works
+	memcpy(&jit->function, &code, sizeof(code));
+
+	return jit;
+}
+
+void SymbolJitFree(SymbolJit* jit) {
+	munmap(jit->code, jit->size);
+	free(jit->scratch);
+	free(jit);
+}
+
+#else
+
+SymbolJit* SymbolJitCreate(SymbolTape* tape) {
+	(void) tape;
+	return NULL;
+}
+
+void SymbolJitFree(SymbolJit* jit) {
+	free(jit);
+}
+
+#endif
@@ -1,8 +1,13 @@
 #ifndef SIMULATOR_SYMDIFF_H
 #define SIMULATOR_SYMDIFF_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#include "arena.h"
+
 //-----------------------------------------------------------------------------
 // SymbolNode
 //-----------------------------------------------------------------------------
@@ -13,6 +18,13 @@ typedef enum Operation {
 	ADD,
 	SUSTRACT,
 	MULTIPLY,
+	// Unary, the operand is the left child and the right one is NULL
+	SQUARE,
+	NEGATE,
+	// left * right + addend, rounded once where the hardware can
+	FMA,
+	// Sum of the products of n pairs of factors, a sum of n terms when every left factor is the constant 1
+	DOT,
 } Operation;
 
 struct SymbolNode;
@@ -25,14 +37,46 @@ typedef struct SymbolNode {
 		struct {
 			struct SymbolNode* left;
 			struct SymbolNode* right;
+			// Only set for FMA, NULL otherwise
+			struct SymbolNode* addend;
 		} children;
+		// Both arrays of factors live in the arena of the node, right follows left
+		struct {
+			struct SymbolNode** left;
+			struct SymbolNode** right;
+			unsigned int count;
+		} dot;
 	} data;
 } SymbolNode;
 
+// Work stack of the passes over a DAG, which are iterative so expression depth is only limited by memory
+// The state of an entry is up to the pass that pushed it
+typedef struct SymbolNodeStackEntry {
+	SymbolNode* node;
+	unsigned int state;
+} SymbolNodeStackEntry;
+
+typedef struct SymbolNodeStack {
+	SymbolNodeStackEntry* start;
+	size_t capacity;
+	size_t size;
+} SymbolNodeStack;
+
+// Constants and operations are interned, structurally identical nodes are the same pointer, so expressions are DAGs
+// Nodes are allocated next to each other in the arena and released all together
+// The array holds all the state of the symbolic layer, different arrays can be used on different threads at once
 typedef struct SymbolNodeArray {
+	Arena* arena;
 	SymbolNode **start;
 	size_t capacity;
 	size_t size;
+	SymbolNode **internTable;
+	size_t internCapacity;
+	size_t internSize;
+	// Variables are numbered in the order they are created in this array
+	unsigned int variableCount;
+	// Reused by every pass over nodes of this array, so it only grows to the deepest expression once
+	SymbolNodeStack stack;
 } SymbolNodeArray;
 
 SymbolNodeArray* SymbolNodeArrayCreate();
@@ -47,12 +91,47 @@ SymbolNode *SymbolNodeVariable(SymbolNodeArray *array);
 
 SymbolNode* SymbolNodeBinary(SymbolNodeArray* array, Operation operation, SymbolNode* left, SymbolNode* right);
 
+SymbolNode* SymbolNodeUnary(SymbolNodeArray* array, Operation operation, SymbolNode* operand);
+
+SymbolNode* SymbolNodeFma(SymbolNodeArray* array, SymbolNode* left, SymbolNode* right, SymbolNode* addend);
+
+// left[0] * right[0] + ... + left[count - 1] * right[count - 1], the factors are copied
+SymbolNode* SymbolNodeDot(SymbolNodeArray* array, SymbolNode** left, SymbolNode** right, unsigned int count);
+
+// Every node of the DAG is differentiated once, so the derivative is proportional in size to expression
 SymbolNode* SymbolNodeDifferentiate(SymbolNode* expression, SymbolNodeArray* array, SymbolNode* variable);
 
+// Every node of the DAG is evaluated once, constant subexpressions are folded
 SymbolNode* SymbolNodeEvaluate(SymbolNode* expression, SymbolNodeArray* array, SymbolNode *variable, float value);
 
+// Constant folding, removal of additions of 0 and multiplications by 0 or 1, and folding of constant chains
+// Products of a node with itself become SQUARE and subtractions from 0 become NEGATE
+// Terms of DOT with a zero factor are dropped and constant ones folded, FMA with a zero addend becomes MULTIPLY
+SymbolNode* SymbolNodeSimplify(SymbolNode* expression, SymbolNodeArray* array);
+
+// Amount of distinct nodes reachable from expression
+unsigned int SymbolNodeCount(SymbolNode* expression);
+
+// Printed as a tree, shared nodes are repeated, output longer than a log message is cut with "..."
 void SymbolNodePrint(SymbolNode* expression);
 
+// Mark and compact, only the nodes reachable from roots are kept and moved next to each other, in the order they were
+// created, into a new arena, the memory of every other node is returned to the system
+// roots are updated to the moved nodes, NULL roots are skipped, any other pointer to a node of array is invalid afterwards
+// Variables keep their numbering, new variables are numbered after every variable created before
+void SymbolNodeArrayCollect(SymbolNodeArray* array, SymbolNode** roots, size_t rootCount);
+
+// Memory held by the symbolic layer, used is what the nodes and matrices take up in their arenas, reserved is all the
+// memory taken from the system, arena blocks and tables included
+typedef struct SymbolMemoryStatistics {
+	size_t nodeCount;
+	size_t matrixCount;
+	size_t usedBytes;
+	size_t reservedBytes;
+} SymbolMemoryStatistics;
+
+SymbolMemoryStatistics SymbolNodeArrayStatistics(SymbolNodeArray* array);
+
 //-----------------------------------------------------------------------------
 // SymbolMatrix
 //-----------------------------------------------------------------------------
@@ -63,7 +142,9 @@ typedef struct SymbolMatrix {
 	unsigned int rows;
 } SymbolMatrix;
 
+// Matrices and their values live in the arena, nodes in the arena of nodeArray
 typedef struct SymbolMatrixArray {
+	Arena* arena;
 	SymbolMatrix **start;
 	SymbolNodeArray *nodeArray;
 	size_t capacity;
@@ -77,9 +158,15 @@ void SymbolMatrixArrayFree(SymbolMatrixArray* array);
 
 void SymbolMatrixArrayPrint(SymbolMatrixArray* array);
 
-SymbolMatrix *SymbolMatrixCreate(SymbolMatrixArray *array, unsigned int rows, unsigned int cols);
+// Same as SymbolNodeArrayCollect, the matrices in matrixRoots and their values are kept too and every other matrix is
+// released, both kinds of roots are updated to where they are moved
+void SymbolMatrixArrayCollect(SymbolMatrixArray* array, SymbolMatrix** matrixRoots, size_t matrixRootCount,
+                              SymbolNode** nodeRoots, size_t nodeRootCount);
+
+// Matrices and their nodes together
+SymbolMemoryStatistics SymbolMatrixArrayStatistics(SymbolMatrixArray* array);
 
-void SymbolMatrixFree(SymbolMatrix *matrix);
+SymbolMatrix *SymbolMatrixCreate(SymbolMatrixArray *array, unsigned int rows, unsigned int cols);
 
 void SymbolMatrixSet(SymbolMatrix *matrix, unsigned int row, unsigned int col, SymbolNode *value);
 
@@ -93,10 +180,197 @@ SymbolMatrix* SymbolMatrixMultiplyValue(SymbolMatrixArray* array, SymbolMatrix*
 
 SymbolMatrix* SymbolMatrixMultiplyElementWise(SymbolMatrixArray* array, SymbolMatrix* left, SymbolMatrix* right);
 
+SymbolMatrix* SymbolMatrixSquareElementWise(SymbolMatrixArray* array, SymbolMatrix* matrix);
+
+// Sum of the element-wise products as a single DOT node
+SymbolNode* SymbolMatrixDot(SymbolMatrixArray* array, SymbolMatrix* left, SymbolMatrix* right);
+
 SymbolMatrix* SymbolNodeDifferentiateSymbolMatrix(SymbolNode* expression, SymbolMatrixArray* array, SymbolMatrix* variableMatrix);
 
+// Reverse mode, all the derivatives of expression are built in a single backward sweep over its nodes
+SymbolMatrix* SymbolNodeGradientSymbolMatrix(SymbolNode* expression, SymbolMatrixArray* array, SymbolMatrix* variableMatrix);
+
 SymbolMatrix* SymbolMatrixDifferentiateSymbolNode(SymbolMatrix* expression, SymbolMatrixArray* array, SymbolNode* variableMatrix);
 
+SymbolMatrix* SymbolMatrixSimplify(SymbolMatrix* expression, SymbolMatrixArray* array);
+
+// Structural sparsity of a simplified derivative, derivatives with respect to a variable the expression does not
+// depend on simplify to the constant 0, every other value may be nonzero
+// nonzero has a flag for each value in the layout of values, returns how many are set
+unsigned int SymbolMatrixSparsity(SymbolMatrix* expression, bool* nonzero);
+
+unsigned int SymbolMatrixCount(SymbolMatrix* expression);
+
 void SymbolMatrixPrint(SymbolMatrix* expression);
 
+//-----------------------------------------------------------------------------
+// SymbolGraph
+//-----------------------------------------------------------------------------
+
+// Compact node of a SymbolGraph, children are indices of nodes before it in the same graph
+// Unary operations only use the left child, the right one repeats it
+// Operations with more than two operands keep them in the factors of the graph from first: DOT has count left
+// factors followed by count right ones, FMA has count 1 and its left, right and addend
+typedef struct SymbolGraphNode {
+	uint32_t operation;
+	union {
+		float value;
+		uint32_t input;
+		struct {
+			uint32_t left;
+			uint32_t right;
+		} children;
+		struct {
+			uint32_t first;
+			uint32_t count;
+		} factors;
+	} data;
+} SymbolGraphNode;
+
+_Static_assert(sizeof(SymbolGraphNode) <= 12, "SymbolGraphNode has to stay 12 bytes or less");
+
+// Set of expressions stored as one block without pointers, so it can be copied, written and mapped as is
+// Nodes are in topological order, evaluation is a single linear pass over them
+// Variables are replaced by the index of their input, the output indices follow the nodes and the node indices of the
+// factors of every DOT and FMA follow the outputs
+typedef struct SymbolGraph {
+	uint32_t nodeCount;
+	uint32_t inputCount;
+	uint32_t outputCount;
+	uint32_t factorCount;
+	SymbolGraphNode nodes[];
+} SymbolGraph;
+
+SymbolGraph* SymbolGraphCreate(SymbolNode** inputs, unsigned int inputCount, SymbolNode** outputs,
+                               unsigned int outputCount);
+
+void SymbolGraphFree(SymbolGraph* graph);
+
+// Bytes of the whole block
+size_t SymbolGraphSize(const SymbolGraph* graph);
+
+uint32_t* SymbolGraphOutputs(const SymbolGraph* graph);
+
+uint32_t* SymbolGraphFactors(const SymbolGraph* graph);
+
+// values has room for one float per node
+void SymbolGraphEvaluate(const SymbolGraph* graph, const float* inputs, float* values, float* outputs);
+
+// Same as SymbolMatrixSparsity for the outputs of the graph, nonzero has a flag for each output
+unsigned int SymbolGraphSparsity(const SymbolGraph* graph, bool* nonzero);
+
+// Rebuilds the expressions as nodes of array in terms of the given input variables
+void SymbolGraphToNodes(const SymbolGraph* graph, SymbolNodeArray* array, SymbolNode** inputs, SymbolNode** outputs);
+
+// Bumped whenever the layout of SymbolGraphFileHeader or SymbolGraph changes
+#define SYMBOL_GRAPH_FILE_VERSION 3
+
+// On disk a graph is this header followed by its block
+// The key is chosen by the writer, a file is only opened with the key it was written with
+typedef struct SymbolGraphFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint64_t size;
+} SymbolGraphFileHeader;
+
+// Graph file mapped into memory, graph points into the mapping and is used in place
+typedef struct SymbolGraphFile {
+	void* mapping;
+	size_t mappingSize;
+	const SymbolGraph* graph;
+} SymbolGraphFile;
+
+bool SymbolGraphWrite(const SymbolGraph* graph, uint64_t key, const char* path);
+
+// NULL when the file is missing, has another version or key, or does not hold a valid graph
+SymbolGraphFile* SymbolGraphFileOpen(const char* path, uint64_t key);
+
+void SymbolGraphFileClose(SymbolGraphFile* file);
+
+//-----------------------------------------------------------------------------
+// SymbolTape
+//-----------------------------------------------------------------------------
+
+#define SYMBOL_TAPE_MAX_BATCH_WIDTH 16
+
+// Unary operations read left only, right is the same register
+// Only FMA reads addend, every other operation repeats left in it
+typedef struct SymbolInstruction {
+	Operation operation;
+	unsigned int result;
+	unsigned int left;
+	unsigned int right;
+	unsigned int addend;
+} SymbolInstruction;
+
+// Linear, register based form of a set of expressions
+// Registers [0, inputCount) hold the inputs, constants are preloaded and every other register is written by exactly
+// one instruction, so evaluation is a single pass over the instructions
+// Each register has a tangent for dual number evaluation, the tangent of a constant is always 0
+// DOT is lowered to a product followed by a chain of FMA, terms whose left factor is the constant 1 are added instead
+typedef struct SymbolTape {
+	SymbolInstruction* instructions;
+	unsigned int instructionCount;
+	unsigned int instructionCapacity;
+	float* registers;
+	float* tangents;
+	float* batchRegisters;
+	float* batchTangents;
+	unsigned int registerCount;
+	unsigned int registerCapacity;
+	unsigned int* outputs;
+	unsigned int outputCount;
+	unsigned int inputCount;
+} SymbolTape;
+
+SymbolTape* SymbolTapeCreate(SymbolNode** inputs, unsigned int inputCount, SymbolNode** outputs,
+                             unsigned int outputCount);
+
+// Same tape as compiling the nodes the graph was created from
+SymbolTape* SymbolTapeCreateGraph(const SymbolGraph* graph);
+
+void SymbolTapeFree(SymbolTape* tape);
+
+void SymbolTapeEvaluate(SymbolTape* tape, const float* inputs, float* outputs);
+
+// Evaluates with dual numbers, outputTangents is the derivative of the outputs in the direction of inputTangents
+void SymbolTapeEvaluateDual(SymbolTape* tape, const float* inputs, const float* inputTangents, float* outputs,
+                            float* outputTangents);
+
+// Dual number evaluation of count independent sets of inputs, stored as structure of arrays
+// Input i of set j is at inputs[i * count + j], outputs use the same layout
+// Sets are evaluated in SIMD lanes, 16 at once with AVX-512, 8 with AVX2 and FMA and 4 with SSE, the rest one by one
+void SymbolTapeEvaluateDualBatch(SymbolTape* tape, unsigned int count, const float* inputs, const float* inputTangents,
+                                 float* outputs, float* outputTangents);
+
+void SymbolTapePrint(SymbolTape* tape);
+
+// Writes the tape as a static C function with straight-line arithmetic and the signature and batch layout of
+// SymbolTapeEvaluateDualBatch without the tape, so the compiler can register allocate and vectorize it
+void SymbolTapeGenerateC(SymbolTape* tape, const char* name, FILE* file);
+
+//-----------------------------------------------------------------------------
+// SymbolJit
+//-----------------------------------------------------------------------------
+
+// Native dual number evaluation of a tape, with the signature and batch layout of SymbolTapeEvaluateDualBatch
+typedef void (*SymbolJitFunction)(unsigned int count, const float* inputs, const float* inputTangents,
+                                  float* outputs, float* outputTangents);
+
+// Registers live in scratch memory owned by the JIT, so like a tape it can only evaluate one batch at a time
+typedef struct SymbolJit {
+	void* code;
+	size_t size;
+	float* scratch;
+	SymbolJitFunction function;
+} SymbolJit;
+
+// Lowers the tape to x86-64 code in an executable page, 8 sets at a time with AVX or 4 with SSE, the rest one by one
+// FMA is always fused like the interpreters do it, so a tape with FMA needs a processor with AVX and FMA
+// Returns NULL on other architectures or processors, the tape has to be interpreted then
+SymbolJit* SymbolJitCreate(SymbolTape* tape);
+
+void SymbolJitFree(SymbolJit* jit);
+
 #endif //SIMULATOR_SYMDIFF_H
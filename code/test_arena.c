@@ -0,0 +1,66 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+
+#include <stdint.h>
+
+#include "arena.h"
+
+static Arena* arena;
+
+static void setup() {
+	arena = ArenaCreate(64);
+}
+
+static void teardown() {
+	ArenaFree(arena);
+}
+
+Test(arena, allocate, .init = setup, .fini = teardown) {
+	char* a = ArenaAllocate(arena, 3, alignof(char));
+	double* b = ArenaAllocate(arena, sizeof(double), alignof(double));
+	float* c = ArenaAllocateZero(arena, 5 * sizeof(float), alignof(float));
+
+	cr_assert(eq(u64, (uintptr_t) b % alignof(double), 0));
+	cr_assert(eq(u64, (uintptr_t) c % alignof(float), 0));
+	cr_assert((char*) b >= a + 3);
+	cr_assert((char*) c >= (char*) (b + 1));
+
+	for (unsigned int i = 0; i < 5; ++i) {
+		cr_assert(eq(flt, c[i], 0.0f));
+	}
+
+	// Consecutive small allocations are contiguous
+	cr_assert(eq(ptr, (char*) c, (char*) (b + 1)));
+}
+
+Test(arena, grow, .init = setup, .fini = teardown) {
+	// Bigger than the first block, needs a new one
+	unsigned char* big = ArenaAllocateZero(arena, 1000, 1);
+	for (unsigned int i = 0; i < 1000; ++i) {
+		cr_assert(eq(u8, big[i], 0));
+	}
+
+	for (unsigned int i = 0; i < 100; ++i) {
+		int* value = ArenaAllocate(arena, sizeof(int), alignof(int));
+		*value = (int) i;
+	}
+
+	cr_assert(ArenaCapacity(arena) >= ArenaSize(arena));
+	cr_assert(ArenaSize(arena) >= 1000 + 100 * sizeof(int));
+}
+
+Test(arena, reset, .init = setup, .fini = teardown) {
+	void* first = ArenaAllocate(arena, 16, 1);
+	ArenaAllocate(arena, 1000, 1);
+	ArenaAllocate(arena, 10000, 1);
+	const size_t capacity = ArenaCapacity(arena);
+
+	ArenaReset(arena);
+	cr_assert(eq(sz, ArenaSize(arena), 0));
+
+	// Same allocations again reuse the blocks instead of asking for new ones
+	cr_assert(eq(ptr, ArenaAllocate(arena, 16, 1), first));
+	ArenaAllocate(arena, 1000, 1);
+	ArenaAllocate(arena, 10000, 1);
+	cr_assert(eq(sz, ArenaCapacity(arena), capacity));
+}
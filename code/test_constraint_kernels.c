@@ -0,0 +1,443 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "constraint_type.h"
+#include "constraint_kernels.h"
+
+static SymbolMatrixArray* arraySymbolMatrix;
+
+static void setup() {
+	arraySymbolMatrix = SymbolMatrixArrayCreate();
+}
+
+static void teardown() {
+	SymbolMatrixArrayFree(arraySymbolMatrix);
+}
+
+static void CompareOutputs(const float* expected, const float* actual, unsigned int size) {
+	for (unsigned int i = 0; i < size; ++i) {
+		cr_assert(eq(flt, expected[i], actual[i]), "at %u", i);
+	}
+}
+
+// Chain of count particles 11 apart, so every distance constraint of 10 pulls a bit, the first one held on a circle
+static void ChainCreate(ParticleArray* particles, ConstraintArray* constraints, unsigned int count) {
+	Particle* previous = ParticleCreate(particles, (Vector2) { .x = 250.0f, .y = 200.0f }, false);
+	CircleConstraintCreate(constraints, arraySymbolMatrix, ParticleArrayOf(1, previous),
+	                       (Vector2) { .x = 200.0f, .y = 200.0f }, (Vector2) { .x = 50.0f, .y = 50.0f });
+	for (unsigned int i = 1; i < count; ++i) {
+		Particle* particle = ParticleCreate(particles, (Vector2) { .x = 250.0f + i * 11.0f, .y = 200.0f }, false);
+		DistanceConstraintCreate(constraints, arraySymbolMatrix, ParticleArrayOf(2, previous, particle), 10.0f);
+		previous = particle;
+	}
+}
+
+// Constraints with the particle lists they were given, the particles themselves belong to a particle array
+static void ConstraintsFree(ConstraintArray* constraints) {
+	for (unsigned int i = 0; i < constraints->size; ++i) {
+		free(constraints->start[i]->particles->start);
+		free(constraints->start[i]->particles);
+	}
+	ConstraintArrayFree(constraints);
+}
+
+static void SceneFree(ParticleArray* particles, ConstraintArray* constraints) {
+	ConstraintsFree(constraints);
+	ParticleArrayFree(particles);
+}
+
+// The generated kernel of a type has to match interpreting the tape of its symbolic template
+static void CompareKernel(ConstraintType type) {
+	const ConstraintKernel* kernel = &constraintKernels[type];
+	cr_assert(kernel->evaluate != NULL);
+
+	ConstraintTemplate* constraintTemplate = ConstraintTypeTemplateCreate(arraySymbolMatrix, type);
+	cr_assert(eq(u32, kernel->particleCount, constraintTemplate->particleCount));
+	cr_assert(eq(u32, kernel->parameterCount, constraintTemplate->parameterCount));
+	cr_assert(eq(u32, kernel->jacobianEntryCount, constraintTemplate->jacobianEntryCount));
+	for (unsigned int i = 0; i < kernel->jacobianEntryCount; ++i) {
+		cr_assert(eq(u32, kernel->jacobianEntries[i], constraintTemplate->jacobianEntries[i]), "at %u", i);
+	}
+
+	const unsigned int count = 21;
+	const unsigned int inputCount = constraintTemplate->inputCount;
+	const unsigned int outputCount = constraintTemplate->outputCount;
+	float* inputs = calloc(inputCount * count, sizeof(float));
+	float* inputTangents = calloc(inputCount * count, sizeof(float));
+	float* tapeOutputs = calloc(outputCount * count, sizeof(float));
+	float* tapeOutputTangents = calloc(outputCount * count, sizeof(float));
+	float* kernelOutputs = calloc(outputCount * count, sizeof(float));
+	float* kernelOutputTangents = calloc(outputCount * count, sizeof(float));
+
+	srand(7);
+	for (unsigned int i = 0; i < inputCount * count; ++i) {
+		inputs[i] = (float) rand() / (float) RAND_MAX * 20.0f - 10.0f;
+		inputTangents[i] = (float) rand() / (float) RAND_MAX * 2.0f - 1.0f;
+	}
+
+	SymbolTapeEvaluateDualBatch(constraintTemplate->tape, count, inputs, inputTangents, tapeOutputs, tapeOutputTangents);
+	kernel->evaluate(count, inputs, inputTangents, kernelOutputs, kernelOutputTangents);
+
+	CompareOutputs(tapeOutputs, kernelOutputs, outputCount * count);
+	CompareOutputs(tapeOutputTangents, kernelOutputTangents, outputCount * count);
+
+	// Without the generated kernel the tape is compiled at runtime instead
+	if(constraintTemplate->jit != NULL) {
+		constraintTemplate->kernel(count, inputs, inputTangents, kernelOutputs, kernelOutputTangents);
+
+		CompareOutputs(tapeOutputs, kernelOutputs, outputCount * count);
+		CompareOutputs(tapeOutputTangents, kernelOutputTangents, outputCount * count);
+	}
+
+	free(inputs);
+	free(inputTangents);
+	free(tapeOutputs);
+	free(tapeOutputTangents);
+	free(kernelOutputs);
+	free(kernelOutputTangents);
+	ConstraintTemplateFree(constraintTemplate);
+}
+
+Test(constraint_kernels, circle, .init = setup, .fini = teardown) {
+	CompareKernel(CIRCLE);
+}
+
+Test(constraint_kernels, distance, .init = setup, .fini = teardown) {
+	CompareKernel(DISTANCE);
+}
+
+Test(constraint_kernels, template, .init = setup, .fini = teardown) {
+	ConstraintArray* constraintArray = ConstraintArrayCreate();
+
+	ConstraintTemplate* constraintTemplate = ConstraintTypeTemplate(constraintArray, arraySymbolMatrix, DISTANCE);
+	cr_assert(constraintTemplate->kernel != NULL);
+	cr_assert(constraintTemplate->tape == NULL);
+	cr_assert(eq(ptr, constraintTemplate, ConstraintTypeTemplate(constraintArray, arraySymbolMatrix, DISTANCE)));
+
+	ConstraintArrayFree(constraintArray);
+}
+
+Test(constraint_kernels, collect, .init = setup, .fini = teardown) {
+	ConstraintArray* constraintArray = ConstraintArrayCreate();
+	constraintArray->templates[DISTANCE] = ConstraintTypeTemplateCreate(arraySymbolMatrix, DISTANCE);
+	ConstraintTemplate* constraintTemplate = constraintArray->templates[DISTANCE];
+	const unsigned int count = SymbolNodeCount(constraintTemplate->constraintFunction)
+	                           + SymbolMatrixCount(constraintTemplate->constraintFunction_dx);
+	const SymbolMemoryStatistics before = SymbolMatrixArrayStatistics(arraySymbolMatrix);
+
+	// Only the symbolic form of the template is left, the Taylor expansion it was specialized from is released
+	ConstraintArrayCollectSymbols(constraintArray, arraySymbolMatrix);
+	const SymbolMemoryStatistics after = SymbolMatrixArrayStatistics(arraySymbolMatrix);
+	cr_assert(eq(sz, 3, after.matrixCount));
+	cr_assert(lt(sz, after.nodeCount, before.nodeCount));
+	cr_assert(lt(sz, after.reservedBytes, before.reservedBytes));
+
+	cr_assert(eq(u32, count, SymbolNodeCount(constraintTemplate->constraintFunction)
+	                         + SymbolMatrixCount(constraintTemplate->constraintFunction_dx)));
+	bool nonzero[4];
+	cr_assert(eq(u32, constraintTemplate->jacobianEntryCount,
+	             SymbolMatrixSparsity(constraintTemplate->constraintFunction_dx, nonzero)));
+
+	ConstraintArrayFree(constraintArray);
+}
+
+Test(constraint_kernels, sparsity, .init = setup, .fini = teardown) {
+	// Two particles, only the x of the first and the y of the second are constrained, f = x0 - y1 - p
+	SymbolNodeArray* nodeArray = arraySymbolMatrix->nodeArray;
+	SymbolMatrix* x = SymbolMatrixCreate(arraySymbolMatrix, 2, 2);
+	for (unsigned int i = 0; i < 4; ++i) {
+		x->values[i] = SymbolNodeVariable(nodeArray);
+	}
+	SymbolMatrix* parameters = SymbolMatrixCreate(arraySymbolMatrix, 1, 1);
+	SymbolMatrixSet(parameters, 0, 0, SymbolNodeVariable(nodeArray));
+
+	SymbolNode* t1 = SymbolNodeBinary(nodeArray, SUSTRACT, SymbolMatrixGet(x, 0, 0), SymbolMatrixGet(x, 1, 1));
+	SymbolNode* f = SymbolNodeBinary(nodeArray, SUSTRACT, t1, SymbolMatrixGet(parameters, 0, 0));
+	SymbolMatrix* df_dx = SymbolMatrixSimplify(SymbolNodeGradientSymbolMatrix(f, arraySymbolMatrix, x), arraySymbolMatrix);
+
+	ConstraintTemplate* constraintTemplate = ConstraintTemplateCreate(CIRCLE, parameters, x, f, df_dx);
+	cr_assert(eq(u32, 2, constraintTemplate->jacobianEntryCount));
+	cr_assert(eq(u32, 0, constraintTemplate->jacobianEntries[0]));
+	cr_assert(eq(u32, 3, constraintTemplate->jacobianEntries[1]));
+
+	ConstraintArray* constraintArray = ConstraintArrayCreate();
+	ParticleArray* particleArray = ParticleArrayCreate();
+	Particle* particle1 = ParticleCreate(particleArray, (Vector2) { .x = 1.0f, .y = 2.0f }, false);
+	Particle* particle2 = ParticleCreate(particleArray, (Vector2) { .x = 3.0f, .y = 4.0f }, false);
+	const float parameter = 5.0f;
+	Constraint* constraint = ConstraintCreate(constraintArray, ParticleArrayOf(2, particle1, particle2),
+	                                          constraintTemplate, &parameter);
+
+	cr_assert(ConstraintJacobianNonzero(constraint, 0, 0));
+	cr_assert(!ConstraintJacobianNonzero(constraint, 0, 1));
+	cr_assert(!ConstraintJacobianNonzero(constraint, 1, 0));
+	cr_assert(ConstraintJacobianNonzero(constraint, 1, 1));
+	cr_assert(eq(u32, 2, ConstraintArrayJacobianNonzeroCount(constraintArray)));
+
+	SceneFree(particleArray, constraintArray);
+	ConstraintTemplateFree(constraintTemplate);
+}
+
+Test(constraint_kernels, cache, .init = setup, .fini = teardown) {
+	char directory[] = "/tmp/constraint_cache_XXXXXX";
+	cr_assert(ne(ptr, mkdtemp(directory), NULL));
+
+	// The first load builds the template and writes its graph, the second one only reads it
+	ConstraintTemplate* built = ConstraintTypeTemplateLoad(arraySymbolMatrix, CIRCLE, directory);
+	cr_assert(ne(ptr, built->graph, NULL));
+
+	ConstraintTemplate* cached = ConstraintTypeTemplateLoad(arraySymbolMatrix, CIRCLE, directory);
+	cr_assert(eq(ptr, cached->x, NULL));
+	cr_assert(eq(u32, cached->particleCount, built->particleCount));
+	cr_assert(eq(u32, cached->parameterCount, built->parameterCount));
+
+	const float inputs[] = { 200, 200, 50, 50, 250, 210 };
+	float builtOutputs[3];
+	float cachedOutputs[3];
+	SymbolTapeEvaluate(built->tape, inputs, builtOutputs);
+	SymbolTapeEvaluate(cached->tape, inputs, cachedOutputs);
+	CompareOutputs(builtOutputs, cachedOutputs, 3);
+
+	ConstraintTemplateFree(built);
+	ConstraintTemplateFree(cached);
+
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/circle.graph", directory);
+	remove(path);
+	rmdir(directory);
+}
+
+Test(constraint_kernels, parallel, .init = setup, .fini = teardown) {
+	ParticleArray* particles = ParticleArrayCreate();
+	ConstraintArray* serial = ConstraintArrayCreate();
+	ConstraintArray* parallel = ConstraintArrayCreate();
+
+	const unsigned int count = 101;
+	ConstraintDescription descriptions[101];
+
+	Particle* previous = ParticleCreate(particles, (Vector2) { .x = 0.0f, .y = 0.0f }, false);
+	for (unsigned int i = 0; i < count; ++i) {
+		Particle* particle = ParticleCreate(particles, (Vector2) { .x = i * 10.0f, .y = 0.0f }, false);
+
+		// Types interleaved, so lanes of each template are not the same as indices in the array
+		if(i % 3 == 0) {
+			const Vector2 center = { .x = i, .y = 0.0f };
+			const Vector2 radius = { .x = 5.0f, .y = 6.0f };
+			descriptions[i] = (ConstraintDescription) {
+				.type = CIRCLE,
+				.particles = ParticleArrayOf(1, particle),
+				.metadata.circle = { .center = center, .radius = radius },
+			};
+			CircleConstraintCreate(serial, arraySymbolMatrix, ParticleArrayOf(1, particle), center, radius);
+		} else {
+			descriptions[i] = (ConstraintDescription) {
+				.type = DISTANCE,
+				.particles = ParticleArrayOf(2, previous, particle),
+				.metadata.distance = { .distance = i },
+			};
+			DistanceConstraintCreate(serial, arraySymbolMatrix, ParticleArrayOf(2, previous, particle), i);
+		}
+
+		previous = particle;
+	}
+
+	ThreadPool* pool = ThreadPoolCreate(4);
+	ConstraintsCreateParallel(parallel, pool, descriptions, count);
+	ThreadPoolFree(pool);
+
+	cr_assert(eq(u32, parallel->size, serial->size));
+	for (unsigned int i = 0; i < CONSTRAINT_TYPE_COUNT; ++i) {
+		cr_assert(eq(u32, parallel->templates[i]->constraintCount, serial->templates[i]->constraintCount));
+	}
+	for (unsigned int i = 0; i < count; ++i) {
+		const Constraint* expected = serial->start[i];
+		const Constraint* actual = parallel->start[i];
+
+		cr_assert(eq(int, actual->type, expected->type));
+		cr_assert(eq(u32, actual->index, expected->index));
+		cr_assert(eq(u32, actual->lane, expected->lane));
+		cr_assert(eq(ptr, actual->constraintTemplate, parallel->templates[expected->type]));
+		cr_assert(eq(int, memcmp(actual->parameters, expected->parameters,
+		                         expected->constraintTemplate->parameterCount * sizeof(float)), 0));
+	}
+
+	ConstraintsFree(parallel);
+	SceneFree(particles, serial);
+}
+
+#define CONCURRENT_LANES 9
+
+// Templates of every type built in a symbolic context of its own, each thread in a different order
+typedef struct ConcurrentBuild {
+	pthread_barrier_t* barrier;
+	float inputs[CONSTRAINT_TYPE_COUNT][(CONSTRAINT_MAX_PARAMETERS + 4) * CONCURRENT_LANES];
+	float inputTangents[CONSTRAINT_TYPE_COUNT][(CONSTRAINT_MAX_PARAMETERS + 4) * CONCURRENT_LANES];
+	float outputs[2][CONSTRAINT_TYPE_COUNT][5 * CONCURRENT_LANES];
+	float outputTangents[2][CONSTRAINT_TYPE_COUNT][5 * CONCURRENT_LANES];
+	unsigned int outputCounts[CONSTRAINT_TYPE_COUNT];
+} ConcurrentBuild;
+
+static void ConcurrentBuildRun(void* context, unsigned int index) {
+	ConcurrentBuild* build = context;
+
+	// Both threads build at the same time
+	pthread_barrier_wait(build->barrier);
+
+	SymbolMatrixArray* symbolMatrixArray = SymbolMatrixArrayCreate();
+	for (unsigned int i = 0; i < CONSTRAINT_TYPE_COUNT; ++i) {
+		const ConstraintType type = index == 0 ? i : CONSTRAINT_TYPE_COUNT - 1 - i;
+		ConstraintTemplate* constraintTemplate = ConstraintTypeTemplateCreate(symbolMatrixArray, type);
+		SymbolTapeEvaluateDualBatch(constraintTemplate->tape, CONCURRENT_LANES, build->inputs[type],
+		                            build->inputTangents[type], build->outputs[index][type],
+		                            build->outputTangents[index][type]);
+		build->outputCounts[type] = constraintTemplate->outputCount;
+		ConstraintTemplateFree(constraintTemplate);
+	}
+	SymbolMatrixArrayFree(symbolMatrixArray);
+}
+
+Test(constraint_kernels, concurrent, .init = setup, .fini = teardown) {
+	ThreadPool* pool = ThreadPoolCreate(2);
+	cr_assert(eq(u32, pool->threadCount, 2));
+
+	pthread_barrier_t barrier;
+	pthread_barrier_init(&barrier, NULL, 2);
+	ConcurrentBuild* build = calloc(1, sizeof(ConcurrentBuild));
+	build->barrier = &barrier;
+	srand(11);
+	for (unsigned int type = 0; type < CONSTRAINT_TYPE_COUNT; ++type) {
+		for (unsigned int i = 0; i < (CONSTRAINT_MAX_PARAMETERS + 4) * CONCURRENT_LANES; ++i) {
+			build->inputs[type][i] = (float) rand() / (float) RAND_MAX * 20.0f - 10.0f;
+			build->inputTangents[type][i] = (float) rand() / (float) RAND_MAX * 2.0f - 1.0f;
+		}
+	}
+
+	ThreadPoolRun(pool, ConcurrentBuildRun, build, 2);
+
+	// Both threads built the same functions as the generated kernels
+	float outputs[5 * CONCURRENT_LANES];
+	float outputTangents[5 * CONCURRENT_LANES];
+	for (unsigned int type = 0; type < CONSTRAINT_TYPE_COUNT; ++type) {
+		const unsigned int size = build->outputCounts[type] * CONCURRENT_LANES;
+		constraintKernels[type].evaluate(CONCURRENT_LANES, build->inputs[type], build->inputTangents[type], outputs,
+		                                 outputTangents);
+		for (unsigned int thread = 0; thread < 2; ++thread) {
+			CompareOutputs(outputs, build->outputs[thread][type], size);
+			CompareOutputs(outputTangents, build->outputTangents[thread][type], size);
+		}
+	}
+
+	free(build);
+	pthread_barrier_destroy(&barrier);
+	ThreadPoolFree(pool);
+}
+
+Test(constraint_kernels, rope, .init = setup, .fini = teardown) {
+	ParticleArray* particles = ParticleArrayCreate();
+	ConstraintArray* constraints = ConstraintArrayCreate();
+
+	const unsigned int count = 10000;
+	ChainCreate(particles, constraints, count);
+
+	Simulator simulator = SimulatorCreate(particles, constraints, false);
+	SimulatorUpdate(&simulator, 0.0001f);
+
+	// J, g and its factor only hold the few entries of each constraint, a dense g alone would be 400 MB
+	cr_assert(lt(sz, ArenaCapacity(simulator.matrixNArray->arena), 16 << 20));
+	for (unsigned int i = 0; i < count; ++i) {
+		cr_assert(isfinite(particles->start[i]->aConstraint.x) && isfinite(particles->start[i]->aConstraint.y), "at %u", i);
+	}
+	cr_assert(gt(flt, fabsf(particles->start[count - 1]->aConstraint.x), 0.0f));
+
+	SimulatorFree(&simulator);
+	SceneFree(particles, constraints);
+}
+
+Test(constraint_kernels, masses, .init = setup, .fini = teardown) {
+	ParticleArray* particles = ParticleArrayCreate();
+	ConstraintArray* constraints = ConstraintArrayCreate();
+
+	// A light and a heavy particle, and a particle tied to a static one, both pairs as far apart
+	Particle* light = ParticleCreate(particles, (Vector2) { .x = 0.0f, .y = 0.0f }, false);
+	Particle* heavy = ParticleCreate(particles, (Vector2) { .x = 11.0f, .y = 0.0f }, false);
+	Particle* anchor = ParticleCreate(particles, (Vector2) { .x = 0.0f, .y = 100.0f }, true);
+	Particle* tied = ParticleCreate(particles, (Vector2) { .x = 0.0f, .y = 111.0f }, false);
+	ParticleSetMass(heavy, 3.0f);
+	ParticleSetMass(anchor, 3.0f);
+	DistanceConstraintCreate(constraints, arraySymbolMatrix, ParticleArrayOf(2, light, heavy), 10.0f);
+	DistanceConstraintCreate(constraints, arraySymbolMatrix, ParticleArrayOf(2, anchor, tied), 10.0f);
+	cr_assert(eq(flt, anchor->inverseMass, 0.0f));
+
+	Simulator simulator = SimulatorCreate(particles, constraints, false);
+	SimulatorUpdate(&simulator, 0.0001f);
+
+	// The constraint force is the same on both ends, so it accelerates the light particle three times as much
+	cr_assert(gt(flt, fabsf(light->aConstraint.x), 0.0f));
+	cr_assert(epsilon_eq(flt, light->aConstraint.x, -3.0f * heavy->aConstraint.x, 1e-5f * fabsf(light->aConstraint.x)));
+
+	// The static particle takes none of the correction, the one tied to it does all of it
+	cr_assert(eq(flt, anchor->x.y, 100.0f));
+	cr_assert(eq(flt, anchor->aConstraint.y, 0.0f));
+	cr_assert(epsilon_eq(flt, tied->aConstraint.y, -4.0f * light->aConstraint.x / 3.0f,
+	                     1e-5f * fabsf(tied->aConstraint.y)));
+
+	SimulatorFree(&simulator);
+	SceneFree(particles, constraints);
+}
+
+Test(constraint_kernels, applied, .init = setup, .fini = teardown) {
+	ParticleArray* particles = ParticleArrayCreate();
+	ConstraintArray* constraints = ConstraintArrayCreate();
+
+	// A particle hanging at rest from a static one, both pushed, only the push across the constraint is left
+	Particle* anchor = ParticleCreate(particles, (Vector2) { .x = 0.0f, .y = 100.0f }, true);
+	Particle* tied = ParticleCreate(particles, (Vector2) { .x = 0.0f, .y = 110.0f }, false);
+	ParticleSetMass(tied, 2.0f);
+	ParticleSetForce(anchor, (Vector2) { .x = 100.0f, .y = 100.0f });
+	ParticleSetForce(tied, (Vector2) { .x = 3.0f, .y = 5.0f });
+	DistanceConstraintCreate(constraints, arraySymbolMatrix, ParticleArrayOf(2, anchor, tied), 10.0f);
+
+	// Without the terms correcting the drift, the constraint force only cancels the applied force along it
+	Simulator simulator = SimulatorCreate(particles, constraints, false);
+	simulator.ks = 0.0f;
+	simulator.kd = 0.0f;
+	SimulatorUpdate(&simulator, 0.0001f);
+
+	cr_assert(eq(flt, anchor->a.x, 0.0f));
+	cr_assert(eq(flt, anchor->a.y, 0.0f));
+	cr_assert(eq(flt, anchor->x.y, 100.0f));
+	cr_assert(epsilon_eq(flt, tied->aApplied.x, 1.5f, 1e-6f));
+	cr_assert(epsilon_eq(flt, tied->aConstraint.y, -2.5f, 1e-4f));
+	cr_assert(epsilon_eq(flt, tied->a.x, 1.5f, 1e-4f));
+	cr_assert(epsilon_eq(flt, tied->a.y, 0.0f, 1e-4f));
+
+	SimulatorFree(&simulator);
+	SceneFree(particles, constraints);
+}
+
+Test(constraint_kernels, steady, .init = setup, .fini = teardown) {
+	ParticleArray* particles = ParticleArrayCreate();
+	ConstraintArray* constraints = ConstraintArrayCreate();
+
+	ChainCreate(particles, constraints, 100);
+
+	// Once the first step has sized the matrix arena, the next ones reuse it and take no more memory
+	Simulator simulator = SimulatorCreate(particles, constraints, false);
+	SimulatorUpdate(&simulator, 0.0001f);
+	const size_t capacity = ArenaCapacity(simulator.matrixNArray->arena);
+	const size_t matrixCapacity = simulator.matrixNArray->capacity;
+	for (unsigned int i = 0; i < 10; ++i) {
+		SimulatorUpdate(&simulator, 0.0001f);
+		cr_assert(eq(sz, capacity, ArenaCapacity(simulator.matrixNArray->arena)), "at step %u", i);
+		cr_assert(eq(sz, matrixCapacity, simulator.matrixNArray->capacity), "at step %u", i);
+	}
+
+	SimulatorFree(&simulator);
+	SceneFree(particles, constraints);
+}
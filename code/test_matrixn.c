@@ -272,3 +272,282 @@ Test(matrixn, pseudoinverse_inv_2, .init = setup, .fini = teardown) {
 		}
 	}
 }
+
+Test(matrixn, cholesky_1, .init = setup, .fini = teardown) {
+	MatrixN* matrix = MatrixNCreate(arrayMatrixN, 3, 3);
+	*MatrixNGet(matrix, 0, 0) =   4; *MatrixNGet(matrix, 0, 1) =  12; *MatrixNGet(matrix, 0, 2) = -16;
+	*MatrixNGet(matrix, 1, 0) =  12; *MatrixNGet(matrix, 1, 1) =  37; *MatrixNGet(matrix, 1, 2) = -43;
+	*MatrixNGet(matrix, 2, 0) = -16; *MatrixNGet(matrix, 2, 1) = -43; *MatrixNGet(matrix, 2, 2) =  98;
+	MatrixN* factor = MatrixNCholesky(arrayMatrixN, matrix, 0);
+
+	MatrixN* realFactor = MatrixNCreate(arrayMatrixN, 3, 3);
+	*MatrixNGet(realFactor, 0, 0) =  2; *MatrixNGet(realFactor, 0, 1) = 0; *MatrixNGet(realFactor, 0, 2) = 0;
+	*MatrixNGet(realFactor, 1, 0) =  6; *MatrixNGet(realFactor, 1, 1) = 1; *MatrixNGet(realFactor, 1, 2) = 0;
+	*MatrixNGet(realFactor, 2, 0) = -8; *MatrixNGet(realFactor, 2, 1) = 5; *MatrixNGet(realFactor, 2, 2) = 3;
+
+	for (unsigned int i = 0; i < matrix->rows; ++i) {
+		for (unsigned int j = 0; j < matrix->cols; ++j) {
+			cr_assert(epsilon_eq(flt, *MatrixNGet(realFactor, i, j), *MatrixNGet(factor, i, j), 0.0001), "at pos (%u, %u)", i, j);
+		}
+	}
+
+	MatrixN* b = MatrixNCreate(arrayMatrixN, 3, 2);
+	*MatrixNGet(b, 0, 0) = 1; *MatrixNGet(b, 0, 1) =  4;
+	*MatrixNGet(b, 1, 0) = 2; *MatrixNGet(b, 1, 1) = -3;
+	*MatrixNGet(b, 2, 0) = 3; *MatrixNGet(b, 2, 1) =  8;
+	MatrixN* x = MatrixNCholeskySolve(arrayMatrixN, factor, b);
+	MatrixN* product = MatrixNMultiply(arrayMatrixN, matrix, x);
+
+	for (unsigned int i = 0; i < b->rows; ++i) {
+		for (unsigned int j = 0; j < b->cols; ++j) {
+			cr_assert(epsilon_eq(flt, *MatrixNGet(b, i, j), *MatrixNGet(product, i, j), 0.001), "at pos (%u, %u)", i, j);
+		}
+	}
+}
+
+Test(matrixn, cholesky_redundant, .init = setup, .fini = teardown) {
+	// The last row of J repeats the first one, so J J' is singular
+	MatrixN* J = MatrixNCreate(arrayMatrixN, 3, 4);
+	*MatrixNGet(J, 0, 0) = 1; *MatrixNGet(J, 0, 1) = 2; *MatrixNGet(J, 0, 2) =  0; *MatrixNGet(J, 0, 3) = -1;
+	*MatrixNGet(J, 1, 0) = 0; *MatrixNGet(J, 1, 1) = 1; *MatrixNGet(J, 1, 2) = -3; *MatrixNGet(J, 1, 3) =  2;
+	*MatrixNGet(J, 2, 0) = 1; *MatrixNGet(J, 2, 1) = 2; *MatrixNGet(J, 2, 2) =  0; *MatrixNGet(J, 2, 3) = -1;
+	MatrixN* matrix = MatrixNMultiply(arrayMatrixN, J, MatrixNTranspose(arrayMatrixN, J));
+
+	// Consistent right hand side, the redundant constraints ask for the same
+	MatrixN* b = MatrixNCreate(arrayMatrixN, 3, 1);
+	*MatrixNGet(b, 0, 0) = 5; *MatrixNGet(b, 1, 0) = -2; *MatrixNGet(b, 2, 0) = 5;
+
+	MatrixN* factor = MatrixNCholesky(arrayMatrixN, matrix, 1e-5f);
+	MatrixN* x = MatrixNCholeskySolve(arrayMatrixN, factor, b);
+	MatrixN* product = MatrixNMultiply(arrayMatrixN, matrix, x);
+	for (unsigned int i = 0; i < b->rows; ++i) {
+		cr_assert(epsilon_eq(flt, *MatrixNGet(b, i, 0), *MatrixNGet(product, i, 0), 0.001), "at pos %u", i);
+	}
+
+	// J' x is the same as without the repeated row, which gets part of the solution of the first one
+	MatrixN* reducedJ = MatrixNCreate(arrayMatrixN, 2, 4);
+	MatrixN* reducedB = MatrixNCreate(arrayMatrixN, 2, 1);
+	for (unsigned int i = 0; i < 2; ++i) {
+		for (unsigned int j = 0; j < 4; ++j) {
+			*MatrixNGet(reducedJ, i, j) = *MatrixNGet(J, i, j);
+		}
+		*MatrixNGet(reducedB, i, 0) = *MatrixNGet(b, i, 0);
+	}
+	MatrixN* reducedMatrix = MatrixNMultiply(arrayMatrixN, reducedJ, MatrixNTranspose(arrayMatrixN, reducedJ));
+	MatrixN* reducedX = MatrixNCholeskySolve(arrayMatrixN, MatrixNCholesky(arrayMatrixN, reducedMatrix, 0), reducedB);
+
+	MatrixN* a = MatrixNMultiply(arrayMatrixN, MatrixNTranspose(arrayMatrixN, J), x);
+	MatrixN* reducedA = MatrixNMultiply(arrayMatrixN, MatrixNTranspose(arrayMatrixN, reducedJ), reducedX);
+	for (unsigned int i = 0; i < a->rows; ++i) {
+		cr_assert(epsilon_eq(flt, *MatrixNGet(reducedA, i, 0), *MatrixNGet(a, i, 0), 0.001), "at pos %u", i);
+	}
+}
+
+// Chain of rows each touching the column of the row before, out of order and with a repeated entry
+static MatrixNSparse* GenerateSparse(unsigned int rows, unsigned int cols) {
+	MatrixNTriplets* triplets = MatrixNTripletsCreate(arrayMatrixN, rows, cols, 3 * rows);
+	for (unsigned int r = rows; r-- > 0;) {
+		MatrixNTripletsAdd(triplets, r, (r + 1) % cols, 2.0f + r);
+		MatrixNTripletsAdd(triplets, r, r % cols, 1.0f);
+		MatrixNTripletsAdd(triplets, r, r % cols, -3.0f * r);
+	}
+	return MatrixNSparseCreate(arrayMatrixN, triplets);
+}
+
+Test(matrixn, sparse_create, .init = setup, .fini = teardown) {
+	MatrixNSparse* sparse = GenerateSparse(4, 6);
+	cr_assert(eq(uint, 8, MatrixNSparseNonzeroCount(sparse)));
+
+	for (unsigned int i = 0; i < sparse->rows; ++i) {
+		for (unsigned int e = sparse->rowStarts[i] + 1; e < sparse->rowStarts[i + 1]; ++e) {
+			cr_assert(lt(uint, sparse->columns[e - 1], sparse->columns[e]), "at row %u", i);
+		}
+	}
+
+	MatrixN* dense = MatrixNSparseToDense(arrayMatrixN, sparse);
+	cr_assert(ieee_ulp_eq(flt, 1.0f, *MatrixNGet(dense, 0, 0), 4));
+	cr_assert(ieee_ulp_eq(flt, 2.0f, *MatrixNGet(dense, 0, 1), 4));
+	cr_assert(ieee_ulp_eq(flt, -8.0f, *MatrixNGet(dense, 3, 3), 4));
+	cr_assert(ieee_ulp_eq(flt, 5.0f, *MatrixNGet(dense, 3, 4), 4));
+	cr_assert(ieee_ulp_eq(flt, 0.0f, *MatrixNGet(dense, 3, 0), 4));
+
+	MatrixN* transpose = MatrixNSparseToDense(arrayMatrixN, MatrixNSparseTranspose(arrayMatrixN, sparse));
+	MatrixN* denseTranspose = MatrixNTranspose(arrayMatrixN, dense);
+	for (unsigned int i = 0; i < transpose->rows * transpose->cols; ++i) {
+		cr_assert(ieee_ulp_eq(flt, denseTranspose->values[i], transpose->values[i], 4), "at %u", i);
+	}
+}
+
+Test(matrixn, sparse_multiply, .init = setup, .fini = teardown) {
+	MatrixNSparse* sparse = GenerateSparse(5, 7);
+	MatrixN* dense = MatrixNSparseToDense(arrayMatrixN, sparse);
+
+	MatrixN* b = Generate(7, 2);
+	MatrixN* product = MatrixNSparseMultiply(arrayMatrixN, sparse, b);
+	MatrixN* denseProduct = MatrixNMultiply(arrayMatrixN, dense, b);
+	for (unsigned int i = 0; i < product->rows * product->cols; ++i) {
+		cr_assert(ieee_ulp_eq(flt, denseProduct->values[i], product->values[i], 4), "at %u", i);
+	}
+
+	MatrixN* c = Generate(5, 2);
+	MatrixN* transposeProduct = MatrixNSparseTransposeMultiply(arrayMatrixN, sparse, c);
+	MatrixN* denseTransposeProduct = MatrixNMultiply(arrayMatrixN, MatrixNTranspose(arrayMatrixN, dense), c);
+	for (unsigned int i = 0; i < transposeProduct->rows * transposeProduct->cols; ++i) {
+		cr_assert(ieee_ulp_eq(flt, denseTransposeProduct->values[i], transposeProduct->values[i], 4), "at %u", i);
+	}
+
+	MatrixN* w = MatrixNCreate(arrayMatrixN, 7, 1);
+	MatrixN* W = MatrixNCreate(arrayMatrixN, 7, 7);
+	for (unsigned int i = 0; i < 7; ++i) {
+		*MatrixNGet(w, i, 0) = 0.5f + i;
+		*MatrixNGet(W, i, i) = 0.5f + i;
+	}
+	MatrixN* g = MatrixNSparseToDense(arrayMatrixN, MatrixNSparseMultiplyWeightedTranspose(arrayMatrixN, sparse, w));
+	MatrixN* denseG = MatrixNMultiply(arrayMatrixN, MatrixNMultiply(arrayMatrixN, dense, W),
+	                                  MatrixNTranspose(arrayMatrixN, dense));
+	for (unsigned int i = 0; i < g->rows * g->cols; ++i) {
+		cr_assert(ieee_ulp_eq(flt, denseG->values[i], g->values[i], 4), "at %u", i);
+	}
+}
+
+Test(matrixn, diagonal, .init = setup, .fini = teardown) {
+	MatrixN* b = Generate(7, 2);
+	MatrixN* w = MatrixNCreate(arrayMatrixN, 7, 1);
+	MatrixN* W = MatrixNCreate(arrayMatrixN, 7, 7);
+	for (unsigned int i = 0; i < 7; ++i) {
+		*MatrixNGet(w, i, 0) = i == 2 ? 0.0f : 0.5f + i;
+		*MatrixNGet(W, i, i) = *MatrixNGet(w, i, 0);
+	}
+	MatrixN* product = MatrixNDiagonalMultiply(arrayMatrixN, w, b);
+	MatrixN* denseProduct = MatrixNMultiply(arrayMatrixN, W, b);
+	for (unsigned int i = 0; i < product->rows * product->cols; ++i) {
+		cr_assert(ieee_ulp_eq(flt, denseProduct->values[i], product->values[i], 4), "at %u", i);
+	}
+
+	// Rows 1 and 2 only share column 2, which has no weight, so they are not coupled, the rest of g is tridiagonal
+	MatrixNSparse* sparse = GenerateSparse(5, 7);
+	MatrixNSparse* g = MatrixNSparseMultiplyWeightedTranspose(arrayMatrixN, sparse, w);
+	cr_assert(eq(uint, 11, MatrixNSparseNonzeroCount(g)));
+	MatrixN* dense = MatrixNSparseToDense(arrayMatrixN, sparse);
+	MatrixN* denseG = MatrixNMultiply(arrayMatrixN, MatrixNMultiply(arrayMatrixN, dense, W),
+	                                  MatrixNTranspose(arrayMatrixN, dense));
+	MatrixN* sparseG = MatrixNSparseToDense(arrayMatrixN, g);
+	for (unsigned int i = 0; i < denseG->rows * denseG->cols; ++i) {
+		cr_assert(ieee_ulp_eq(flt, denseG->values[i], sparseG->values[i], 4), "at %u", i);
+	}
+}
+
+Test(matrixn, sparse_cholesky, .init = setup, .fini = teardown) {
+	// J J' of a chain is tridiagonal, its envelope is one entry left of the diagonal
+	MatrixNSparse* J = GenerateSparse(6, 7);
+	MatrixN* w = MatrixNCreate(arrayMatrixN, 7, 1);
+	for (unsigned int i = 0; i < 7; ++i) {
+		*MatrixNGet(w, i, 0) = 1.0f;
+	}
+	MatrixNSparse* g = MatrixNSparseMultiplyWeightedTranspose(arrayMatrixN, J, w);
+	MatrixNSparse* factor = MatrixNSparseCholesky(arrayMatrixN, g, 0);
+	cr_assert(eq(uint, 11, MatrixNSparseNonzeroCount(factor)));
+
+	MatrixN* denseG = MatrixNSparseToDense(arrayMatrixN, g);
+	MatrixN* denseFactor = MatrixNCholesky(arrayMatrixN, denseG, 0);
+	MatrixN* sparseFactor = MatrixNSparseToDense(arrayMatrixN, factor);
+	for (unsigned int i = 0; i < denseFactor->rows * denseFactor->cols; ++i) {
+		cr_assert(epsilon_eq(flt, denseFactor->values[i], sparseFactor->values[i], 0.0001), "at %u", i);
+	}
+
+	MatrixN* b = Generate(6, 2);
+	MatrixN* x = MatrixNSparseCholeskySolve(arrayMatrixN, factor, b);
+	MatrixN* product = MatrixNSparseMultiply(arrayMatrixN, g, x);
+	for (unsigned int i = 0; i < b->rows * b->cols; ++i) {
+		cr_assert(epsilon_eq(flt, b->values[i], product->values[i], 0.01), "at %u", i);
+	}
+}
+
+Test(matrixn, into, .init = setup, .fini = teardown) {
+	MatrixN* a = Generate(3, 4);
+	MatrixN* b = Generate(4, 2);
+	*MatrixNGet(a, 0, 0) = 2.0f;
+	*MatrixNGet(b, 0, 1) = -1.0f;
+	MatrixN* c = Generate(3, 2);
+	*MatrixNGet(c, 2, 0) = 5.0f;
+
+	// c + a b and c + 3 c, with the results written over c
+	MatrixN* expected = MatrixNAdd(arrayMatrixN, c, MatrixNMultiply(arrayMatrixN, a, b));
+	expected = MatrixNAdd(arrayMatrixN, expected, MatrixNMultiplyValue(arrayMatrixN, expected, 3.0f));
+	MatrixNMultiplyAddInto(c, a, b);
+	MatrixNMultiplyValueAddInto(c, c, 3.0f);
+	for (unsigned int i = 0; i < c->rows * c->cols; ++i) {
+		cr_assert(ieee_ulp_eq(flt, expected->values[i], c->values[i], 4), "at %u", i);
+	}
+
+	// Element-wise operations in place
+	MatrixNNegateInto(c, c);
+	MatrixNAddInto(c, c, expected);
+	for (unsigned int i = 0; i < c->rows * c->cols; ++i) {
+		cr_assert(eq(flt, 0.0f, c->values[i]), "at %u", i);
+	}
+
+	// Solving in place, over the right hand side
+	MatrixNSparse* J = GenerateSparse(6, 7);
+	MatrixN* w = MatrixNCreate(arrayMatrixN, 7, 1);
+	for (unsigned int i = 0; i < 7; ++i) {
+		*MatrixNGet(w, i, 0) = 1.0f;
+	}
+	MatrixNSparse* factor = MatrixNSparseCholesky(arrayMatrixN, MatrixNSparseMultiplyWeightedTranspose(arrayMatrixN, J, w), 0);
+	MatrixN* x = Generate(6, 2);
+	MatrixN* solution = MatrixNSparseCholeskySolve(arrayMatrixN, factor, x);
+	MatrixNSparseCholeskySolveInto(x, factor, x);
+	for (unsigned int i = 0; i < x->rows * x->cols; ++i) {
+		cr_assert(eq(flt, solution->values[i], x->values[i]), "at %u", i);
+	}
+}
+
+Test(matrixn, multiply_transposed, .init = setup, .fini = teardown) {
+	MatrixN* a = Generate(3, 4);
+	MatrixN* b = Generate(4, 2);
+	for (unsigned int i = 0; i < 12; ++i) {
+		a->values[i] += 0.25f * i - 1.0f;
+	}
+	for (unsigned int i = 0; i < 8; ++i) {
+		b->values[i] -= 0.5f * i;
+	}
+	MatrixN* aT = MatrixNTranspose(arrayMatrixN, a);
+	MatrixN* bT = MatrixNTranspose(arrayMatrixN, b);
+
+	// Every combination of transposes gives a b or its transpose b' a'
+	MatrixN* expected = MatrixNMultiply(arrayMatrixN, a, b);
+	MatrixN* expectedT = MatrixNTranspose(arrayMatrixN, expected);
+	MatrixN* results[] = {
+		MatrixNMultiplyTransposed(arrayMatrixN, aT, true, b, false),
+		MatrixNMultiplyTransposed(arrayMatrixN, a, false, bT, true),
+		MatrixNMultiplyTransposed(arrayMatrixN, aT, true, bT, true),
+	};
+	for (unsigned int r = 0; r < 3; ++r) {
+		for (unsigned int i = 0; i < expected->rows * expected->cols; ++i) {
+			cr_assert(ieee_ulp_eq(flt, expected->values[i], results[r]->values[i], 4), "%u at %u", r, i);
+		}
+	}
+	MatrixN* transposed = MatrixNMultiplyTransposed(arrayMatrixN, b, true, a, true);
+	MatrixNMultiplyTransposedAddInto(transposed, bT, false, aT, false);
+	for (unsigned int i = 0; i < expectedT->rows * expectedT->cols; ++i) {
+		cr_assert(ieee_ulp_eq(flt, 2.0f * expectedT->values[i], transposed->values[i], 4), "at %u", i);
+	}
+
+	// a W a' and a' W a against the full products
+	MatrixN* w = MatrixNCreate(arrayMatrixN, 4, 1);
+	MatrixN* W = MatrixNCreate(arrayMatrixN, 4, 4);
+	for (unsigned int i = 0; i < 4; ++i) {
+		*MatrixNGet(w, i, 0) = 0.5f + i;
+		*MatrixNGet(W, i, i) = 0.5f + i;
+	}
+	MatrixN* g = MatrixNMultiplyWeightedTranspose(arrayMatrixN, a, false, w);
+	MatrixN* expectedG = MatrixNMultiply(arrayMatrixN, MatrixNMultiply(arrayMatrixN, a, W), aT);
+	for (unsigned int i = 0; i < g->rows * g->cols; ++i) {
+		cr_assert(ieee_ulp_eq(flt, expectedG->values[i], g->values[i], 4), "at %u", i);
+	}
+	MatrixN* h = MatrixNMultiplyWeightedTranspose(arrayMatrixN, b, true, NULL);
+	MatrixN* expectedH = MatrixNMultiply(arrayMatrixN, bT, b);
+	for (unsigned int i = 0; i < h->rows * h->cols; ++i) {
+		cr_assert(ieee_ulp_eq(flt, expectedH->values[i], h->values[i], 4), "at %u", i);
+	}
+}
@@ -44,3 +44,166 @@ Test(symdiff_matrix, general, .init = setup, .fini = teardown) {
 		cr_assert(ieee_ulp_eq(flt, 2, valueD2, 4));
 	}
 }
+
+Test(symdiff_matrix, gradient, .init = setup, .fini = teardown) {
+	SymbolMatrix* a = SymbolMatrixCreate(arraySymbolMatrix, 1, 3);                 // a
+	SymbolMatrixSet(a, 0, 0, SymbolNodeVariable(arraySymbolMatrix->nodeArray));
+	SymbolMatrixSet(a, 0, 1, SymbolNodeVariable(arraySymbolMatrix->nodeArray));
+	SymbolMatrixSet(a, 0, 2, SymbolNodeVariable(arraySymbolMatrix->nodeArray));
+	SymbolNodeArray* nodeArray = arraySymbolMatrix->nodeArray;
+	SymbolNode* t1 = SymbolNodeBinary(nodeArray, MULTIPLY, a->values[0], a->values[1]);     // a0 * a1
+	SymbolNode* t2 = SymbolNodeBinary(nodeArray, SUSTRACT, t1, a->values[2]);               // a0 * a1 - a2
+	SymbolNode* t3 = SymbolNodeBinary(nodeArray, MULTIPLY, t2, t2);                         // (a0 * a1 - a2) ** 2
+	SymbolNode* expression = SymbolNodeBinary(nodeArray, ADD, t3, a->values[0]);            // (a0 * a1 - a2) ** 2 + a0
+
+	SymbolMatrix* forward = SymbolNodeDifferentiateSymbolMatrix(expression, arraySymbolMatrix, a);
+	SymbolMatrix* reverse = SymbolNodeGradientSymbolMatrix(expression, arraySymbolMatrix, a);
+
+	SymbolNode* outputs[6];
+	for (unsigned int i = 0; i < 3; ++i) {
+		outputs[i] = forward->values[i];
+		outputs[3 + i] = reverse->values[i];
+	}
+	SymbolTape* tape = SymbolTapeCreate(a->values, 3, outputs, 6);
+
+	const float input[] = { 3, -2, 5 };
+	float output[6];
+	SymbolTapeEvaluate(tape, input, output);
+
+	// d/da0 = 2 (a0 a1 - a2) a1 + 1, d/da1 = 2 (a0 a1 - a2) a0, d/da2 = -2 (a0 a1 - a2)
+	cr_assert(ieee_ulp_eq(flt, 45, output[0], 4));
+	cr_assert(ieee_ulp_eq(flt, -66, output[1], 4));
+	cr_assert(ieee_ulp_eq(flt, 22, output[2], 4));
+	for (unsigned int i = 0; i < 3; ++i) {
+		cr_assert(ieee_ulp_eq(flt, output[i], output[3 + i], 4), "at %u", i);
+	}
+
+	SymbolTapeFree(tape);
+}
+
+Test(symdiff_matrix, gradient_square_negate, .init = setup, .fini = teardown) {
+	SymbolMatrix* a = SymbolMatrixCreate(arraySymbolMatrix, 1, 2);                 // a
+	SymbolMatrixSet(a, 0, 0, SymbolNodeVariable(arraySymbolMatrix->nodeArray));
+	SymbolMatrixSet(a, 0, 1, SymbolNodeVariable(arraySymbolMatrix->nodeArray));
+	SymbolNodeArray* nodeArray = arraySymbolMatrix->nodeArray;
+	SymbolMatrix* t1 = SymbolMatrixSquareElementWise(arraySymbolMatrix, a);                 // a ** 2
+	SymbolNode* t2 = SymbolNodeBinary(nodeArray, MULTIPLY, t1->values[0], a->values[1]);     // a0 ** 2 * a1
+	SymbolNode* t3 = SymbolNodeUnary(nodeArray, NEGATE, t1->values[1]);                       // -(a1 ** 2)
+	SymbolNode* expression = SymbolNodeBinary(nodeArray, ADD, t2, t3);                        // a0 ** 2 * a1 - a1 ** 2
+
+	SymbolMatrix* forward = SymbolNodeDifferentiateSymbolMatrix(expression, arraySymbolMatrix, a);
+	SymbolMatrix* reverse = SymbolNodeGradientSymbolMatrix(expression, arraySymbolMatrix, a);
+
+	SymbolNode* outputs[4] = { forward->values[0], forward->values[1], reverse->values[0], reverse->values[1] };
+	SymbolTape* tape = SymbolTapeCreate(a->values, 2, outputs, 4);
+
+	const float input[] = { 3, -2 };
+	float output[4];
+	SymbolTapeEvaluate(tape, input, output);
+
+	// d/da0 = 2 a0 a1, d/da1 = a0 ** 2 - 2 a1
+	cr_assert(ieee_ulp_eq(flt, -12, output[0], 4));
+	cr_assert(ieee_ulp_eq(flt, 13, output[1], 4));
+	cr_assert(ieee_ulp_eq(flt, output[0], output[2], 4));
+	cr_assert(ieee_ulp_eq(flt, output[1], output[3], 4));
+
+	SymbolTapeFree(tape);
+}
+
+Test(symdiff_matrix, gradient_dot, .init = setup, .fini = teardown) {
+	SymbolMatrix* a = SymbolMatrixCreate(arraySymbolMatrix, 1, 3);                 // a
+	SymbolMatrixSet(a, 0, 0, SymbolNodeVariable(arraySymbolMatrix->nodeArray));
+	SymbolMatrixSet(a, 0, 1, SymbolNodeVariable(arraySymbolMatrix->nodeArray));
+	SymbolMatrixSet(a, 0, 2, SymbolNodeVariable(arraySymbolMatrix->nodeArray));
+	SymbolNodeArray* nodeArray = arraySymbolMatrix->nodeArray;
+	SymbolMatrix* b = SymbolMatrixCreate(arraySymbolMatrix, 1, 3);                 // (a1, 2, a0)
+	SymbolMatrixSet(b, 0, 0, a->values[1]);
+	SymbolMatrixSet(b, 0, 1, SymbolNodeConstant(nodeArray, 2));
+	SymbolMatrixSet(b, 0, 2, a->values[0]);
+	SymbolNode* t1 = SymbolMatrixDot(arraySymbolMatrix, a, a);                              // a . a
+	SymbolNode* t2 = SymbolMatrixDot(arraySymbolMatrix, a, b);                              // a0 a1 + 2 a1 + a2 a0
+	SymbolNode* expression = SymbolNodeFma(nodeArray, SymbolNodeConstant(nodeArray, 0.5f), t1, t2);
+	cr_assert(eq(int, DOT, t1->operation));
+
+	SymbolMatrix* forward = SymbolNodeDifferentiateSymbolMatrix(expression, arraySymbolMatrix, a);
+	SymbolMatrix* reverse = SymbolNodeGradientSymbolMatrix(expression, arraySymbolMatrix, a);
+
+	SymbolNode* outputs[6];
+	for (unsigned int i = 0; i < 3; ++i) {
+		outputs[i] = forward->values[i];
+		outputs[3 + i] = reverse->values[i];
+	}
+	SymbolTape* tape = SymbolTapeCreate(a->values, 3, outputs, 6);
+
+	const float input[] = { 3, -2, 5 };
+	float output[6];
+	SymbolTapeEvaluate(tape, input, output);
+
+	// d/da0 = a0 + a1 + a2, d/da1 = a1 + a0 + 2, d/da2 = a2 + a0
+	cr_assert(ieee_ulp_eq(flt, 6, output[0], 4));
+	cr_assert(ieee_ulp_eq(flt, 3, output[1], 4));
+	cr_assert(ieee_ulp_eq(flt, 8, output[2], 4));
+	for (unsigned int i = 0; i < 3; ++i) {
+		cr_assert(ieee_ulp_eq(flt, output[i], output[3 + i], 4), "at %u", i);
+	}
+
+	SymbolTapeFree(tape);
+}
+
+Test(symdiff_matrix, gradient_unused, .init = setup, .fini = teardown) {
+	SymbolMatrix* a = SymbolMatrixCreate(arraySymbolMatrix, 2, 1);                 // a
+	SymbolMatrixSet(a, 0, 0, SymbolNodeVariable(arraySymbolMatrix->nodeArray));
+	SymbolMatrixSet(a, 1, 0, SymbolNodeVariable(arraySymbolMatrix->nodeArray));
+	SymbolNode* expression = SymbolNodeBinary(arraySymbolMatrix->nodeArray, MULTIPLY, a->values[0],
+	                                          SymbolNodeConstant(arraySymbolMatrix->nodeArray, 4)); // a0 * 4
+
+	SymbolMatrix* reverse = SymbolNodeGradientSymbolMatrix(expression, arraySymbolMatrix, a);
+
+	cr_assert(eq(int, CONSTANT, reverse->values[0]->operation));
+	cr_assert(ieee_ulp_eq(flt, 4, reverse->values[0]->data.value, 4));
+	cr_assert(eq(int, CONSTANT, reverse->values[1]->operation));
+	cr_assert(ieee_ulp_eq(flt, 0, reverse->values[1]->data.value, 4));
+
+	bool nonzero[2];
+	cr_assert(eq(uint, 1, SymbolMatrixSparsity(reverse, nonzero)));
+	cr_assert(nonzero[0]);
+	cr_assert(!nonzero[1]);
+}
+
+Test(symdiff_matrix, collect, .init = setup, .fini = teardown) {
+	SymbolMatrix* a = SymbolMatrixCreate(arraySymbolMatrix, 2, 1);                 // a
+	SymbolMatrixSet(a, 0, 0, SymbolNodeVariable(arraySymbolMatrix->nodeArray));
+	SymbolMatrixSet(a, 1, 0, SymbolNodeVariable(arraySymbolMatrix->nodeArray));
+	SymbolMatrix* b = SymbolMatrixSquareElementWise(arraySymbolMatrix, a);          // a ** 2
+	SymbolMatrix* c = SymbolMatrixAdd(arraySymbolMatrix, b, a);                     // a ** 2 + a
+	SymbolMatrix* dc = SymbolMatrixDifferentiateSymbolNode(c, arraySymbolMatrix, a->values[0]);
+	SymbolNode* sum = SymbolNodeBinary(arraySymbolMatrix->nodeArray, ADD, c->values[0], c->values[1]);
+	SymbolNode* product = SymbolNodeBinary(arraySymbolMatrix->nodeArray, MULTIPLY, c->values[0], c->values[1]); // unused
+	cr_assert(ne(ptr, product, NULL));
+	const SymbolMemoryStatistics before = SymbolMatrixArrayStatistics(arraySymbolMatrix);
+
+	SymbolMatrix* matrixRoots[] = { a, dc, a };
+	SymbolNode* nodeRoots[] = { sum };
+	SymbolMatrixArrayCollect(arraySymbolMatrix, matrixRoots, 3, nodeRoots, 1);
+	const SymbolMemoryStatistics after = SymbolMatrixArrayStatistics(arraySymbolMatrix);
+
+	cr_assert(eq(ptr, matrixRoots[0], matrixRoots[2]));
+	cr_assert(eq(sz, 2, after.matrixCount));
+	cr_assert(lt(sz, after.nodeCount, before.nodeCount));
+	cr_assert(lt(sz, after.usedBytes, before.usedBytes));
+
+	SymbolMatrix* x = matrixRoots[0];
+	SymbolNode* inputs[] = { x->values[0], x->values[1] };
+	SymbolNode* outputs[] = { nodeRoots[0], matrixRoots[1]->values[0], matrixRoots[1]->values[1] };
+	SymbolTape* tape = SymbolTapeCreate(inputs, 2, outputs, 3);
+	const float input[] = { 3, -2 };
+	float output[3];
+	SymbolTapeEvaluate(tape, input, output);
+
+	// 9 + 3 + 4 - 2, d/da0 (a ** 2 + a) = (2 a0 + 1, 0)
+	cr_assert(ieee_ulp_eq(flt, 14, output[0], 4));
+	cr_assert(ieee_ulp_eq(flt, 7, output[1], 4));
+	cr_assert(ieee_ulp_eq(flt, 0, output[2], 4));
+
+	SymbolTapeFree(tape);
+}
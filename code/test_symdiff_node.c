@@ -1,5 +1,7 @@
 #include <criterion/criterion.h>
 #include <criterion/new/assert.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "symdiff.h"
 
@@ -110,6 +112,76 @@ Test(symdiff_node, multiply, .init = setup, .fini = teardown) {
 	cr_assert(ieee_ulp_eq(flt, 0, valueD3, 4));
 }
 
+Test(symdiff_node, square_negate, .init = setup, .fini = teardown) {
+	SymbolNode* variable = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* t1 = SymbolNodeUnary(symbolNodeArray, SQUARE, variable); // v ** 2
+	SymbolNode* t2 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, SymbolNodeConstant(symbolNodeArray, 3), variable); // 3 * v
+	SymbolNode* expression = SymbolNodeUnary(symbolNodeArray, NEGATE, SymbolNodeBinary(symbolNodeArray, ADD, t1, t2)); // -(v ** 2 + 3 * v)
+	cr_assert(eq(ptr, t1, SymbolNodeUnary(symbolNodeArray, SQUARE, variable)));
+	cr_assert(eq(uint, 6, SymbolNodeCount(expression)));
+
+	const float value = SymbolNodeEvaluate(expression, symbolNodeArray, variable, 10)->data.value;
+	cr_assert(ieee_ulp_eq(flt, -130, value, 4));
+
+	SymbolNode* derivate = SymbolNodeDifferentiate(expression, symbolNodeArray, variable);
+	const float valueD = SymbolNodeEvaluate(derivate, symbolNodeArray, variable, 10)->data.value;
+	cr_assert(ieee_ulp_eq(flt, -23, valueD, 4));
+
+	SymbolNode* derivate2 = SymbolNodeDifferentiate(derivate, symbolNodeArray, variable);
+	const float valueD2 = SymbolNodeEvaluate(derivate2, symbolNodeArray, variable, 10)->data.value;
+	cr_assert(ieee_ulp_eq(flt, -2, valueD2, 4));
+}
+
+Test(symdiff_node, fma, .init = setup, .fini = teardown) {
+	SymbolNode* variable1 = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* variable2 = SymbolNodeVariable(symbolNodeArray); // w
+	SymbolNode* expression = SymbolNodeFma(symbolNodeArray, variable1, variable2, variable1); // v * w + v
+	cr_assert(eq(ptr, expression, SymbolNodeFma(symbolNodeArray, variable1, variable2, variable1)));
+	cr_assert(ne(ptr, expression, SymbolNodeFma(symbolNodeArray, variable1, variable2, variable2)));
+
+	SymbolNode* bound = SymbolNodeEvaluate(expression, symbolNodeArray, variable2, 5); // v * 5 + v
+	const float value = SymbolNodeEvaluate(bound, symbolNodeArray, variable1, 3)->data.value;
+	cr_assert(ieee_ulp_eq(flt, 18, value, 4));
+
+	SymbolNode* derivate = SymbolNodeDifferentiate(bound, symbolNodeArray, variable1);
+	const float valueD = SymbolNodeEvaluate(derivate, symbolNodeArray, variable1, 3)->data.value;
+	cr_assert(ieee_ulp_eq(flt, 6, valueD, 4));
+
+	SymbolNode* derivate2 = SymbolNodeDifferentiate(derivate, symbolNodeArray, variable1);
+	const float valueD2 = SymbolNodeEvaluate(derivate2, symbolNodeArray, variable1, 3)->data.value;
+	cr_assert(ieee_ulp_eq(flt, 0, valueD2, 4));
+}
+
+Test(symdiff_node, dot, .init = setup, .fini = teardown) {
+	SymbolNode* variable1 = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* variable2 = SymbolNodeVariable(symbolNodeArray); // w
+	SymbolNode* left[] = { variable1, SymbolNodeConstant(symbolNodeArray, 2), variable1 };
+	SymbolNode* right[] = { variable2, variable1, variable1 };
+	SymbolNode* expression = SymbolNodeDot(symbolNodeArray, left, right, 3); // v * w + 2 * v + v * v
+	cr_assert(eq(int, DOT, expression->operation));
+	cr_assert(eq(uint, 3, expression->data.dot.count));
+	cr_assert(eq(uint, 4, SymbolNodeCount(expression)));
+
+	// The factors are copied, the arrays passed in are not kept
+	left[0] = variable2;
+	cr_assert(eq(ptr, variable1, expression->data.dot.left[0]));
+	left[0] = variable1;
+	cr_assert(eq(ptr, expression, SymbolNodeDot(symbolNodeArray, left, right, 3)));
+	cr_assert(ne(ptr, expression, SymbolNodeDot(symbolNodeArray, left, right, 2)));
+
+	SymbolNode* bound = SymbolNodeEvaluate(expression, symbolNodeArray, variable2, 5); // v * 5 + 2 * v + v * v
+	const float value = SymbolNodeEvaluate(bound, symbolNodeArray, variable1, 3)->data.value;
+	cr_assert(ieee_ulp_eq(flt, 30, value, 4));
+
+	SymbolNode* derivate = SymbolNodeDifferentiate(bound, symbolNodeArray, variable1);
+	const float valueD = SymbolNodeEvaluate(derivate, symbolNodeArray, variable1, 3)->data.value;
+	cr_assert(ieee_ulp_eq(flt, 13, valueD, 4));
+
+	SymbolNode* derivate2 = SymbolNodeDifferentiate(derivate, symbolNodeArray, variable1);
+	const float valueD2 = SymbolNodeEvaluate(derivate2, symbolNodeArray, variable1, 3)->data.value;
+	cr_assert(ieee_ulp_eq(flt, 2, valueD2, 4));
+}
+
 Test(symdiff_node, general, .init = setup, .fini = teardown) {
 	// From https://www.cs.utexas.edu/users/novak/asg-symdif.html
 	// x3 + 2*x2 - 4*x + 3
@@ -137,3 +209,632 @@ Test(symdiff_node, general, .init = setup, .fini = teardown) {
 	const float valueD2 = SymbolNodeEvaluate(derivate2, symbolNodeArray, variable, 100)->data.value; // 6 * 100 + 4
 	cr_assert(ieee_ulp_eq(flt, 604, valueD2, 4));
 }
+
+Test(symdiff_node, variable_numbering, .init = setup, .fini = teardown) {
+	// Every array numbers its own variables, so arrays do not depend on each other
+	SymbolNodeArray* other = SymbolNodeArrayCreate();
+
+	cr_assert(eq(u32, SymbolNodeVariable(symbolNodeArray)->data.variableId, 0));
+	cr_assert(eq(u32, SymbolNodeVariable(other)->data.variableId, 0));
+	cr_assert(eq(u32, SymbolNodeVariable(symbolNodeArray)->data.variableId, 1));
+	cr_assert(eq(u32, SymbolNodeVariable(other)->data.variableId, 1));
+
+	SymbolNodeArrayFree(other);
+}
+
+Test(symdiff_node, differentiate_shared, .init = setup, .fini = teardown) {
+	// v ** (2 ** 40), every node is used twice by the next one, so without sharing derivatives this would not finish
+	SymbolNode* variable = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* expression = variable;
+	for (unsigned int i = 0; i < 40; ++i) {
+		expression = SymbolNodeBinary(symbolNodeArray, MULTIPLY, expression, expression);
+	}
+
+	SymbolNode* derivate = SymbolNodeDifferentiate(expression, symbolNodeArray, variable);
+	cr_assert(lt(uint, SymbolNodeCount(derivate), 4 * SymbolNodeCount(expression)));
+
+	// d(v ** 8)/dv = 8 * v ** 7 at v = 1
+	SymbolNode* small = variable;
+	for (unsigned int i = 0; i < 3; ++i) {
+		small = SymbolNodeBinary(symbolNodeArray, MULTIPLY, small, small);
+	}
+	SymbolNode* value = SymbolNodeEvaluate(SymbolNodeDifferentiate(small, symbolNodeArray, variable), symbolNodeArray,
+	                                       variable, 1.0f);
+	cr_assert(ieee_ulp_eq(flt, value->data.value, 8.0f, 4));
+}
+
+Test(symdiff_node, tape, .init = setup, .fini = teardown) {
+	// x3 + 2*x2 - 4*x + 3 and its derivative, evaluated together
+	SymbolNode* variable = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* t1 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, variable, variable); // v**2
+	SymbolNode* t2 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, t1, variable); // v**3
+	SymbolNode* t3 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, SymbolNodeConstant(symbolNodeArray, 2), t1); // 2 * v**2
+	SymbolNode* t4 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, SymbolNodeConstant(symbolNodeArray, 4), variable); // 4 * v
+	SymbolNode* t5 = SymbolNodeBinary(symbolNodeArray, ADD, t2, t3); // v**3 + 2 * v**2
+	SymbolNode* t6 = SymbolNodeBinary(symbolNodeArray, SUSTRACT, t5, t4); // v**3 + 2 * v**2 - 4 * v
+	SymbolNode* expression = SymbolNodeBinary(symbolNodeArray, ADD, t6, SymbolNodeConstant(symbolNodeArray, 3));
+	SymbolNode* derivate = SymbolNodeDifferentiate(expression, symbolNodeArray, variable);
+
+	SymbolNode* inputs[] = { variable };
+	SymbolNode* outputs[] = { expression, derivate };
+	SymbolTape* tape = SymbolTapeCreate(inputs, 1, outputs, 2);
+
+	for (int i = -10; i <= 10; ++i) {
+		const float input[] = { (float) i };
+		float output[2];
+		SymbolTapeEvaluate(tape, input, output);
+
+		const float value = SymbolNodeEvaluate(expression, symbolNodeArray, variable, (float) i)->data.value;
+		const float valueD = SymbolNodeEvaluate(derivate, symbolNodeArray, variable, (float) i)->data.value;
+		cr_assert(ieee_ulp_eq(flt, value, output[0], 4), "at %d", i);
+		cr_assert(ieee_ulp_eq(flt, valueD, output[1], 4), "at %d", i);
+	}
+
+	SymbolTapeFree(tape);
+}
+
+Test(symdiff_node, tape_passthrough, .init = setup, .fini = teardown) {
+	SymbolNode* variable1 = SymbolNodeVariable(symbolNodeArray);
+	SymbolNode* variable2 = SymbolNodeVariable(symbolNodeArray);
+	SymbolNode* constant = SymbolNodeConstant(symbolNodeArray, 7);
+
+	SymbolNode* inputs[] = { variable1, variable2 };
+	SymbolNode* outputs[] = { variable2, constant, variable1 };
+	SymbolTape* tape = SymbolTapeCreate(inputs, 2, outputs, 3);
+
+	const float input[] = { 1, 2 };
+	float output[3];
+	SymbolTapeEvaluate(tape, input, output);
+
+	cr_assert(ieee_ulp_eq(flt, 2, output[0], 4));
+	cr_assert(ieee_ulp_eq(flt, 7, output[1], 4));
+	cr_assert(ieee_ulp_eq(flt, 1, output[2], 4));
+	cr_assert(eq(uint, 0, tape->instructionCount));
+
+	SymbolTapeFree(tape);
+}
+
+Test(symdiff_node, interning, .init = setup, .fini = teardown) {
+	SymbolNode* variable = SymbolNodeVariable(symbolNodeArray);
+	SymbolNode* t1 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, variable, SymbolNodeConstant(symbolNodeArray, 2));
+	const size_t size = symbolNodeArray->size;
+	SymbolNode* t2 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, variable, SymbolNodeConstant(symbolNodeArray, 2));
+
+	cr_assert(eq(ptr, t1, t2));
+	cr_assert(eq(sz, size, symbolNodeArray->size));
+	cr_assert(ne(ptr, SymbolNodeConstant(symbolNodeArray, 0.0f), SymbolNodeConstant(symbolNodeArray, -0.0f)));
+	cr_assert(ne(ptr, t1, SymbolNodeBinary(symbolNodeArray, MULTIPLY, SymbolNodeConstant(symbolNodeArray, 2), variable)));
+	cr_assert(ne(ptr, variable, SymbolNodeVariable(symbolNodeArray)));
+}
+
+Test(symdiff_node, simplify, .init = setup, .fini = teardown) {
+	SymbolNode* variable = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* t1 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, SymbolNodeConstant(symbolNodeArray, 0), variable); // 0 * v
+	SymbolNode* t2 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, variable, SymbolNodeConstant(symbolNodeArray, 1)); // v * 1
+	SymbolNode* t3 = SymbolNodeBinary(symbolNodeArray, ADD, t1, t2); // 0 * v + v * 1
+	SymbolNode* t4 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, t3, SymbolNodeConstant(symbolNodeArray, 2)); // (0 * v + v * 1) * 2
+	SymbolNode* t5 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, SymbolNodeConstant(symbolNodeArray, 3), t4); // 3 * (0 * v + v * 1) * 2
+	SymbolNode* expression = SymbolNodeBinary(symbolNodeArray, SUSTRACT, t5, SymbolNodeConstant(symbolNodeArray, 0)); // 3 * (0 * v + v * 1) * 2 - 0
+
+	SymbolNode* simplified = SymbolNodeSimplify(expression, symbolNodeArray); // 6 * v
+	cr_assert(eq(int, MULTIPLY, simplified->operation));
+	cr_assert(ieee_ulp_eq(flt, 6, simplified->data.children.left->data.value, 4));
+	cr_assert(eq(ptr, variable, simplified->data.children.right));
+	cr_assert(eq(uint, 3, SymbolNodeCount(simplified)));
+
+	const float value = SymbolNodeEvaluate(expression, symbolNodeArray, variable, 100)->data.value;
+	const float valueSimplified = SymbolNodeEvaluate(simplified, symbolNodeArray, variable, 100)->data.value;
+	cr_assert(ieee_ulp_eq(flt, value, valueSimplified, 4));
+
+	SymbolNode* derivate = SymbolNodeSimplify(SymbolNodeDifferentiate(simplified, symbolNodeArray, variable), symbolNodeArray);
+	cr_assert(eq(int, CONSTANT, derivate->operation));
+	cr_assert(ieee_ulp_eq(flt, 6, derivate->data.value, 4));
+}
+
+Test(symdiff_node, simplify_fused, .init = setup, .fini = teardown) {
+	SymbolNode* variable1 = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* variable2 = SymbolNodeVariable(symbolNodeArray); // w
+	SymbolNode* zero = SymbolNodeConstant(symbolNodeArray, 0);
+
+	SymbolNode* t1 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, variable1, variable1); // v * v
+	SymbolNode* square = SymbolNodeSimplify(t1, symbolNodeArray); // v ** 2
+	cr_assert(eq(int, SQUARE, square->operation));
+	cr_assert(eq(ptr, variable1, square->data.children.left));
+
+	SymbolNode* t2 = SymbolNodeBinary(symbolNodeArray, SUSTRACT, zero, variable1); // 0 - v
+	SymbolNode* negate = SymbolNodeSimplify(t2, symbolNodeArray); // -v
+	cr_assert(eq(int, NEGATE, negate->operation));
+	cr_assert(eq(ptr, variable1, negate->data.children.left));
+
+	SymbolNode* t3 = SymbolNodeBinary(symbolNodeArray, SUSTRACT, zero, t2); // 0 - (0 - v)
+	cr_assert(eq(ptr, variable1, SymbolNodeSimplify(t3, symbolNodeArray)));
+
+	SymbolNode* t4 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, t2, t2); // (0 - v) * (0 - v)
+	cr_assert(eq(ptr, square, SymbolNodeSimplify(t4, symbolNodeArray)));
+
+	SymbolNode* t5 = SymbolNodeBinary(symbolNodeArray, ADD, variable2, t2); // w + (0 - v)
+	SymbolNode* difference = SymbolNodeSimplify(t5, symbolNodeArray); // w - v
+	cr_assert(eq(int, SUSTRACT, difference->operation));
+	cr_assert(eq(ptr, variable2, difference->data.children.left));
+	cr_assert(eq(ptr, variable1, difference->data.children.right));
+
+	SymbolNode* t6 = SymbolNodeUnary(symbolNodeArray, SQUARE, SymbolNodeConstant(symbolNodeArray, -3)); // (-3) ** 2
+	SymbolNode* folded = SymbolNodeSimplify(t6, symbolNodeArray);
+	cr_assert(eq(int, CONSTANT, folded->operation));
+	cr_assert(ieee_ulp_eq(flt, 9, folded->data.value, 4));
+}
+
+Test(symdiff_node, simplify_general, .init = setup, .fini = teardown) {
+	// x3 + 2*x2 - 4*x + 3
+	SymbolNode* variable = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* t1 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, variable, variable); // v**2
+	SymbolNode* t2 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, t1, variable); // v**3
+	SymbolNode* t3 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, SymbolNodeConstant(symbolNodeArray, 2), t1); // 2 * v**2
+	SymbolNode* t4 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, SymbolNodeConstant(symbolNodeArray, 4), variable); // 4 * v
+	SymbolNode* t5 = SymbolNodeBinary(symbolNodeArray, ADD, t2, t3); // v**3 + 2 * v**2
+	SymbolNode* t6 = SymbolNodeBinary(symbolNodeArray, SUSTRACT, t5, t4); // v**3 + 2 * v**2 - 4 * v
+	SymbolNode* expression = SymbolNodeBinary(symbolNodeArray, ADD, t6, SymbolNodeConstant(symbolNodeArray, 3));
+
+	SymbolNode* derivate = SymbolNodeDifferentiate(SymbolNodeDifferentiate(expression, symbolNodeArray, variable), symbolNodeArray, variable);
+	SymbolNode* simplified = SymbolNodeSimplify(derivate, symbolNodeArray);
+	cr_assert(lt(uint, SymbolNodeCount(simplified), SymbolNodeCount(derivate)));
+
+	for (int i = -10; i <= 10; ++i) {
+		const float value = SymbolNodeEvaluate(derivate, symbolNodeArray, variable, (float) i)->data.value;
+		const float valueSimplified = SymbolNodeEvaluate(simplified, symbolNodeArray, variable, (float) i)->data.value;
+		cr_assert(ieee_ulp_eq(flt, value, valueSimplified, 4), "at %d", i);
+	}
+}
+
+Test(symdiff_node, simplify_fma_dot, .init = setup, .fini = teardown) {
+	SymbolNode* variable1 = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* variable2 = SymbolNodeVariable(symbolNodeArray); // w
+	SymbolNode* zero = SymbolNodeConstant(symbolNodeArray, 0);
+	SymbolNode* one = SymbolNodeConstant(symbolNodeArray, 1);
+	SymbolNode* two = SymbolNodeConstant(symbolNodeArray, 2);
+
+	SymbolNode* product = SymbolNodeSimplify(SymbolNodeFma(symbolNodeArray, variable1, variable2, zero), symbolNodeArray);
+	cr_assert(eq(int, MULTIPLY, product->operation)); // v * w
+
+	cr_assert(eq(ptr, variable2, SymbolNodeSimplify(SymbolNodeFma(symbolNodeArray, zero, variable1, variable2), symbolNodeArray)));
+
+	SymbolNode* sum = SymbolNodeSimplify(SymbolNodeFma(symbolNodeArray, variable1, one, variable2), symbolNodeArray);
+	cr_assert(eq(int, ADD, sum->operation)); // v + w
+
+	SymbolNode* scaled = SymbolNodeSimplify(SymbolNodeFma(symbolNodeArray, variable1, two, variable2), symbolNodeArray);
+	cr_assert(eq(int, FMA, scaled->operation)); // 2 * v + w
+	cr_assert(eq(ptr, two, scaled->data.children.left));
+	cr_assert(eq(ptr, variable1, scaled->data.children.right));
+	cr_assert(eq(ptr, variable2, scaled->data.children.addend));
+
+	SymbolNode* folded = SymbolNodeSimplify(SymbolNodeFma(symbolNodeArray, two, two, one), symbolNodeArray);
+	cr_assert(eq(int, CONSTANT, folded->operation));
+	cr_assert(ieee_ulp_eq(flt, 5, folded->data.value, 4));
+
+	// v * 0 + 2 * 2 + w * 2 + v * w is 4 + DOT(2 * w, v * w)
+	SymbolNode* left[] = { variable1, two, variable2, variable1 };
+	SymbolNode* right[] = { zero, two, two, variable2 };
+	SymbolNode* expression = SymbolNodeDot(symbolNodeArray, left, right, 4);
+	SymbolNode* simplified = SymbolNodeSimplify(expression, symbolNodeArray);
+	cr_assert(eq(int, ADD, simplified->operation));
+	cr_assert(ieee_ulp_eq(flt, 4, simplified->data.children.left->data.value, 4));
+	SymbolNode* dot = simplified->data.children.right;
+	cr_assert(eq(int, DOT, dot->operation));
+	cr_assert(eq(uint, 2, dot->data.dot.count));
+	cr_assert(eq(ptr, two, dot->data.dot.left[0]));
+	cr_assert(eq(ptr, variable2, dot->data.dot.right[0]));
+
+	// A single term left is a multiply add
+	SymbolNode* single = SymbolNodeSimplify(SymbolNodeDot(symbolNodeArray, left, right, 3), symbolNodeArray);
+	cr_assert(eq(int, FMA, single->operation)); // 2 * w + 4
+
+	SymbolNode* empty = SymbolNodeSimplify(SymbolNodeDot(symbolNodeArray, left, right, 1), symbolNodeArray);
+	cr_assert(eq(int, CONSTANT, empty->operation));
+	cr_assert(ieee_ulp_eq(flt, 0, empty->data.value, 4));
+}
+
+Test(symdiff_node, tape_dual, .init = setup, .fini = teardown) {
+	// f(v, w) = v * v * w - w, its derivative in the direction (1, 0) is 2 * v * w
+	SymbolNode* variable1 = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* variable2 = SymbolNodeVariable(symbolNodeArray); // w
+	SymbolNode* t1 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, variable1, variable1); // v * v
+	SymbolNode* t2 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, t1, variable2); // v * v * w
+	SymbolNode* expression = SymbolNodeBinary(symbolNodeArray, SUSTRACT, t2, variable2); // v * v * w - w
+	SymbolNode* derivate = SymbolNodeDifferentiate(expression, symbolNodeArray, variable1);
+
+	SymbolNode* inputs[] = { variable1, variable2 };
+	SymbolNode* outputs[] = { expression, derivate };
+	SymbolTape* tape = SymbolTapeCreate(inputs, 2, outputs, 2);
+
+	const float input[] = { 3, 5 };
+	const float inputTangent[] = { 1, 0 };
+	float output[2];
+	float outputTangent[2];
+	SymbolTapeEvaluateDual(tape, input, inputTangent, output, outputTangent);
+
+	cr_assert(ieee_ulp_eq(flt, 40, output[0], 4));
+	cr_assert(ieee_ulp_eq(flt, 30, output[1], 4));
+	cr_assert(ieee_ulp_eq(flt, 30, outputTangent[0], 4));
+	cr_assert(ieee_ulp_eq(flt, 10, outputTangent[1], 4));
+
+	SymbolTapeFree(tape);
+}
+
+Test(symdiff_node, tape_dual_batch, .init = setup, .fini = teardown) {
+	// f(v, w) = (v - w) * (v - w) * 0.5 + v
+	SymbolNode* variable1 = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* variable2 = SymbolNodeVariable(symbolNodeArray); // w
+	SymbolNode* t1 = SymbolNodeBinary(symbolNodeArray, SUSTRACT, variable1, variable2); // v - w
+	SymbolNode* t2 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, t1, t1); // (v - w) ** 2
+	SymbolNode* t3 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, t2, SymbolNodeConstant(symbolNodeArray, 0.5f)); // (v - w) ** 2 / 2
+	SymbolNode* expression = SymbolNodeBinary(symbolNodeArray, ADD, t3, variable1); // (v - w) ** 2 / 2 + v
+
+	SymbolNode* inputs[] = { variable1, variable2 };
+	SymbolNode* outputs[] = { expression, t1 };
+	SymbolTape* tape = SymbolTapeCreate(inputs, 2, outputs, 2);
+
+	// Not a multiple of any SIMD width, so the remainder is evaluated one by one
+	const unsigned int count = 37;
+	float batchInputs[2 * 37];
+	float batchInputTangents[2 * 37];
+	float batchOutputs[2 * 37];
+	float batchOutputTangents[2 * 37];
+	for (unsigned int j = 0; j < count; ++j) {
+		batchInputs[0 * count + j] = (float) j;
+		batchInputs[1 * count + j] = (float) j * -0.5f + 3;
+		batchInputTangents[0 * count + j] = 1;
+		batchInputTangents[1 * count + j] = (float) j;
+	}
+
+	SymbolTapeEvaluateDualBatch(tape, count, batchInputs, batchInputTangents, batchOutputs, batchOutputTangents);
+
+	for (unsigned int j = 0; j < count; ++j) {
+		const float input[] = { batchInputs[j], batchInputs[count + j] };
+		const float inputTangent[] = { batchInputTangents[j], batchInputTangents[count + j] };
+		float output[2];
+		float outputTangent[2];
+		SymbolTapeEvaluateDual(tape, input, inputTangent, output, outputTangent);
+
+		for (unsigned int i = 0; i < 2; ++i) {
+			cr_assert(ieee_ulp_eq(flt, output[i], batchOutputs[i * count + j], 4), "at output %u set %u", i, j);
+			cr_assert(ieee_ulp_eq(flt, outputTangent[i], batchOutputTangents[i * count + j], 4), "at output %u set %u", i, j);
+		}
+	}
+
+	SymbolTapeFree(tape);
+}
+
+Test(symdiff_node, tape_jit, .init = setup, .fini = teardown) {
+	// f(v, w) = (v - w) * (v - w) * 0.5 + v * 3, g(v, w) = v * w - w, h(v, w) = -((v - w) ** 2)
+	SymbolNode* variable1 = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* variable2 = SymbolNodeVariable(symbolNodeArray); // w
+	SymbolNode* t1 = SymbolNodeBinary(symbolNodeArray, SUSTRACT, variable1, variable2); // v - w
+	SymbolNode* t2 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, t1, t1); // (v - w) ** 2
+	SymbolNode* t3 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, t2, SymbolNodeConstant(symbolNodeArray, 0.5f)); // (v - w) ** 2 / 2
+	SymbolNode* t4 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, variable1, SymbolNodeConstant(symbolNodeArray, 3)); // v * 3
+	SymbolNode* f = SymbolNodeBinary(symbolNodeArray, ADD, t3, t4); // (v - w) ** 2 / 2 + v * 3
+	SymbolNode* t5 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, variable1, variable2); // v * w
+	SymbolNode* g = SymbolNodeBinary(symbolNodeArray, SUSTRACT, t5, variable2); // v * w - w
+	SymbolNode* h = SymbolNodeUnary(symbolNodeArray, NEGATE, SymbolNodeUnary(symbolNodeArray, SQUARE, t1)); // -((v - w) ** 2)
+
+	SymbolNode* inputs[] = { variable1, variable2 };
+	SymbolNode* outputs[] = { f, g, variable2, h };
+	SymbolTape* tape = SymbolTapeCreate(inputs, 2, outputs, 4);
+
+	SymbolJit* jit = SymbolJitCreate(tape);
+	if(jit == NULL) {
+		// No JIT on this architecture, the tape is interpreted
+		SymbolTapeFree(tape);
+		return;
+	}
+
+	const unsigned int count = 53;
+	float batchInputs[2 * 53];
+	float batchInputTangents[2 * 53];
+	float jitOutputs[4 * 53];
+	float jitOutputTangents[4 * 53];
+
+	srand(11);
+	for (unsigned int i = 0; i < 2 * count; ++i) {
+		batchInputs[i] = (float) rand() / (float) RAND_MAX * 200.0f - 100.0f;
+		batchInputTangents[i] = (float) rand() / (float) RAND_MAX * 20.0f - 10.0f;
+	}
+
+	jit->function(count, batchInputs, batchInputTangents, jitOutputs, jitOutputTangents);
+
+	// Compared one set at a time, both round every operation the same way
+	for (unsigned int j = 0; j < count; ++j) {
+		const float input[] = { batchInputs[j], batchInputs[count + j] };
+		const float inputTangent[] = { batchInputTangents[j], batchInputTangents[count + j] };
+		float output[4];
+		float outputTangent[4];
+		SymbolTapeEvaluateDual(tape, input, inputTangent, output, outputTangent);
+
+		for (unsigned int i = 0; i < 4; ++i) {
+			cr_assert(eq(flt, output[i], jitOutputs[i * count + j]), "at output %u set %u", i, j);
+			cr_assert(eq(flt, outputTangent[i], jitOutputTangents[i * count + j]), "at output %u set %u", i, j);
+		}
+	}
+
+	// An empty batch must not touch the buffers
+	jit->function(0, NULL, NULL, NULL, NULL);
+
+	SymbolJitFree(jit);
+	SymbolTapeFree(tape);
+}
+
+Test(symdiff_node, graph, .init = setup, .fini = teardown) {
+	// f(v, w) = (v - w) * (v - w) + v * 3, g(v, w) = v * w
+	SymbolNode* variable1 = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* variable2 = SymbolNodeVariable(symbolNodeArray); // w
+	SymbolNode* t1 = SymbolNodeBinary(symbolNodeArray, SUSTRACT, variable1, variable2); // v - w
+	SymbolNode* t2 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, t1, t1); // (v - w) ** 2
+	SymbolNode* t3 = SymbolNodeBinary(symbolNodeArray, MULTIPLY, variable1, SymbolNodeConstant(symbolNodeArray, 3)); // v * 3
+	SymbolNode* f = SymbolNodeBinary(symbolNodeArray, ADD, t2, t3); // (v - w) ** 2 + v * 3
+	SymbolNode* g = SymbolNodeBinary(symbolNodeArray, MULTIPLY, variable1, variable2); // v * w
+
+	SymbolNode* inputs[] = { variable1, variable2 };
+	SymbolNode* outputs[] = { f, g };
+	SymbolGraph* graph = SymbolGraphCreate(inputs, 2, outputs, 2);
+
+	// v, w, v - w, (v - w) ** 2, 3, v * 3, f, g
+	cr_assert(eq(u32, graph->nodeCount, 8));
+
+	// Children always come first
+	for (uint32_t i = 0; i < graph->nodeCount; ++i) {
+		const SymbolGraphNode node = graph->nodes[i];
+		if(node.operation == ADD || node.operation == SUSTRACT || node.operation == MULTIPLY) {
+			cr_assert(lt(uint, node.data.children.left, i));
+			cr_assert(lt(uint, node.data.children.right, i));
+		}
+	}
+
+	// The block has no pointers, a plain copy is a working graph
+	SymbolGraph* copy = malloc(SymbolGraphSize(graph));
+	memcpy(copy, graph, SymbolGraphSize(graph));
+	SymbolGraphFree(graph);
+
+	float values[8];
+	const float input[] = { 5, -2 };
+	float output[2];
+	SymbolGraphEvaluate(copy, input, values, output);
+	cr_assert(ieee_ulp_eq(flt, output[0], 7 * 7 + 5 * 3, 4));
+	cr_assert(ieee_ulp_eq(flt, output[1], 5 * -2, 4));
+
+	SymbolTape* tape = SymbolTapeCreateGraph(copy);
+	SymbolTapeEvaluate(tape, input, output);
+	cr_assert(ieee_ulp_eq(flt, output[0], 7 * 7 + 5 * 3, 4));
+	cr_assert(ieee_ulp_eq(flt, output[1], 5 * -2, 4));
+	SymbolTapeFree(tape);
+
+	// Rebuilding goes through interning, so the same nodes come back
+	SymbolNode* rebuilt[2];
+	SymbolGraphToNodes(copy, symbolNodeArray, inputs, rebuilt);
+	cr_assert(eq(ptr, rebuilt[0], f));
+	cr_assert(eq(ptr, rebuilt[1], g));
+
+	SymbolGraphFree(copy);
+}
+
+Test(symdiff_node, graph_file, .init = setup, .fini = teardown) {
+	SymbolNode* variable1 = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* variable2 = SymbolNodeVariable(symbolNodeArray); // w
+	SymbolNode* t1 = SymbolNodeBinary(symbolNodeArray, SUSTRACT, variable1, variable2); // v - w
+	SymbolNode* f = SymbolNodeBinary(symbolNodeArray, MULTIPLY, t1, SymbolNodeConstant(symbolNodeArray, 2)); // (v - w) * 2
+
+	SymbolNode* inputs[] = { variable1, variable2 };
+	SymbolNode* outputs[] = { f };
+	SymbolGraph* graph = SymbolGraphCreate(inputs, 2, outputs, 1);
+
+	char path[] = "/tmp/symdiff_graph_XXXXXX";
+	close(mkstemp(path));
+	cr_assert(SymbolGraphWrite(graph, 42, path));
+
+	// Another key is another build, the file is not used
+	cr_assert(eq(ptr, SymbolGraphFileOpen(path, 41), NULL));
+
+	SymbolGraphFile* file = SymbolGraphFileOpen(path, 42);
+	cr_assert(ne(ptr, file, NULL));
+	cr_assert(eq(sz, SymbolGraphSize(file->graph), SymbolGraphSize(graph)));
+	cr_assert(eq(int, memcmp(file->graph, graph, SymbolGraphSize(graph)), 0));
+
+	float values[5];
+	const float input[] = { 5, -2 };
+	float output[1];
+	SymbolGraphEvaluate(file->graph, input, values, output);
+	cr_assert(ieee_ulp_eq(flt, output[0], 14, 4));
+	SymbolGraphFileClose(file);
+
+	// A truncated file does not hold the whole graph
+	cr_assert(eq(int, truncate(path, sizeof(SymbolGraphFileHeader) + SymbolGraphSize(graph) - 4), 0));
+	cr_assert(eq(ptr, SymbolGraphFileOpen(path, 42), NULL));
+
+	remove(path);
+	SymbolGraphFree(graph);
+}
+
+Test(symdiff_node, fma_dot_compiled, .init = setup, .fini = teardown) {
+	// f(u, v, w) = u * u + v * w + w, g(u, v, w) = v * 3 + u, h(u, v, w) = u * v - w
+	SymbolNode* variables[] = {
+		SymbolNodeVariable(symbolNodeArray), SymbolNodeVariable(symbolNodeArray), SymbolNodeVariable(symbolNodeArray)
+	};
+	SymbolNode* one = SymbolNodeConstant(symbolNodeArray, 1);
+	SymbolNode* left[] = { variables[0], variables[1], one };
+	SymbolNode* right[] = { variables[0], variables[2], variables[2] };
+	SymbolNode* f = SymbolNodeDot(symbolNodeArray, left, right, 3);
+	SymbolNode* g = SymbolNodeFma(symbolNodeArray, variables[1], SymbolNodeConstant(symbolNodeArray, 3), variables[0]);
+	SymbolNode* h = SymbolNodeFma(symbolNodeArray, variables[0], variables[1],
+	                              SymbolNodeUnary(symbolNodeArray, NEGATE, variables[2]));
+	SymbolNode* outputs[] = { f, g, h, SymbolNodeDifferentiate(f, symbolNodeArray, variables[0]) };
+
+	SymbolGraph* graph = SymbolGraphCreate(variables, 3, outputs, 4);
+	SymbolTape* tape = SymbolTapeCreate(variables, 3, outputs, 4);
+	SymbolTape* graphTape = SymbolTapeCreateGraph(graph);
+
+	const float input[] = { 2, -3, 5 };
+	const float inputTangent[] = { 1, 0.5f, -2 };
+	const float expected[] = { 4 - 15 + 5, -9 + 2, -6 - 5, 4 };
+	const float expectedTangent[] = { 4 + 2.5f + 6 - 2, 1.5f + 1, -3 + 1 + 2, 2 };
+	float values[32];
+	float output[4];
+	float outputTangent[4];
+
+	SymbolGraphEvaluate(graph, input, values, output);
+	for (unsigned int i = 0; i < 4; ++i) {
+		cr_assert(ieee_ulp_eq(flt, expected[i], output[i], 4), "at output %u", i);
+	}
+
+	SymbolTapeEvaluate(graphTape, input, output);
+	for (unsigned int i = 0; i < 4; ++i) {
+		cr_assert(ieee_ulp_eq(flt, expected[i], output[i], 4), "at output %u", i);
+	}
+
+	SymbolTapeEvaluateDual(tape, input, inputTangent, output, outputTangent);
+	for (unsigned int i = 0; i < 4; ++i) {
+		cr_assert(ieee_ulp_eq(flt, expected[i], output[i], 4), "at output %u", i);
+		cr_assert(ieee_ulp_eq(flt, expectedTangent[i], outputTangent[i], 4), "at output %u", i);
+	}
+
+	// Rebuilding goes through interning, the factors of DOT included
+	SymbolNode* rebuilt[4];
+	SymbolGraphToNodes(graph, symbolNodeArray, variables, rebuilt);
+	for (unsigned int i = 0; i < 4; ++i) {
+		cr_assert(eq(ptr, outputs[i], rebuilt[i]), "at output %u", i);
+	}
+
+	char path[] = "/tmp/symdiff_graph_XXXXXX";
+	close(mkstemp(path));
+	cr_assert(SymbolGraphWrite(graph, 7, path));
+	SymbolGraphFile* file = SymbolGraphFileOpen(path, 7);
+	cr_assert(ne(ptr, file, NULL));
+	cr_assert(eq(int, memcmp(file->graph, graph, SymbolGraphSize(graph)), 0));
+	SymbolGraphFileClose(file);
+	remove(path);
+
+	// The batch kernels and the JIT fuse every FMA like the interpreter does with fmaf, so results are exact
+	const unsigned int count = 29;
+	float batchInputs[3 * 29];
+	float batchInputTangents[3 * 29];
+	float batchOutputs[4 * 29];
+	float batchOutputTangents[4 * 29];
+	srand(5);
+	for (unsigned int i = 0; i < 3 * count; ++i) {
+		batchInputs[i] = (float) rand() / (float) RAND_MAX * 20.0f - 10.0f;
+		batchInputTangents[i] = (float) rand() / (float) RAND_MAX * 2.0f - 1.0f;
+	}
+
+	SymbolJit* jit = SymbolJitCreate(tape);
+	for (unsigned int pass = 0; pass < 2; ++pass) {
+		if(pass == 0) {
+			SymbolTapeEvaluateDualBatch(tape, count, batchInputs, batchInputTangents, batchOutputs, batchOutputTangents);
+		} else if(jit != NULL) {
+			jit->function(count, batchInputs, batchInputTangents, batchOutputs, batchOutputTangents);
+		} else {
+			// No JIT on this architecture, the tape is interpreted
+			break;
+		}
+
+		for (unsigned int j = 0; j < count; ++j) {
+			const float setInput[] = { batchInputs[j], batchInputs[count + j], batchInputs[2 * count + j] };
+			const float setInputTangent[] = {
+				batchInputTangents[j], batchInputTangents[count + j], batchInputTangents[2 * count + j]
+			};
+			SymbolTapeEvaluateDual(tape, setInput, setInputTangent, output, outputTangent);
+
+			for (unsigned int i = 0; i < 4; ++i) {
+				cr_assert(eq(flt, output[i], batchOutputs[i * count + j]), "pass %u output %u set %u", pass, i, j);
+				cr_assert(eq(flt, outputTangent[i], batchOutputTangents[i * count + j]), "pass %u output %u set %u", pass, i, j);
+			}
+		}
+	}
+
+	if(jit != NULL) {
+		SymbolJitFree(jit);
+	}
+	SymbolTapeFree(graphTape);
+	SymbolTapeFree(tape);
+	SymbolGraphFree(graph);
+}
+
+Test(symdiff_node, deep, .init = setup, .fini = teardown) {
+	const unsigned int depth = 200000;
+	SymbolNode* variable = SymbolNodeVariable(symbolNodeArray); // x
+	SymbolNode* f = variable;
+	for (unsigned int i = 0; i < depth; ++i) {
+		f = SymbolNodeBinary(symbolNodeArray, ADD, f, variable); // (((x + x) + x) + ...)
+	}
+	cr_assert(eq(uint, depth + 1, SymbolNodeCount(f)));
+
+	SymbolNode* value = SymbolNodeEvaluate(f, symbolNodeArray, variable, 0.5f);
+	cr_assert(eq(int, CONSTANT, value->operation));
+	cr_assert(ieee_ulp_eq(flt, (depth + 1) * 0.5f, value->data.value, 4));
+
+	SymbolNode* derivative = SymbolNodeSimplify(SymbolNodeDifferentiate(f, symbolNodeArray, variable), symbolNodeArray);
+	cr_assert(ieee_ulp_eq(flt, depth + 1, SymbolNodeEvaluate(derivative, symbolNodeArray, variable, 3)->data.value, 4));
+
+	SymbolNode* inputs[] = { variable };
+	SymbolNode* outputs[] = { f };
+	SymbolTape* tape = SymbolTapeCreate(inputs, 1, outputs, 1);
+	float output[1];
+	SymbolTapeEvaluate(tape, (float[]) { 2 }, output);
+	cr_assert(ieee_ulp_eq(flt, (depth + 1) * 2.0f, output[0], 4));
+	SymbolTapeFree(tape);
+
+	SymbolGraph* graph = SymbolGraphCreate(inputs, 1, outputs, 1);
+	cr_assert(eq(uint, depth + 1, graph->nodeCount));
+	SymbolGraphFree(graph);
+
+	// Far longer than a log message, cut instead of overflowing
+	SymbolNodePrint(f);
+}
+
+Test(symdiff_node, collect, .init = setup, .fini = teardown) {
+	SymbolNode* variable1 = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* variable2 = SymbolNodeVariable(symbolNodeArray); // w
+	SymbolNode* t1 = SymbolNodeBinary(symbolNodeArray, SUSTRACT, variable1, variable2); // v - w
+	SymbolNode* f = SymbolNodeUnary(symbolNodeArray, SQUARE, t1); // (v - w) ** 2
+	SymbolNode* df = SymbolNodeDifferentiate(f, symbolNodeArray, variable1); // unused
+	cr_assert(ne(ptr, df, NULL));
+	const size_t size = SymbolNodeArrayStatistics(symbolNodeArray).nodeCount;
+
+	SymbolNode* roots[] = { f, NULL, variable1 };
+	SymbolNodeArrayCollect(symbolNodeArray, roots, 3);
+	cr_assert(eq(ptr, roots[1], NULL));
+	cr_assert(eq(uint, 4, SymbolNodeArrayStatistics(symbolNodeArray).nodeCount));
+	cr_assert(lt(sz, 4, size));
+	cr_assert(eq(uint, 4, SymbolNodeCount(roots[0])));
+	cr_assert(ieee_ulp_eq(flt, 4, SymbolNodeEvaluate(SymbolNodeEvaluate(roots[0], symbolNodeArray, roots[2], 5),
+	                                                 symbolNodeArray, roots[0]->data.children.left->data.children.right,
+	                                                 3)->data.value, 4));
+
+	// Moved nodes are interned again, new variables do not reuse the numbers of released ones
+	SymbolNode* v = roots[2];
+	SymbolNode* w = roots[0]->data.children.left->data.children.right;
+	cr_assert(eq(ptr, roots[0], SymbolNodeUnary(symbolNodeArray, SQUARE, SymbolNodeBinary(symbolNodeArray, SUSTRACT, v, w))));
+	cr_assert(eq(uint, 2, SymbolNodeVariable(symbolNodeArray)->data.variableId));
+}
+
+Test(symdiff_node, collect_dot, .init = setup, .fini = teardown) {
+	SymbolNode* variable1 = SymbolNodeVariable(symbolNodeArray); // v
+	SymbolNode* variable2 = SymbolNodeVariable(symbolNodeArray); // w
+	SymbolNode* left[] = { variable1, variable2 };
+	SymbolNode* right[] = { variable2, variable2 };
+	SymbolNode* f = SymbolNodeFma(symbolNodeArray, SymbolNodeDot(symbolNodeArray, left, right, 2), variable1, variable2);
+	SymbolNodeDifferentiate(f, symbolNodeArray, variable1);
+
+	// v * w + w * w, then (v * w + w * w) * v + w
+	SymbolNode* roots[] = { f };
+	SymbolNodeArrayCollect(symbolNodeArray, roots, 1);
+	cr_assert(eq(uint, 4, SymbolNodeArrayStatistics(symbolNodeArray).nodeCount));
+
+	// The factors moved with the node, it is interned again
+	SymbolNode* dot = roots[0]->data.children.left;
+	SymbolNode* v = roots[0]->data.children.right;
+	SymbolNode* w = roots[0]->data.children.addend;
+	cr_assert(eq(ptr, v, dot->data.dot.left[0]));
+	cr_assert(eq(ptr, w, dot->data.dot.right[1]));
+	cr_assert(eq(ptr, dot, SymbolNodeDot(symbolNodeArray, (SymbolNode*[]) { v, w }, (SymbolNode*[]) { w, w }, 2)));
+
+	SymbolNode* bound = SymbolNodeEvaluate(roots[0], symbolNodeArray, v, 2);
+	cr_assert(ieee_ulp_eq(flt, (2 * 3 + 3 * 3) * 2 + 3, SymbolNodeEvaluate(bound, symbolNodeArray, w, 3)->data.value, 4));
+}
@@ -0,0 +1,107 @@
+#include "thread_pool.h"
+
+#include <stdlib.h>
+
+#include "custom_assert.h"
+
+// Takes tasks of the current job until there are none left, called and returns with the mutex locked
+static void ThreadPoolWork(ThreadPool* pool) {
+	while (pool->nextTask < pool->taskCount) {
+		const ThreadPoolTask task = pool->task;
+		void* context = pool->context;
+		const unsigned int index = pool->nextTask++;
+
+		pthread_mutex_unlock(&pool->mutex);
+		task(context, index);
+		pthread_mutex_lock(&pool->mutex);
+
+		pool->pendingTasks--;
+		if(pool->pendingTasks == 0) {
+			pthread_cond_broadcast(&pool->finished);
+		}
+	}
+}
+
+static void* ThreadPoolWorker(void* argument) {
+	ThreadPool* pool = argument;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (true) {
+		while (!pool->stopping && pool->nextTask >= pool->taskCount) {
+			pthread_cond_wait(&pool->started, &pool->mutex);
+		}
+		if(pool->stopping) {
+			break;
+		}
+		ThreadPoolWork(pool);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+ThreadPool* ThreadPoolCreate(unsigned int threadCount) {
+	assert(threadCount > 0, "No threads!");
+
+	ThreadPool* pool = malloc(sizeof(ThreadPool));
+	assert(pool != NULL, "No memory!");
+	*pool = (ThreadPool) {
+		.threads = calloc(threadCount, sizeof(pthread_t)),
+		.threadCount = 1,
+		.stopping = false,
+		.task = NULL,
+		.context = NULL,
+		.taskCount = 0,
+		.nextTask = 0,
+		.pendingTasks = 0,
+	};
+	assert(pool->threads != NULL, "No memory!");
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->started, NULL);
+	pthread_cond_init(&pool->finished, NULL);
+
+	// threads[0] stands for the thread running the job, it is never started
+	for (unsigned int i = 1; i < threadCount; ++i) {
+		if(pthread_create(&pool->threads[i], NULL, ThreadPoolWorker, pool) != 0) {
+			break;
+		}
+		pool->threadCount++;
+	}
+
+	return pool;
+}
+
+void ThreadPoolFree(ThreadPool* pool) {
+	pthread_mutex_lock(&pool->mutex);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->started);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (unsigned int i = 1; i < pool->threadCount; ++i) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->finished);
+	pthread_cond_destroy(&pool->started);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	free(pool);
+}
+
+void ThreadPoolRun(ThreadPool* pool, ThreadPoolTask task, void* context, unsigned int taskCount) {
+	pthread_mutex_lock(&pool->mutex);
+	assert(pool->pendingTasks == 0, "Thread pool is already running a job!");
+
+	pool->task = task;
+	pool->context = context;
+	pool->taskCount = taskCount;
+	pool->nextTask = 0;
+	pool->pendingTasks = taskCount;
+	pthread_cond_broadcast(&pool->started);
+
+	ThreadPoolWork(pool);
+	while (pool->pendingTasks > 0) {
+		pthread_cond_wait(&pool->finished, &pool->mutex);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
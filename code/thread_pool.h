@@ -0,0 +1,41 @@
+#ifndef SIMULATOR_THREAD_POOL_H
+#define SIMULATOR_THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+//-----------------------------------------------------------------------------
+// ThreadPool
+//-----------------------------------------------------------------------------
+
+// Runs task for every index of a job, context is shared by all of them
+typedef void (*ThreadPoolTask)(void* context, unsigned int index);
+
+// Worker threads kept waiting between jobs, so running a job does not start any thread
+// Jobs are run one at a time, from one thread, which works on the job too until every task of it is done
+typedef struct ThreadPool {
+	pthread_t* threads;
+	unsigned int threadCount;
+	pthread_mutex_t mutex;
+	pthread_cond_t started;
+	pthread_cond_t finished;
+	bool stopping;
+
+	// Current job, tasks are taken in order by whichever thread is free
+	ThreadPoolTask task;
+	void* context;
+	unsigned int taskCount;
+	unsigned int nextTask;
+	unsigned int pendingTasks;
+} ThreadPool;
+
+// Pool running jobs on threadCount threads, the one running the job and threadCount - 1 workers
+// Fewer workers are kept when the system can not start them all, down to none
+ThreadPool* ThreadPoolCreate(unsigned int threadCount);
+
+void ThreadPoolFree(ThreadPool* pool);
+
+// Runs task for every index below taskCount and returns once all of them are done
+void ThreadPoolRun(ThreadPool* pool, ThreadPoolTask task, void* context, unsigned int taskCount);
+
+#endif //SIMULATOR_THREAD_POOL_H